@@ -182,5 +182,185 @@ class AirConPowerLimitationOnAction : public Action<Ts...> {
     uint8_t pwr_lim_;
 };
 
+// **************************************** SEND COMMAND ACTIONS ****************************************
+// любой набор параметров одной командой: один обмен со сплитом вместо отдельного на каждое действие
+// vlouver - положение шторки в кодах фронтенда (как у vlouver_set), power_limit = 0 выключает ограничение мощности
+// режим, вентилятор и пресеты переводятся в команду теми же функциями, что и в control()
+template <typename... Ts>
+class AirConCommandAction : public Action<Ts...> {
+   public:
+    TEMPLATABLE_VALUE(ClimateMode, mode);
+    TEMPLATABLE_VALUE(bool, power);
+    TEMPLATABLE_VALUE(float, target_temperature);
+    TEMPLATABLE_VALUE(ClimateFanMode, fan_mode);
+    TEMPLATABLE_VALUE(bool, fan_turbo);
+    TEMPLATABLE_VALUE(bool, fan_mute);
+    TEMPLATABLE_VALUE(uint8_t, vlouver);
+    TEMPLATABLE_VALUE(bool, hlouver_swing);
+    TEMPLATABLE_VALUE(bool, health);
+    TEMPLATABLE_VALUE(bool, clean);
+    TEMPLATABLE_VALUE(bool, mildew);
+    TEMPLATABLE_VALUE(bool, display);
+    TEMPLATABLE_VALUE(uint8_t, power_limit);
+
+   protected:
+    // собирает команду для конкретного кондиционера; false - отправлять нечего
+    bool build_command_(AirCon *ac, ac_command_t *cmd, Ts... x) {
+        *cmd = ac->newCommand();
+        bool has_command = false;
+
+        // режим первым: он может подгрузить сохраненный пресет, а остальные поля его уточняют
+        if (this->mode_.has_value()) {
+            has_command |= ac->climateModeCommand(cmd, this->mode_.value(x...));
+        }
+        if (this->power_.has_value()) {
+            cmd->power = this->power_.value(x...) ? AC_POWER_ON : AC_POWER_OFF;
+            has_command = true;
+        }
+        if (this->target_temperature_.has_value()) {
+            cmd->temp_target = this->target_temperature_.value(x...);
+            cmd->temp_target_matter = true;
+            has_command = true;
+        }
+        if (this->fan_mode_.has_value()) {
+            has_command |= ac->climateFanModeCommand(cmd, this->fan_mode_.value(x...));
+        }
+        if (this->fan_turbo_.has_value()) {
+            has_command |= ac->commandFanTurbo(cmd, this->fan_turbo_.value(x...));
+        }
+        if (this->fan_mute_.has_value()) {
+            has_command |= ac->commandFanMute(cmd, this->fan_mute_.value(x...));
+        }
+        if (this->vlouver_.has_value()) {
+            ac_louver_V vlouver = ac->vlouverFrontendToAUXvlouver((ac_vlouver_frontend)this->vlouver_.value(x...));
+            has_command |= ac->commandVLouver(cmd, vlouver);
+        }
+        if (this->hlouver_swing_.has_value()) {
+            has_command |= ac->commandHLouverSwing(cmd, this->hlouver_swing_.value(x...));
+        }
+        if (this->health_.has_value()) {
+            has_command |= ac->commandHealth(cmd, this->health_.value(x...));
+        }
+        if (this->clean_.has_value()) {
+            has_command |= ac->commandClean(cmd, this->clean_.value(x...));
+        }
+        if (this->mildew_.has_value()) {
+            has_command |= ac->commandMildew(cmd, this->mildew_.value(x...));
+        }
+        if (this->display_.has_value()) {
+            cmd->display = ac->displayCommandCode(this->display_.value(x...));
+            has_command = true;
+        }
+        if (this->power_limit_.has_value()) {
+            uint8_t power_limit = this->power_limit_.value(x...);
+            has_command |= ac->commandPowerLimitation(cmd, power_limit != 0, power_limit);
+        }
+        return has_command;
+    }
+};
+
+template <typename... Ts>
+class AirConSendCommandAction : public AirConCommandAction<Ts...> {
+   public:
+    explicit AirConSendCommandAction(AirCon *ac) : ac_(ac) {}
+
+    void play(Ts... x) override {
+        ac_command_t cmd;
+        if (this->build_command_(this->ac_, &cmd, x...)) this->ac_->commandSequence(&cmd);
+    }
+
+   protected:
+    AirCon *ac_;
+};
+
+// одна команда нескольким кондиционерам узла: обмены идут одновременно, у каждого по своему UART
+// следующее действие автоматизации выполняется, когда отчитались все кондиционеры группы
+// когда это происходит, решает AirConGroupCommandRun (проверяется на хосте), здесь только связка с ESPHome
+template <typename... Ts>
+class AirConGroupCommandAction : public AirConCommandAction<Ts...> {
+   public:
+    explicit AirConGroupCommandAction(const std::vector<AirCon *> &units) : units_(units) {
+        if (this->units_.size() > AC_GROUP_MAX_UNITS) this->units_.resize(AC_GROUP_MAX_UNITS);
+        for (uint8_t i = 0; i < this->units_.size(); i++) {
+            this->units_[i]->add_on_command_done_callback([this, i](bool success) {
+                if (this->run_.finished(i, success, millis())) this->complete_();
+            });
+        }
+    }
+
+    void play_complex(Ts... x) override {
+        // новая рассылка, пока идет прежняя: прежнюю больше не ждем
+        if (this->run_.stop()) this->complete_();
+        this->num_running_++;
+        this->var_ = std::make_tuple(x...);
+
+        bool complete = this->run_.start(this->units_.size(), millis(), [&](uint8_t i) {
+            ac_command_t cmd;
+            return this->build_command_(this->units_[i], &cmd, x...) && this->units_[i]->commandSequence(&cmd);
+        });
+        if (complete) this->complete_();
+    }
+
+    void play(Ts... x) override { /* вся работа в play_complex() */ }
+
+    // автоматизацию остановили (script.stop и т.п.): отчеты кондиционеров больше не ждем
+    void stop() override { this->run_.stop(); }
+
+   protected:
+    void complete_() {
+        if (this->num_running_ == 0) return;
+        AirConCommandGroup &group = this->run_.get_group();
+        for (uint8_t i = 0; i < this->units_.size(); i++) {
+            ac_group_unit_state state = group.get_unit_state(i);
+            ESP_LOGD(TAG, "Group command: unit %u %s in %u ms", i, (state == AC_GROUP_UNIT_DONE) ? "done" : (state == AC_GROUP_UNIT_FAILED) ? "failed" : "pending",
+                     group.get_unit_time(i));
+        }
+        ESP_LOGD(TAG, "Group command: %u of %u units done, %u failed, %u ms total", group.get_done(), group.get_count(),
+                 group.get_failed(), group.get_elapsed(millis()));
+        this->play_next_tuple_(this->var_);
+    }
+
+    std::vector<AirCon *> units_;
+    AirConGroupCommandRun run_;
+    std::tuple<Ts...> var_{};
+};
+
+// выгрузка истории телеметрии; куски приходят в триггер on_chunk
+template <typename... Ts>
+class AirConHistoryDumpAction : public Action<Ts...> {
+   public:
+    explicit AirConHistoryDumpAction(AirCon *ac) : ac_(ac) {}
+
+    void play(Ts... x) override { this->ac_->start_history_dump(); }
+
+   protected:
+    AirCon *ac_;
+};
+
+// **************************************** TRIGGERS ****************************************
+// последовательность с командой закончилась; success - сплит подтвердил команду
+class AirConCommandDoneTrigger : public Trigger<bool> {
+   public:
+    explicit AirConCommandDoneTrigger(AirCon *ac) {
+        ac->add_on_command_done_callback([this](bool success) { this->trigger(success); });
+    }
+};
+
+// сплит не подтвердил команду, и оптимистично опубликованное состояние откачено
+class AirConCommandRollbackTrigger : public Trigger<> {
+   public:
+    explicit AirConCommandRollbackTrigger(AirCon *ac) {
+        ac->add_on_command_rollback_callback([this]() { this->trigger(); });
+    }
+};
+
+// очередной кусок выгрузки истории: CSV-строки и признак последнего куска
+class AirConHistoryChunkTrigger : public Trigger<std::string, bool> {
+   public:
+    explicit AirConHistoryChunkTrigger(AirCon *ac) {
+        ac->add_on_history_chunk_callback([this](std::string chunk, bool last) { this->trigger(chunk, last); });
+    }
+};
+
 }  // namespace aux_ac
 }  // namespace esphome
\ No newline at end of file
@@ -0,0 +1,4632 @@
+// Custom ESPHome component for AUX-based air conditioners
+// Source code and detailed instructions are available on github: https://github.com/GrKoR/esphome_aux_ac_component
+//
+// Ядро протокола AUX: структуры пакетов, CRC, сборка и разбор пакетов, конечный автомат приёма-передачи
+// и движок последовательностей команд. Ядро не зависит ни от Arduino, ни от ESPHome: с UART, часами и логом
+// оно работает только через интерфейсы AirConUart, AirConClock и AirConLogger. Поэтому его можно собрать
+// и протестировать на обычном компьютере (см. tests/host). Для ESPHome ядро оборачивает класс AirCon из aux_ac.h.
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#endif
+
+namespace esphome {
+namespace aux_ac {
+
+// уровни лога совпадают с уровнями ESPHome; на устройстве они уже определены в esphome/core/log.h
+#ifndef ESPHOME_LOG_LEVEL_NONE
+#define ESPHOME_LOG_LEVEL_NONE 0
+#define ESPHOME_LOG_LEVEL_ERROR 1
+#define ESPHOME_LOG_LEVEL_WARN 2
+#define ESPHOME_LOG_LEVEL_INFO 3
+#define ESPHOME_LOG_LEVEL_CONFIG 4
+#define ESPHOME_LOG_LEVEL_DEBUG 5
+#define ESPHOME_LOG_LEVEL_VERBOSE 6
+#define ESPHOME_LOG_LEVEL_VERY_VERBOSE 7
+#endif
+
+// на Arduino строки сообщений лога лежат во флеше (макрос F()) и передаются как String,
+// на компьютере это обычные строки
+#if defined(ARDUINO)
+typedef const String &ac_log_msg_t;
+#else
+#ifndef F
+#define F(s) (s)
+#endif
+typedef const char *ac_log_msg_t;
+#endif
+
+//****************************************************************************************************************************************************
+//**************************************************** Packet logger configuration *******************************************************************
+//****************************************************************************************************************************************************
+// v.0.2.9: замена директиве HOLMS
+#ifdef HOLMS
+#undef HOLMS
+#warning "HOLMS was deprecated in v.0.2.9. Use HOLMES_x instead (see below)."
+#endif
+
+// Директива HOLMES_WORKS позволяет включить (true) или выключить (false) вывод пакетов в лог
+// Причём отключение вывода пакетов не затронет вывод остальных данных
+#define HOLMES_WORKS true
+
+// Директива HOLMES_BYTE_FORMAT задаёт формат вывод каждого байта пакета в лог в формате sprintf.
+// Для вывода в шестнадцатиричном виде с двумя знаками, задайте "%02X".
+// Для вывода в десятичном виде с тремя знаками, задайте "%03d".
+#define HOLMES_BYTE_FORMAT "%02X"
+
+// Директива HOLMES_FILTER_LEN обеспечивает фильтрацию вывода пакетов в лог.
+// Все корректные пакеты, длина тела которых короче HOLMES_FILTER_LEN, будут проигнорированы.
+// Все корректные пакеты, длина тела которых HOLMES_FILTER_LEN и более, попадут в лог.
+// Все данные, не являющиеся корректными пакетами, попадут в лог в любом случае. Это нужно для целей отладки.
+// В протоколе встречаются пакеты с телом следующей длины: 0, 1, 2, 4, 8, 15, 23
+#define HOLMES_FILTER_LEN 0
+
+// Директива HOLMES_DELIMITER позволяет задать разделитель байт при выводе в лог
+// Для "классического" вывода задайте " "
+// Для вывода "под Excel" задайте ";"
+#define HOLMES_DELIMITER " "
+
+// Директивы HOLMES_x_BRACKET_OPEN и HOLMES_x_BRACKET_CLOSE задают открывающую и
+// закрывающую скобки для заголовка и CRC.
+// Если вместо скобок указать "", то в логе скобок не будет.
+#define HOLMES_HEADER_BRACKET_OPEN "["
+#define HOLMES_HEADER_BRACKET_CLOSE "]"
+#define HOLMES_CRC_BRACKET_OPEN "["
+#define HOLMES_CRC_BRACKET_CLOSE "]"
+
+//****************************************************************************************************************************************************
+//*************************************************** Loop profiler configuration ********************************************************************
+//****************************************************************************************************************************************************
+// Директива AC_LOOP_PROFILER включает замер времени, которое тратят обработчики состояний конечного автомата
+// (_doIdleState, _doReceivingPacketState, _doParsingPacket, _doSendingPacketState), а также stateChanged() и publish_all_states().
+// Для каждого обработчика копятся минимальное, среднее и максимальное время выполнения в микросекундах и количество вызовов.
+// Статистика выводится в лог из dump_config() (то есть при подключении к логам через API или при старте).
+// Нужно для поиска причин предупреждений ESPHome о слишком долгой работе компонента в loop().
+// Сами замеры тоже стоят времени, поэтому по умолчанию выключено.
+//#define AC_LOOP_PROFILER
+
+//****************************************************************************************************************************************************
+//************************************************* Constants for ESPHome integration ****************************************************************
+//****************************************************************************************************************************************************
+// строковая константа: текст и его длина известны при компиляции, при старте в куче ничего не создается
+// сравнение со std::string идет по длине и memcmp, без временных строк
+struct ac_const_str_t {
+    const char *str;
+    size_t len;
+
+    const char *c_str() const { return str; }
+    size_t size() const { return len; }
+    // копия в виде std::string, например, для custom_preset и custom_fan_mode
+    std::string to_string() const { return std::string(str, len); }
+};
+#define AC_CONST_STR(s) ac_const_str_t{s, sizeof(s) - 1}
+
+inline bool operator==(const std::string &a, const ac_const_str_t &b) { return (a.size() == b.len) && (memcmp(a.data(), b.str, b.len) == 0); }
+inline bool operator==(const ac_const_str_t &a, const std::string &b) { return b == a; }
+inline bool operator!=(const std::string &a, const ac_const_str_t &b) { return !(a == b); }
+inline bool operator!=(const ac_const_str_t &a, const std::string &b) { return !(b == a); }
+
+class Constants {
+   public:
+    static constexpr ac_const_str_t AC_FIRMWARE_VERSION = AC_CONST_STR("0.2.10");
+
+    // custom fan modes
+    static constexpr ac_const_str_t MUTE = AC_CONST_STR("mute");
+    static constexpr ac_const_str_t TURBO = AC_CONST_STR("turbo");
+
+    // custom presets
+    static constexpr ac_const_str_t CLEAN = AC_CONST_STR("Clean");
+    static constexpr ac_const_str_t HEALTH = AC_CONST_STR("Health");
+    static constexpr ac_const_str_t ANTIFUNGUS = AC_CONST_STR("Antifungus");
+
+    /// минимальная и максимальная температура в градусах Цельсия, ограничения самого кондиционера
+    static const float AC_MIN_TEMPERATURE;
+    static const float AC_MAX_TEMPERATURE;
+    /// шаг изменения целевой температуры, градусы Цельсия
+    static const float AC_TEMPERATURE_STEP;
+
+    /// минимальное и максимальное значение мощности инвертора при установке ограничений
+    static const uint8_t AC_MIN_INVERTER_POWER_LIMIT;
+    static const uint8_t AC_MAX_INVERTER_POWER_LIMIT;
+
+    // периодичность опроса кондиционера на предмет изменения состояния
+    // изменение параметров с пульта не сообщается в UART, поэтому надо запрашивать состояние, чтобы быть в курсе
+    // значение в миллисекундах
+    static const uint32_t AC_STATES_REQUEST_INTERVAL;
+
+    // границы допустимого диапазона таймаута загрузки пакета
+    // таймаут загрузки - через такое количиство миллисекунд конечный автомат перейдет из
+    // состояния ACSM_RECEIVING_PACKET в ACSM_IDLE, если пакет не будет загружен
+    static const uint32_t AC_PACKET_TIMEOUT_MAX;
+    static const uint32_t AC_PACKET_TIMEOUT_MIN;
+
+    // время передачи одного байта по UART в микросекундах для штатных настроек (4800 бод, 8E1 = 11 бит на байт)
+    // используется, пока время не рассчитано по реальным настройкам UART
+    static const uint32_t AC_UART_BYTE_TIME_US;
+
+    // защитный интервал тишины на линии перед началом передачи, миллисекунды
+    // передача начинается только если от кондиционера не приходило ни одного байта в течение этого времени
+    static const uint32_t AC_TX_GUARD_TIME_DEFAULT;
+    static const uint32_t AC_TX_GUARD_TIME_MAX;
+
+    // снимок состояния пишется во флеш, если оно не менялось столько миллисекунд
+    static const uint32_t AC_SNAPSHOT_SAVE_DELAY;
+
+    // бюджет общего планировщика узла на один проход главного цикла: байты разбираемых пакетов и публикуемые сущности
+    static const uint16_t AC_SCHEDULER_TICK_BYTES;
+    static const uint16_t AC_SCHEDULER_TICK_ENTITIES;
+
+    // бюджет мощности узла: как часто пересчитываются ограничения, миллисекунды
+    static const uint32_t AC_POWER_BUDGET_INTERVAL;
+    // не чаще какого интервала менять ограничение одному кондиционеру, миллисекунды
+    static const uint32_t AC_POWER_BUDGET_HOLD_TIME;
+    // шаг ограничения мощности в %, меньшие изменения на сплит не отправляются
+    static const uint8_t AC_POWER_BUDGET_STEP;
+    // запас к текущей мощности в % для кондиционера, который уже добрался до целевой температуры
+    static const uint8_t AC_POWER_BUDGET_HEADROOM;
+    // до целевой температуры ближе этого - кондиционер считается добравшимся, градусы Цельсия
+    static const float AC_POWER_BUDGET_DEADBAND;
+
+    // как часто накопленная оценка энергии пишется во флеш, миллисекунды
+    static const uint32_t AC_ENERGY_SAVE_INTERVAL;
+};
+
+constexpr ac_const_str_t Constants::AC_FIRMWARE_VERSION;
+
+constexpr ac_const_str_t Constants::MUTE;
+constexpr ac_const_str_t Constants::TURBO;
+
+constexpr ac_const_str_t Constants::CLEAN;
+constexpr ac_const_str_t Constants::HEALTH;
+constexpr ac_const_str_t Constants::ANTIFUNGUS;
+
+// params
+const float Constants::AC_MIN_TEMPERATURE = 16.0;
+const float Constants::AC_MAX_TEMPERATURE = 32.0;
+const float Constants::AC_TEMPERATURE_STEP = 0.5;
+const uint8_t Constants::AC_MIN_INVERTER_POWER_LIMIT = 30;  // 30%
+const uint8_t Constants::AC_MAX_INVERTER_POWER_LIMIT = 100; // 100%
+const uint32_t Constants::AC_STATES_REQUEST_INTERVAL = 7000;
+// таймаут загрузки пакета
+// По расчетам выходит:
+//      - получение и обработка посимвольно не должна длиться дольше 600 мсек.
+//      - получение и обработка пакетов целиком не должна длиться дольше 150 мсек.
+// Мы будем обрабатывать пакетами, поэтому 150.
+// Растягивать приём пакетов очередью команд нельзя, так как кондиционер иногда посылает
+// информационные пакеты без запроса. Такие пакеты будут рушить последовательность команд,
+// команды будут теряться. От такой коллизии мы не защищены в любом случае. Но чем меньше таймаут,
+// тем меньше шансов на коллизию.
+// Из этих соображений выбраны границы диапазона (_MIN и _MAX значения).
+const uint32_t Constants::AC_PACKET_TIMEOUT_MAX = 600;
+const uint32_t Constants::AC_PACKET_TIMEOUT_MIN = 150;
+const uint32_t Constants::AC_UART_BYTE_TIME_US = 2292;  // 11 бит * 1000000 / 4800 бод
+// Кондиционер иногда сам отправляет пакеты без запроса (см. комментарий к таймауту загрузки пакета выше).
+// Если в этот момент начать передачу, то наш пакет и пакет сплита столкнутся, последовательность команд развалится.
+// Поэтому перед передачей ждем, чтобы на линии была тишина. Один байт на 4800 8E1 идет 2,3 мс,
+// внутри пакета пауз между байтами нет, так что 10 мс тишины - это уже точно межпакетный интервал.
+const uint32_t Constants::AC_TX_GUARD_TIME_DEFAULT = 10;
+const uint32_t Constants::AC_TX_GUARD_TIME_MAX = 100;
+const uint32_t Constants::AC_SNAPSHOT_SAVE_DELAY = 60000;
+// большой статус - 34-35 байт, малый - 25: за проход разбирается пакет-другой,
+// а публикация одного кондиционера со всеми датчиками - это 13 сущностей
+const uint16_t Constants::AC_SCHEDULER_TICK_BYTES = 64;
+const uint16_t Constants::AC_SCHEDULER_TICK_ENTITIES = 16;
+// большой статус приходит раз в период опроса (7 с), чаще пересчитывать нет смысла;
+// каждое изменение ограничения - это обмен по линии, поэтому одному сплиту - не чаще раза в минуту
+const uint32_t Constants::AC_POWER_BUDGET_INTERVAL = 5000;
+const uint32_t Constants::AC_POWER_BUDGET_HOLD_TIME = 60000;
+const uint8_t Constants::AC_POWER_BUDGET_STEP = 5;
+const uint8_t Constants::AC_POWER_BUDGET_HEADROOM = 10;
+const float Constants::AC_POWER_BUDGET_DEADBAND = 0.5;
+// при внезапном отключении питания теряется не больше 10 минут счета, а во флеш уходит всего шесть записей в час
+const uint32_t Constants::AC_ENERGY_SAVE_INTERVAL = 600000;
+
+
+
+//****************************************************************************************************************************************************
+//********************************************************* ОСНОВНЫЕ СТРУКТУРЫ ***********************************************************************
+//****************************************************************************************************************************************************
+class AirConCore;
+
+// состояния конечного автомата компонента
+enum acsm_state : uint8_t {
+    ACSM_IDLE = 0,          // ничего не делаем, ждем, на что бы среагировать
+    ACSM_RECEIVING_PACKET,  // находимся в процессе получения пакета, никакие отправки в этом состоянии невозможны
+    ACSM_PARSING_PACKET,    // разбираем полученный пакет
+    ACSM_SENDING_PACKET,    // отправляем пакет сплиту
+};
+
+#if defined(AC_LOOP_PROFILER)
+// точки замера профайлера
+enum ac_profiler_point : uint8_t {
+    AC_PROF_IDLE = 0,       // _doIdleState()
+    AC_PROF_RECEIVING,      // _doReceivingPacketState()
+    AC_PROF_PARSING,        // _doParsingPacket()
+    AC_PROF_SENDING,        // _doSendingPacketState()
+    AC_PROF_STATE_CHANGED,  // stateChanged(), включая вложенный publish_all_states()
+    AC_PROF_PUBLISH,        // publish_all_states()
+    AC_PROF_COUNT           // количество точек замера, должно быть последним
+};
+
+// названия точек замера для вывода в лог, порядок как в ac_profiler_point
+static const char *const AC_PROFILER_POINT_NAMES[AC_PROF_COUNT] = {
+    "_doIdleState",
+    "_doReceivingPacketState",
+    "_doParsingPacket",
+    "_doSendingPacketState",
+    "stateChanged",
+    "publish_all_states",
+};
+
+// статистика одной точки замера, все времена в микросекундах
+struct ac_profiler_stat_t {
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t calls;
+};
+
+// замер начинается в начале блока и заканчивается в указанной точке
+#define AC_PROFILER_START() uint32_t _profiler_start_us = this->_micros()
+#define AC_PROFILER_STOP(point) this->_profilerAdd(point, this->_micros() - _profiler_start_us)
+#else
+#define AC_PROFILER_START()
+#define AC_PROFILER_STOP(point)
+#endif
+
+// структура пакета описана тут:
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_structure
+#define AC_HEADER_SIZE 8
+
+// стандартно длина пакета не более 34 байт
+// но встретилось исключение Royal Clima (как минимум, модель CO-D xxHNI) - у них 35 байт
+// поэтому буффер увеличен
+#define AC_BUFFER_SIZE 35
+
+// размер строки для вывода пакета в лог (см. _debugPrintPacket)
+#define AC_DEBUG_PACKET_STR_LEN (24 + AC_BUFFER_SIZE * 8)
+
+// типы пакетов
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_types
+#define AC_PTYPE_PING 0x01  // ping-пакет
+#define AC_PTYPE_CMD 0x06   // команда сплиту
+#define AC_PTYPE_INFO 0x07  // информационный пакет
+#define AC_PTYPE_INIT 0x09  // инициирующий пакет
+#define AC_PTYPE_UNKN 0x0b  // какой-то странный пакет
+
+// типы команд
+// смотреть тут: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_type_cmd
+#define AC_CMD_SET_PARAMS 0x01    // команда установки параметров кондиционера
+#define AC_CMD_STATUS_SMALL 0x11  // маленький пакет статуса кондиционера
+#define AC_CMD_STATUS_BIG 0x21    // большой пакет статуса кондиционера
+// TODO: Нужно посмотреть, где используется AC_CMD_STATUS_PERIODIC, и изменить логику.
+// на сегодня уже известно, что периодически рассылаются команды в диапазоне 0x20..0x2F
+#define AC_CMD_STATUS_PERIODIC 0x2C  // иногда встречается
+
+// значения байтов в пакетах
+#define AC_PACKET_START_BYTE 0xBB  // Стартовый байт любого пакета 0xBB, других не встречал
+#define AC_PACKET_ANSWER 0x80      // признак ответа wifi-модуля
+
+// заголовок пакета
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_header
+struct packet_header_t {
+    uint8_t start_byte = AC_PACKET_START_BYTE;
+    uint8_t _unknown1;
+    uint8_t packet_type;
+    uint8_t wifi;
+    uint8_t ping_answer_01;
+    uint8_t _unknown2;
+    uint8_t body_length;
+    uint8_t _unknown3;
+};
+
+// CRC пакета
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_crc
+// CRC лежит сразу за телом и при нечетной длине тела попадает на нечетный адрес, поэтому union упакован
+union __attribute__((packed)) packet_crc_t {
+    uint16_t crc16;
+    uint8_t crc[2];
+};
+
+// структура пекета[)
+struct packet_t {
+    uint32_t msec;  // значение millis в момент определения корректности пакета
+    packet_header_t *header;
+    packet_crc_t *crc;
+    uint8_t *body;        // указатель на первый байт тела; можно приведением типов указателей обращаться к отдельным битам как к полям соответсвующей структуры
+    uint8_t bytesLoaded;  //количество загруженных в пакет байт, включая CRC
+    uint8_t data[AC_BUFFER_SIZE];
+};
+
+// тело ответа на пинг
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_type_ping
+struct packet_ping_answer_body_t {
+    uint8_t byte_1C = 0x1C;
+    uint8_t byte_27 = 0x27;
+    uint8_t zero1 = 0;
+    uint8_t zero2 = 0;
+    uint8_t zero3 = 0;
+    uint8_t zero4 = 0;
+    uint8_t zero5 = 0;
+    uint8_t zero6 = 0;
+};
+
+// тело большого информационного пакета
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21
+struct packet_big_info_body_t {
+    // байт 0 тела (байт 8 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b08
+    uint8_t byte_01 = 0x01;
+
+    // байт 1 тела (байт 9 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b09
+    uint8_t cmd_answer;
+
+    // байт 2 тела (байт 10 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b10
+    uint8_t reserv20 : 2;
+    bool is_inverter_periodic : 1;  // флаг периодического пакета инверторного кондиционера
+    uint8_t reserv23 : 2;
+    bool is_inverter : 1;  // флаг инвертора
+    uint8_t reserv26 : 2;
+
+    // байт 3 тела (байт 11 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b11
+    bool power : 1;
+    bool sleep : 1;
+    bool v_louver : 1;
+    bool h_louver : 1;
+    bool louvers_on : 1;
+    uint8_t mode : 3;
+    //   #define AC_BIG_MASK_MODE  b11100000
+    //   enum { AC_BIG_MODE_DRY  = 0x40,
+    //          AC_BIG_MODE_COOL = 0x20,
+    //          AC_BIG_MODE_HEAT = 0x80,
+    //          AC_BIG_MODE_FAN  = 0xC0}
+    //   #define AC_BIG_MASK_POWER       b00000001
+    //   #define AC_BIG_MASK_LOUVERS_ON  b00010000
+    //   #define AC_BIG_MASK_LOUVERS_H   b00000100
+    //   #define AC_BIG_MASK_LOUVERS_L   b00001000
+    //   #define AC_BIG_MASK_SLEEP       b00000010
+    //   #define AC_BIG_MASK_COOL        b00100000
+
+    // байт 4 тела (байт 12 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b12
+    uint8_t reserv40 : 4;
+    bool needDefrost : 1;
+    bool defrostMode : 1;
+    bool reserv46 : 1;
+    bool clean : 1;
+    // Для кондея старт-стоп
+    //    x xx
+    // C5 1100 0101
+    // C4 1100 0100
+    // 85 1000 0101
+    // 84 1000 0100
+    // 3D 0011 1101
+    // 3C 0011 1100
+    // 25 0010 0101
+    // 24 0010 0100
+    //  5 0000 0101
+    //  4 0000 0100
+
+    // байт 5 тела (байт 13 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b13
+    uint8_t realFanSpeed : 3;  // реальная (не заданная) скорость вентилятора
+    uint8_t reserv53 : 5;
+    // в дежурных пакетах тут похоже что-то другое
+
+    // байт 6 тела (байт 14 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b14
+
+    bool reserv60 : 1;
+    uint8_t fanPWM : 7;  // ШИМ вентилятора
+
+    // байт 7 тела (байт 15 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b15
+    uint8_t ambient_temperature_int;
+
+    // байт 8 тела (байт 16 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b16
+    uint8_t zero3;  // не расшифрован, у кого-то всегда 0x00, у кого-то повторяет значение байта 17 пакета. Непонятно.
+
+    // байт 9 тела (байт 17 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b17
+    uint8_t in_temperature_int;  // какая-то температура, детали см. в описании на гитхабе
+
+    // байт 10 тела (байт 18 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b18
+    uint8_t zero4;  // не расшифрован
+
+    // байт 11 тела (байт 19 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b19
+    uint8_t zero5;  // всегда 0x00 или 0x64
+
+    // байт 12 тела (байт 20 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b20
+    uint8_t outdoor_temperature;  // Внешняя температура; формула T - 0x20
+
+    // байт 13 тела (байт 21 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b21
+    uint8_t out_temperature_int;  // похоже на температуру обратки, T - 0x20
+
+    // байт 14 тела (байт 22 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b22
+    uint8_t compressor_temperature_int;  // от режима не зависит, растет при включении инвертора; температура двигателя?
+
+    // байт 15 тела (байт 23 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b23
+    uint8_t zero9;  // не расшифрован, подробнее в описании
+
+    // байт 16 тела (байт 24 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b24
+    uint8_t inverter_power;  // мощность инвертора (от 0 до 100) в %
+
+    // байт 17 тела (байт 25 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b25
+    uint8_t zero11;  // не расшифрован, подробнее в описании.
+
+    // байт 18 тела (байт 26 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b26
+    uint8_t zero12;  // не расшифрован, подробнее в описании.
+
+    // байт 19 тела (байт 27 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b27
+    uint8_t zero13;  // не расшифрован, подробнее в описании.
+
+    // байт 20 тела (байт 28 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b28
+    uint8_t zero14;  // не расшифрован, подробнее в описании.
+
+    // байт 21 тела (байт 29 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b29
+    uint8_t zero15;  // всегда 0x00
+
+    // байт 22 тела (байт 30 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b30
+    uint8_t zero16;  // всегда 0x00
+
+    // байт 23 тела (байт 31 пакета)
+    // https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_21_b31
+    uint8_t ambient_temperature_frac : 4;  // дробная часть комнатной температуры воздуха с датчика на внутреннем блоке сплит-системы
+    uint8_t reserv234 : 1;
+    bool unknown : 1;  // для `Royal Clima 18HNI` в этом бите `1`. Не понятно, что это значит. У других сплитов такое не встречалось.
+    uint8_t reserv236 : 2;
+};
+
+// тело малого информационного пакета
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11
+struct packet_small_info_body_t {
+    // байт 8 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b08
+    uint8_t byte_01;
+
+    // байт 9 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b09
+    uint8_t cmd_answer;
+
+    // байт 10 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b10
+    //uint8_t target_temp_int_and_v_louver;
+    uint8_t v_louver : 3;
+    uint8_t target_temp_int : 5;
+
+
+    // байт 11 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b11
+    uint8_t h_louver;
+
+    // байт 12 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b12
+    //uint8_t target_temp_frac;
+    uint8_t ir_timer : 6;
+    bool reserv126 : 1;
+    bool target_temp_frac_bool : 1;
+
+    // байт 13 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b13
+    uint8_t fan_speed;
+
+    // байт 14 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b14
+    uint8_t fan_turbo_and_mute;
+
+    // байт 15 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b15
+    uint8_t mode;
+
+    // байт 16 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b16
+    uint8_t zero1;  // всегда 0x00
+
+    // байт 17 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b17
+    uint8_t zero2;  // всегда 0x00
+
+    // байт 18 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b18
+    uint8_t status;
+
+    // байт 19 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b19
+    uint8_t zero3;  // всегда 0x00
+
+    // байт 20 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b20
+    uint8_t display_and_mildew;
+
+    // байт 21 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b21
+    uint8_t inverter_power_limitation_value : 7;
+    bool inverter_power_limitation_enable : 1;
+
+    // байт 22 пакета: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b22
+    uint8_t target_temp_frac_dec;
+};
+
+//****************************************************************************************************************************************************
+//*************************************************** ПАРАМЕТРЫ РАБОТЫ КОНДИЦИОНЕРА ******************************************************************
+//****************************************************************************************************************************************************
+// для всех параметров ниже вариант X_UNTOUCHED = 0xFF означает, что этот параметр команды должен остаться тот, который уже установлен
+
+// питание кондиционера
+#define AC_POWER_MASK 0b00100000
+enum ac_power : uint8_t { AC_POWER_OFF = 0x00,
+                          AC_POWER_ON = 0x20,
+                          AC_POWER_UNTOUCHED = 0xFF };
+
+// режим очистки кондиционера, включается (или должен включаться) при AC_POWER_OFF
+#define AC_CLEAN_MASK 0b00000100
+enum ac_clean : uint8_t { AC_CLEAN_OFF = 0x00,
+                          AC_CLEAN_ON = 0x04,
+                          AC_CLEAN_UNTOUCHED = 0xFF };
+
+// для включения ионизатора нужно установить второй бит в байте
+// по результату этот бит останется установленным, но кондиционер еще и установит первый бит
+#define AC_HEALTH_MASK 0b00000010
+enum ac_health : uint8_t { AC_HEALTH_OFF = 0x00,
+                           AC_HEALTH_ON = 0x02,
+                           AC_HEALTH_UNTOUCHED = 0xFF };
+
+// Статус ионизатора. Если бит поднят, то обнаружена ошибка ключения ионизатора
+#define AC_HEALTH_STATUS_MASK 0b00000001
+enum ac_health_status : uint8_t { AC_HEALTH_STATUS_OFF = 0x00,
+                                  AC_HEALTH_STATUS_ON = 0x01,
+                                  AC_HEALTH_STATUS_UNTOUCHED = 0xFF };
+
+// целевая температура
+#define AC_TEMP_TARGET_INT_PART_MASK 0b11111000
+#define AC_TEMP_TARGET_FRAC_PART_MASK 0b10000000
+
+// задержка отключения кондиционера
+#define AC_TIMER_MINUTES_MASK 0b00111111
+#define AC_TIMER_HOURS_MASK 0b00011111
+
+// включение таймера сна
+#define AC_TIMER_MASK 0b01000000
+enum ac_timer : uint8_t { AC_TIMER_OFF = 0x00,
+                          AC_TIMER_ON = 0x40,
+                          AC_TIMER_UNTOUCHED = 0xFF };
+
+// основные режимы работы кондиционера
+#define AC_MODE_MASK 0b11100000
+enum ac_mode : uint8_t { AC_MODE_AUTO = 0x00,
+                         AC_MODE_COOL = 0x20,
+                         AC_MODE_DRY = 0x40,
+                         AC_MODE_HEAT = 0x80,
+                         AC_MODE_FAN = 0xC0,
+                         AC_MODE_UNTOUCHED = 0xFF };
+
+// Ночной режим (SLEEP). Комбинируется только с режимами COOL и HEAT. Автоматически выключается через 7 часов.
+// COOL: температура +1 градус через час, еще через час дополнительные +1 градус, дальше не меняется.
+// HEAT: температура -2 градуса через час, еще через час дополнительные -2 градуса, дальше не меняется.
+// Восстанавливается ли температура через 7 часов при отключении режима - не понятно.
+#define AC_SLEEP_MASK 0b00000100
+enum ac_sleep : uint8_t { AC_SLEEP_OFF = 0x00,
+                          AC_SLEEP_ON = 0x04,
+                          AC_SLEEP_UNTOUCHED = 0xFF };
+
+// Вертикальные жалюзи. В протоколе зашита возможность двигать ими по всякому, но должна быть такая возможность на уровне железа.
+#define AC_LOUVERV_MASK 0b00000111
+enum ac_louver_V : uint8_t {
+    AC_LOUVERV_SWING_UPDOWN = 0x00,
+    AC_LOUVERV_SWING_TOP = 0x01,
+    AC_LOUVERV_SWING_MIDDLE_ABOVE = 0x02,
+    AC_LOUVERV_SWING_MIDDLE = 0x03,
+    AC_LOUVERV_SWING_MIDDLE_BELOW = 0x04,
+    AC_LOUVERV_SWING_BOTTOM = 0x05,
+    // 0x06 ничего не даёт, протестировано
+    AC_LOUVERV_OFF = 0x07,
+    AC_LOUVERV_UNTOUCHED = 0xFF
+};
+
+// Горизонтальные жалюзи. В протоколе зашита возможность двигать ими по всякому, но должна быть такая возможность на уровне железа.
+// горизонтальные жалюзи выставлять в определенное положение не вышло, протестировано.
+#define AC_LOUVERH_MASK 0b11100000
+enum ac_louver_H : uint8_t {
+    AC_LOUVERH_SWING_LEFTRIGHT = 0x00,
+    AC_LOUVERH_OFF_AUX = 0x20,          // 0b00100000
+    AC_LOUVERH_OFF_ALTERNATIVE = 0xE0,  // 0b11100000 - по коду везде кроме проверок использую его, так как у него все три бита в 1
+    AC_LOUVERH_UNTOUCHED = 0xFF
+};
+
+struct ac_louver {
+    ac_louver_H louver_h;
+    ac_louver_V louver_v;
+};
+
+// скорость вентилятора
+#define AC_FANSPEED_MASK 0b11100000
+enum ac_fanspeed : uint8_t { AC_FANSPEED_HIGH = 0x20,
+                             AC_FANSPEED_MEDIUM = 0x40,
+                             AC_FANSPEED_LOW = 0x60,
+                             AC_FANSPEED_AUTO = 0xA0,
+                             AC_FANSPEED_UNTOUCHED = 0xFF };
+
+// TURBO работает только в режимах COOL и HEAT
+#define AC_FANTURBO_MASK 0b01000000
+enum ac_fanturbo : uint8_t { AC_FANTURBO_OFF = 0x00,
+                             AC_FANTURBO_ON = 0x40,
+                             AC_FANTURBO_UNTOUCHED = 0xFF };
+
+// MUTE работает только в режиме FAN. В режиме COOL кондей команду принимает, но MUTE не устанавливается
+#define AC_FANMUTE_MASK 0b10000000
+enum ac_fanmute : uint8_t { AC_FANMUTE_OFF = 0x00,
+                            AC_FANMUTE_ON = 0x80,
+                            AC_FANMUTE_UNTOUCHED = 0xFF };
+
+// реальная скорость вентилятора
+enum ac_realFan : uint8_t { AC_REAL_FAN_OFF = 0x00,
+                            AC_REAL_FAN_MUTE = 0x01,
+                            AC_REAL_FAN_LOW = 0x02,
+                            AC_REAL_FAN_MID = 0x04,
+                            AC_REAL_FAN_HIGH = 0x06,
+                            AC_REAL_FAN_TURBO = 0x07,
+                            AC_REAL_FAN_UNTOUCHED = 0xFF };
+
+// включение-выключение дисплея на корпусе внутреннего блока
+#define AC_DISPLAY_MASK 0b00010000
+enum ac_display : uint8_t { AC_DISPLAY_OFF = 0x00,
+                            AC_DISPLAY_ON = 0x10,
+                            AC_DISPLAY_UNTOUCHED = 0xFF };
+
+// включение-выключение функции "Антиплесень".
+// По факту: после выключения сплита он оставляет минут на 5 открытые жалюзи и глушит вентилятор. Уличный блок при этом гудит и тарахтит.
+// Возможно, прогревается теплообменник для высыхания. Через некоторое время внешний блок замолкает и сплит закрывает жалюзи.
+#define AC_MILDEW_MASK 0b00001000
+enum ac_mildew : uint8_t { AC_MILDEW_OFF = 0x00,
+                           AC_MILDEW_ON = 0x08,
+                           AC_MILDEW_UNTOUCHED = 0xFF };
+
+// маска счетчика минут прошедших с последней команды
+// https://github.com/GrKoR/AUX_HVAC_Protocol#packet_cmd_11_b12
+// GK: define убрал, т.к. считаю, что сбрасывать счетчик не надо.
+// #define AC_MIN_COUNTER_MASK     0b00111111
+
+// маски ограничения мощности для инверторного кондиционера
+#define AC_INVERTER_POWER_LIMITATION_ENABLE_MASK 0b10000000
+#define AC_INVERTER_POWER_LIMITATION_VALUE_MASK  0b01111111
+#define AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED  0xFF
+
+// положение вертикальных жалюзи для фронтенда
+enum ac_vlouver_frontend : uint8_t {
+    AC_VLOUVER_FRONTEND_SWING = 0x00,
+    AC_VLOUVER_FRONTEND_STOP = 0x01,
+    AC_VLOUVER_FRONTEND_TOP = 0x02,
+    AC_VLOUVER_FRONTEND_MIDDLE_ABOVE = 0x03,
+    AC_VLOUVER_FRONTEND_MIDDLE = 0x04,
+    AC_VLOUVER_FRONTEND_MIDDLE_BELOW = 0x05,
+    AC_VLOUVER_FRONTEND_BOTTOM = 0x06,
+};
+
+/** команда для кондиционера
+ *
+ * ВАЖНО! В коде используется копирование команд простым присваиванием.
+ * Если в структуру будут введены указатели, то копирование надо будет изменить!
+ */
+
+//*****************************************************************************
+// структура для сохранения настроек, специально вынесено в макрос, чтобы использовать в нескольких местах
+// сделано Brokly для того, чтобы поведение wifi-модуля походило на ИК-пульт (для каждого режима сохранялись свои настройки температуры и прочего)
+#define AC_COMMAND_BASE    \
+    float temp_target;     \
+    ac_power power;        \
+    ac_clean clean;        \
+    ac_health health;      \
+    ac_mode mode;          \
+    ac_sleep sleep;        \
+    ac_louver louver;      \
+    ac_fanspeed fanSpeed;  \
+    ac_fanturbo fanTurbo;  \
+    ac_fanmute fanMute;    \
+    ac_display display;    \
+    ac_mildew mildew;      \
+    ac_timer timer;        \
+    uint8_t timer_hours;   \
+    uint8_t timer_minutes; \
+    bool temp_target_matter
+
+// структура для сохранения настроек режима (пресета)
+struct ac_save_command_t {
+    AC_COMMAND_BASE;
+};
+
+// размер общей части ac_command_t и ac_save_command_t без хвостового выравнивания (сейчас 20 байт)
+// считает компилятор: раньше он был посчитан руками и молча ломался бы при изменении AC_COMMAND_BASE
+#define AC_COMMAND_BASE_SIZE (offsetof(ac_save_command_t, temp_target_matter) + sizeof(bool))
+
+//*****************************************************************************
+
+struct ac_command_t {
+    AC_COMMAND_BASE;
+    ac_health_status health_status;
+    float temp_ambient;       // внутренняя температура
+    int8_t temp_outdoor;      // внешняя температура
+    int8_t temp_inbound;      // температура входящая
+    int8_t temp_outbound;     // температура исходящая
+    int8_t temp_compressor;   // температура компрессора
+    ac_realFan realFanSpeed;  // текущая скорость вентилятора
+    uint8_t inverter_power;   // мощность инвертора
+    bool defrost;             // режим разморозки внешнего блока (накопление тепла + прогрев испарителя)
+    bool inverter_power_limitation_enable;      // ограничение мощности инвертора
+    uint8_t inverter_power_limitation_value;    // значение ограничения мощности инвертора
+};
+
+typedef ac_command_t ac_state_t;  // текущее состояние параметров кондея можно хранить в таком же формате, как и комманды
+
+// общая часть копируется memcpy, поэтому она должна лежать в обеих структурах одинаково
+static_assert(offsetof(ac_command_t, temp_target_matter) == offsetof(ac_save_command_t, temp_target_matter), "AC_COMMAND_BASE layout mismatch");
+static_assert(offsetof(ac_command_t, health_status) >= AC_COMMAND_BASE_SIZE, "AC_COMMAND_BASE_SIZE overlaps ac_command_t fields");
+
+// номера сохранений пресетов
+enum store_pos : uint8_t {
+    POS_MODE_AUTO = 0,
+    POS_MODE_COOL,
+    POS_MODE_DRY,
+    POS_MODE_HEAT,
+    POS_MODE_FAN,
+    POS_MODE_OFF
+};
+#define AC_PRESETS_COUNT (POS_MODE_OFF + 1)
+
+// энергонезависимая память для массива команд (пресеты, снимок состояния); в ESPHome реализуется через global_preferences
+class AirConCommandStorage {
+   public:
+    virtual ~AirConCommandStorage() {}
+    virtual bool load(ac_save_command_t *items, uint8_t count) = 0;
+    // запись вместе с синхронизацией (после нее данные уже во флеше)
+    virtual bool save(const ac_save_command_t *items, uint8_t count) = 0;
+};
+
+// результат попытки записи во флеш
+enum ac_store_result : uint8_t { AC_STORE_NOTHING = 0,    // записывать нечего или пауза еще не прошла
+                                 AC_STORE_SAVED,          // записано
+                                 AC_STORE_UNCHANGED,      // изменения откатились к тому, что уже во флеше
+                                 AC_STORE_FAILED };       // ошибка записи, повтор после следующей паузы
+
+/** массив из N команд в RAM с отложенной записью во флеш
+ *
+ * Изменения копятся в оперативной памяти, занятые ими слоты помечаются как "грязные".
+ * Во флеш массив пишется, только когда изменения затихли на время save_delay: серия команд (например,
+ * температура, которую двигают ползунком) дает одну запись вместо записи на каждую команду.
+ * Если содержимое вернулось к тому, что уже лежит во флеше, запись не делается вовсе.
+ **/
+template <uint8_t N>
+class AirConCommandStore {
+   public:
+    // подключение к памяти и чтение из нее; false - прочитать не удалось, все слоты пустые
+    bool begin(AirConCommandStorage *storage) {
+        _storage = storage;
+        memset(_items, 0, sizeof(_items));
+        bool result = (_storage != nullptr) && _storage->load(_items, N);
+        if (!result) memset(_items, 0, sizeof(_items));
+        memcpy(_persisted, _items, sizeof(_items));
+        _dirty_slots = 0;
+        return result;
+    }
+
+    void set_save_delay(uint32_t ms) { _save_delay = ms; }
+    uint32_t get_save_delay() { return _save_delay; }
+
+    const ac_save_command_t &get(uint8_t slot) { return _items[slot]; }
+
+    // запоминает общую часть команды в слоте; во флеш она попадет позже, из loop()
+    // false - содержимое слота не изменилось
+    bool put(uint8_t slot, const ac_command_t *cmd, uint32_t now) {
+        if (slot >= N) return false;
+        if (memcmp(cmd, &_items[slot], AC_COMMAND_BASE_SIZE) == 0) return false;
+        memcpy(&_items[slot], cmd, AC_COMMAND_BASE_SIZE);
+        _dirty_slots |= (1 << slot);
+        _last_change_ms = now;
+        _changes++;
+        return true;
+    }
+
+    // пишет изменения во флеш, если они затихли на время save_delay
+    ac_store_result loop(uint32_t now) {
+        if (_dirty_slots == 0) return AC_STORE_NOTHING;
+        if (now - _last_change_ms < _save_delay) return AC_STORE_NOTHING;
+        return flush(now);
+    }
+
+    // немедленная запись несохраненных изменений (например, перед перезагрузкой)
+    ac_store_result flush(uint32_t now) {
+        if (_dirty_slots == 0) return AC_STORE_NOTHING;
+        if (!_dirtyChanged()) {
+            _dirty_slots = 0;
+            return AC_STORE_UNCHANGED;
+        }
+        if (_storage == nullptr || !_storage->save(_items, N)) {
+            _last_change_ms = now;
+            return AC_STORE_FAILED;
+        }
+        memcpy(_persisted, _items, sizeof(_items));
+        _dirty_slots = 0;
+        _flash_writes++;
+        return AC_STORE_SAVED;
+    }
+
+    // маска слотов, изменения в которых еще не записаны во флеш
+    uint8_t get_dirty_slots() { return _dirty_slots; }
+    // сколько раз массив записан во флеш
+    uint32_t get_flash_writes() { return _flash_writes; }
+    // сколько записей сэкономлено по сравнению с записью после каждого изменения
+    uint32_t get_writes_avoided() {
+        uint32_t pending = (_dirty_slots != 0) ? 1 : 0;  // одна запись еще впереди
+        return (_changes > _flash_writes + pending) ? _changes - _flash_writes - pending : 0;
+    }
+
+   protected:
+    static_assert(N > 0 && N <= 8, "dirty slots mask is uint8_t");
+
+    AirConCommandStorage *_storage = nullptr;
+    ac_save_command_t _items[N];
+    uint32_t _save_delay = 10000;
+    uint32_t _last_change_ms = 0;
+    uint32_t _changes = 0;
+    uint32_t _flash_writes = 0;
+    uint8_t _dirty_slots = 0;
+    // копия того, что лежит во флеше: запись пропускается, только если изменения действительно вернулись к ней
+    // хеш тут не годится - при коллизии настоящие изменения молча не попали бы во флеш
+    ac_save_command_t _persisted[N];
+
+    // отличается ли от флеша хоть один измененный слот; остальные слоты с флешем совпадают и так
+    bool _dirtyChanged() {
+        for (uint8_t slot = 0; slot < N; slot++) {
+            if (!(_dirty_slots & (1 << slot))) continue;
+            if (memcmp(&_items[slot], &_persisted[slot], AC_COMMAND_BASE_SIZE) != 0) return true;
+        }
+        return false;
+    }
+};
+
+// пресеты режимов: для каждого режима работы свои температура, шторки, скорость вентилятора и т.п.
+class AirConPresetStore : public AirConCommandStore<AC_PRESETS_COUNT> {
+   public:
+    // номер пресета для режима работы из команды
+    static uint8_t slot_for(const ac_command_t *cmd) {
+        if (cmd->power == AC_POWER_OFF) return POS_MODE_OFF;
+        switch (cmd->mode) {
+            case AC_MODE_AUTO: return POS_MODE_AUTO;
+            case AC_MODE_COOL: return POS_MODE_COOL;
+            case AC_MODE_DRY: return POS_MODE_DRY;
+            case AC_MODE_FAN: return POS_MODE_FAN;
+            case AC_MODE_HEAT: return POS_MODE_HEAT;
+            default: return POS_MODE_OFF;
+        }
+    }
+
+    // восстановление настроек из пресета; false - пресет для этого режима еще не сохранялся
+    bool load(ac_command_t *cmd, uint8_t slot) {
+        if (slot >= AC_PRESETS_COUNT) return false;
+        if (cmd->power != _items[slot].power || cmd->mode != _items[slot].mode) return false;  // контроль инициализации
+        memcpy(cmd, &_items[slot], AC_COMMAND_BASE_SIZE);
+        return true;
+    }
+
+    // запоминает настройки текущего режима; возвращает номер пресета, если его содержимое изменилось, иначе -1
+    int put(const ac_command_t *cmd, uint32_t now) {
+        uint8_t slot = slot_for(cmd);
+        return AirConCommandStore<AC_PRESETS_COUNT>::put(slot, cmd, now) ? slot : -1;
+    }
+};
+
+// снимок последнего состояния сплита для мгновенного восстановления после перезагрузки
+typedef AirConCommandStore<1> AirConStateSnapshot;
+
+// сколько кондиционеров можно охватить одной групповой командой
+#define AC_GROUP_MAX_UNITS 8
+
+// судьба команды у отдельного кондиционера группы
+enum ac_group_unit_state : uint8_t { AC_GROUP_UNIT_IDLE = 0,     // в рассылке не участвует
+                                     AC_GROUP_UNIT_PENDING = 1,  // команда загружена, последовательность еще идет
+                                     AC_GROUP_UNIT_DONE = 2,     // сплит подтвердил команду
+                                     AC_GROUP_UNIT_FAILED = 3 }; // команда не загрузилась или не подтверждена
+
+/** учет одной команды, разосланной нескольким кондиционерам узла (действие aux_ac.group_command)
+ *
+ * у каждого кондиционера свой UART и своя последовательность, поэтому обмены идут одновременно,
+ * и вся рассылка занимает примерно один обмен, а не N. Сам класс ничего не отправляет: ему сообщают,
+ * загрузил ли кондиционер команду (loaded) и чем закончилась его последовательность (finished, из commandDone()).
+ * loaded() и finished() возвращают true, когда этим вызовом закончилась вся рассылка
+ **/
+class AirConCommandGroup {
+   public:
+    void begin(uint8_t count, uint32_t now) {
+        if (count > AC_GROUP_MAX_UNITS) count = AC_GROUP_MAX_UNITS;
+        _count = count;
+        _pending = 0;
+        _done = 0;
+        _failed = 0;
+        _start_ms = now;
+        _finish_ms = now;
+        for (uint8_t i = 0; i < AC_GROUP_MAX_UNITS; i++) {
+            _units[i] = AC_GROUP_UNIT_IDLE;
+            _unit_ms[i] = 0;
+        }
+    }
+
+    bool loaded(uint8_t unit, bool ok, uint32_t now) {
+        if (unit >= _count || _units[unit] != AC_GROUP_UNIT_IDLE) return false;
+        if (ok) {
+            _units[unit] = AC_GROUP_UNIT_PENDING;
+            _pending++;
+            return false;
+        }
+        return _finish(unit, false, now);
+    }
+
+    bool finished(uint8_t unit, bool success, uint32_t now) {
+        if (unit >= _count || _units[unit] != AC_GROUP_UNIT_PENDING) return false;  // не наша последовательность
+        _pending--;
+        return _finish(unit, success, now);
+    }
+
+    // все кондиционеры рассылки отчитались
+    bool is_complete() { return (_count > 0) && (_done + _failed == _count); }
+    bool is_running() { return (_count > 0) && !is_complete(); }
+
+    uint8_t get_count() { return _count; }
+    uint8_t get_done() { return _done; }
+    uint8_t get_failed() { return _failed; }
+    ac_group_unit_state get_unit_state(uint8_t unit) { return (unit < _count) ? _units[unit] : AC_GROUP_UNIT_IDLE; }
+    // через сколько после начала рассылки кондиционер отчитался, мс
+    uint32_t get_unit_time(uint8_t unit) { return (unit < _count) ? _unit_ms[unit] : 0; }
+    // длительность рассылки: до последнего отчета или до текущего момента, если она еще идет
+    uint32_t get_elapsed(uint32_t now) { return (is_complete() ? _finish_ms : now) - _start_ms; }
+
+   private:
+    bool _finish(uint8_t unit, bool success, uint32_t now) {
+        _units[unit] = success ? AC_GROUP_UNIT_DONE : AC_GROUP_UNIT_FAILED;
+        _unit_ms[unit] = now - _start_ms;
+        if (success) {
+            _done++;
+        } else {
+            _failed++;
+        }
+        if (!is_complete()) return false;
+        _finish_ms = now;
+        return true;
+    }
+
+    uint8_t _count = 0;
+    uint8_t _pending = 0;
+    uint8_t _done = 0;
+    uint8_t _failed = 0;
+    uint32_t _start_ms = 0;
+    uint32_t _finish_ms = 0;
+    ac_group_unit_state _units[AC_GROUP_MAX_UNITS] = {};
+    uint32_t _unit_ms[AC_GROUP_MAX_UNITS] = {};
+};
+
+/** ход действия aux_ac.group_command без привязки к ESPHome, чтобы его можно было проверить на хосте
+ *
+ * действие только собирает команды и запускает следующее действие автоматизации. Здесь решается,
+ * когда рассылка закончена: после отчета последнего кондиционера, сразу, если ни одна команда не загрузилась,
+ * или при перезапуске, когда новая рассылка пришла раньше конца прежней (прежнюю больше не ждем).
+ * Каждая рассылка заканчивается ровно один раз; отчеты остановленной рассылки не учитываются
+ **/
+class AirConGroupCommandRun {
+   public:
+    // останавливает идущую рассылку; true - она шла, и ее надо завершить (запустить следующее действие)
+    bool stop() {
+        if (!_running) return false;
+        _running = false;
+        return true;
+    }
+
+    // новая рассылка: load(unit) загружает команду кондиционеру и возвращает, получилось ли
+    // true - рассылка закончилась сразу, ждать нечего
+    template <typename Load>
+    bool start(uint8_t count, uint32_t now, Load load) {
+        _running = true;
+        _group.begin(count, now);
+        if (_group.get_count() == 0) return stop();  // пустой группе ждать некого
+        bool complete = false;
+        for (uint8_t i = 0; i < _group.get_count(); i++) {
+            complete = _group.loaded(i, load(i), now) || complete;
+        }
+        return complete && stop();
+    }
+
+    // отчет кондиционера (из on_command_done); true - этим отчетом рассылка закончилась
+    bool finished(uint8_t unit, bool success, uint32_t now) {
+        return _running && _group.finished(unit, success, now) && stop();
+    }
+
+    bool is_running() { return _running; }
+    AirConCommandGroup &get_group() { return _group; }
+
+   private:
+    AirConCommandGroup _group;
+    bool _running = false;
+};
+
+// сколько кондиционеров может быть под одним планировщиком
+#define AC_SCHEDULER_MAX_UNITS 8
+
+/** общий планировщик кондиционеров одного узла
+ *
+ * каждый кондиционер крутит свой loop(), и без координации несколько сплитов опрашиваются в одном и том же проходе
+ * главного цикла, а потом в нем же публикуют все свои сущности; остальные компоненты узла это видят как рывки.
+ * Планировщик
+ *   - разносит опросы статуса: следующий кондиционер начинает опрос не раньше, чем через get_poll_spacing()
+ *     после предыдущего (наименьший период опроса, деленный на число кондиционеров);
+ *   - ограничивает работу за проход: сколько байт входящих пакетов разобрать и сколько сущностей опубликовать.
+ * Что не влезло в проход, переносится на следующий. Первый пакет и первая публикация прохода проходят всегда,
+ * так что никто не голодает. Новый проход начинается, когда loop() какого-то кондиционера вызван повторно.
+ * Бюджет 0 - без ограничения; с выключенным разнесением опросов и без бюджетов планировщик только считает
+ **/
+class AirConScheduler {
+   public:
+    // регистрация кондиционера; AC_SCHEDULER_MAX_UNITS, если мест нет
+    uint8_t attach(uint32_t poll_period) {
+        if (_units >= AC_SCHEDULER_MAX_UNITS) return AC_SCHEDULER_MAX_UNITS;
+        if ((_units == 0) || (poll_period < _min_period)) _min_period = poll_period;
+        return _units++;
+    }
+
+    void set_stagger_polls(bool stagger) { _stagger = stagger; }
+    bool get_stagger_polls() { return _stagger; }
+    void set_tick_budget(uint16_t bytes, uint16_t entities) {
+        _budget_bytes = bytes;
+        _budget_entities = entities;
+    }
+
+    // вызывается из loopCore() каждого кондиционера
+    void unit_loop(uint8_t unit) {
+        uint8_t bit = 1 << unit;
+        if (_looped & bit) {
+            _ticks++;
+            _looped = 0;
+            _tick_bytes = 0;
+            _tick_entities = 0;
+            _tick_polls = 0;
+        }
+        _looped |= bit;
+    }
+
+    // можно ли начать опрос статуса сейчас
+    bool take_poll(uint32_t now) {
+        if (_stagger && _polled && (now - _last_poll < get_poll_spacing())) {
+            _deferred_polls++;
+            return false;
+        }
+        _polled = true;
+        _last_poll = now;
+        _tick_polls++;
+        if (_tick_polls > _max_tick_polls) _max_tick_polls = _tick_polls;
+        return true;
+    }
+
+    // можно ли в этом проходе разобрать пакет из bytes байт
+    bool take_bytes(uint16_t bytes) {
+        if (!_take(_tick_bytes, bytes, _budget_bytes, _max_tick_bytes)) {
+            _deferred_parses++;
+            return false;
+        }
+        return true;
+    }
+
+    // можно ли в этом проходе опубликовать entities сущностей
+    bool take_entities(uint16_t entities) {
+        if (!_take(_tick_entities, entities, _budget_entities, _max_tick_entities)) {
+            _deferred_publishes++;
+            return false;
+        }
+        return true;
+    }
+
+    uint8_t get_units() { return _units; }
+    uint32_t get_poll_spacing() { return (_units > 0) ? _min_period / _units : 0; }
+    uint32_t get_ticks() { return _ticks; }
+    // сколько проходов опросы ждали своей очереди и сколько раз разбор пакета и публикация переносились на следующий проход
+    uint32_t get_deferred_polls() { return _deferred_polls; }
+    uint32_t get_deferred_parses() { return _deferred_parses; }
+    uint32_t get_deferred_publishes() { return _deferred_publishes; }
+    // наибольшая работа за один проход главного цикла
+    uint16_t get_max_tick_bytes() { return _max_tick_bytes; }
+    uint16_t get_max_tick_entities() { return _max_tick_entities; }
+    uint8_t get_max_tick_polls() { return _max_tick_polls; }
+
+   private:
+    static bool _take(uint16_t &spent, uint16_t amount, uint16_t budget, uint16_t &max_spent) {
+        if ((budget > 0) && (spent > 0) && (spent + amount > budget)) return false;
+        spent += amount;
+        if (spent > max_spent) max_spent = spent;
+        return true;
+    }
+
+    uint8_t _units = 0;
+    uint32_t _min_period = 0;
+    bool _stagger = true;
+    uint16_t _budget_bytes = Constants::AC_SCHEDULER_TICK_BYTES;
+    uint16_t _budget_entities = Constants::AC_SCHEDULER_TICK_ENTITIES;
+
+    uint8_t _looped = 0;  // кондиционеры, у которых в этом проходе уже был loop()
+    uint16_t _tick_bytes = 0;
+    uint16_t _tick_entities = 0;
+    uint8_t _tick_polls = 0;
+    bool _polled = false;
+    uint32_t _last_poll = 0;
+
+    uint32_t _ticks = 0;
+    uint32_t _deferred_polls = 0;
+    uint32_t _deferred_parses = 0;
+    uint32_t _deferred_publishes = 0;
+    uint16_t _max_tick_bytes = 0;
+    uint16_t _max_tick_entities = 0;
+    uint8_t _max_tick_polls = 0;
+};
+
+// Время получения последних корректных большого и маленького информационных пакетов.
+// Раньше здесь хранились сами пакеты в сыром виде, но их никто не читал, а это почти сотня байт на каждый кондиционер.
+// Если время равно нулю, значит пакеты еще не принимались. По нему можно смотреть, как давно
+// принималась информация от кондиционера, делать вывод об отвале и рапортовать об ошибке.
+struct ac_last_raw_data {
+    uint32_t last_small_info_msec;
+    uint32_t last_big_info_msec;
+};
+
+// рассчитанное действие кондиционера (экшин), адаптер отображает его на climate::ClimateAction
+enum ac_action : uint8_t { AC_ACTION_OFF = 0x00,
+                           AC_ACTION_IDLE = 0x01,
+                           AC_ACTION_FAN = 0x02,
+                           AC_ACTION_DRYING = 0x03,
+                           AC_ACTION_COOLING = 0x04,
+                           AC_ACTION_HEATING = 0x05 };
+
+// определение экшина кондиционера (информация для пользователя, что кондиционер сейчас делает)
+// сейчас экшины рассчётные и могут не отражать реального положения дел, но других вариантов не придумалось
+// у каждого кондиционера свой экземпляр: состояние (момент выключения инвертора) у нескольких сплитов на одной ноде не пересекается
+// пересчет идет только при изменении входных параметров или пока не истекло ожидание реакции на включение инвертора
+class AirConActionEstimator {
+   public:
+    // сколько ждать реакции на включение инвертора, мс
+    static const uint32_t INVERTER_START_DELAY = 2000;
+
+    // пересчитывает экшин по состоянию сплита; now - текущее время в мс
+    // возвращает true, если экшин изменился (первый расчет тоже считается изменением)
+    bool update(const ac_state_t &state, bool is_inverter, uint32_t now) {
+        bool first = !_valid;
+        if (!first && !_waiting_inverter &&
+            state.power == _power && state.inverter_power == _inverter_power && state.realFanSpeed == _realFanSpeed &&
+            state.temp_ambient == _temp_ambient && state.temp_inbound == _temp_inbound && is_inverter == _is_inverter) {
+            return false;
+        }
+        _valid = true;
+        _power = state.power;
+        _inverter_power = state.inverter_power;
+        _realFanSpeed = state.realFanSpeed;
+        _temp_ambient = state.temp_ambient;
+        _temp_inbound = state.temp_inbound;
+        _is_inverter = is_inverter;
+        _recalculations++;
+
+        ac_action action = is_inverter ? _inverterAction(now) : _onOffAction();
+        if (action == _action && !first) return false;
+        _action = action;
+        return true;
+    }
+
+    ac_action get_action() { return _action; }
+    // сколько раз экшин действительно пересчитывался
+    uint32_t get_recalculations() { return _recalculations; }
+
+   protected:
+    ac_action _action = AC_ACTION_OFF;
+    uint32_t _recalculations = 0;
+
+    // входные параметры последнего расчета
+    bool _valid = false;
+    ac_power _power = AC_POWER_OFF;
+    uint8_t _inverter_power = 0;
+    ac_realFan _realFanSpeed = AC_REAL_FAN_OFF;
+    float _temp_ambient = 0;
+    int8_t _temp_inbound = 0;
+    bool _is_inverter = false;
+
+    // момент, когда инвертор последний раз был выключен, и флаг ожидания реакции на его включение
+    uint32_t _inverter_off_ms = 0;
+    bool _waiting_inverter = false;
+
+    bool _fanIsSlow() { return (_realFanSpeed == AC_REAL_FAN_OFF || _realFanSpeed == AC_REAL_FAN_MUTE); }
+
+    // анализ режима для инвертора точнее потому, что использует показания мощности инвертора
+    ac_action _inverterAction(uint32_t now) {
+        _waiting_inverter = false;
+        int16_t delta_temp = _temp_ambient - _temp_inbound;  // разность температуры между комнатной и входящей
+
+        if (_inverter_power == 0) {  // инвертор выключен
+            _inverter_off_ms = now;
+            // внутренний кулер остановлен, кондей выключен - значит кондей не работает
+            if (_realFanSpeed == AC_REAL_FAN_OFF && _power == AC_POWER_OFF) return AC_ACTION_OFF;
+            if (delta_temp > 0 && delta_temp < 2 && _fanIsSlow()) return AC_ACTION_DRYING;  // ОСУШЕНИЕ
+            if (_fanIsSlow()) return AC_ACTION_IDLE;                                        // кулер чуть вертится, кондей в простое
+            return AC_ACTION_FAN;                                                           // другие режимы - вентиляция
+        }
+
+        if (now - _inverter_off_ms <= INVERTER_START_DELAY) {
+            // инвертор включен, но нужно дождаться реакции на его включение
+            _waiting_inverter = true;
+            return _fanIsSlow() ? AC_ACTION_IDLE : AC_ACTION_FAN;
+        }
+
+        if (_fanIsSlow()) {                                             // медленное вращение
+            return (delta_temp > 0) ? AC_ACTION_DRYING : AC_ACTION_IDLE;  // холодный радиатор - ОСУШЕНИЕ, теплый - видимо, переходный режим
+        }
+        if (delta_temp < -2) return AC_ACTION_HEATING;  // входящая температура выше комнатной, быстрый фен - ОБОГРЕВ
+        if (delta_temp > 2) return AC_ACTION_COOLING;   // ниже, быстрый фен - ОХЛАЖДЕНИЕ
+        return AC_ACTION_IDLE;                          // просто вентиляция
+    }
+
+    // для on-off сплита рассчет экшена упрощен
+    ac_action _onOffAction() {
+        if (_realFanSpeed == AC_REAL_FAN_OFF && _power == AC_POWER_OFF) return AC_ACTION_OFF;  // значит кондей не работает
+
+        int16_t delta_temp = _temp_ambient - _temp_inbound;  // разность температуры между комнатной и входящей
+        if (delta_temp > 0 && delta_temp < 2 && _fanIsSlow()) return AC_ACTION_DRYING;  // ОСУШЕНИЕ
+        if (!_fanIsSlow()) {
+            if (delta_temp > 2) return AC_ACTION_COOLING;
+            if (delta_temp < -2) return AC_ACTION_HEATING;
+            return AC_ACTION_FAN;  // другие режимы - вентиляция
+        }
+        return AC_ACTION_IDLE;
+    }
+};
+
+// каналы температур большого пакета статуса
+enum ac_stats_channel : uint8_t { AC_STATS_AMBIENT = 0,
+                                  AC_STATS_OUTDOOR = 1,
+                                  AC_STATS_INBOUND = 2,
+                                  AC_STATS_OUTBOUND = 3,
+                                  AC_STATS_COMPRESSOR = 4,
+                                  AC_STATS_CHANNELS = 5 };
+
+// какое значение канала отдавать: сырое, экспоненциальное среднее, медиана, минимум или максимум за окно
+enum ac_stats_value : uint8_t { AC_STATS_RAW = 0,
+                                AC_STATS_EMA = 1,
+                                AC_STATS_MEDIAN = 2,
+                                AC_STATS_MIN = 3,
+                                AC_STATS_MAX = 4 };
+
+#define AC_STATS_WINDOW_MAX 15
+
+// потоковая статистика одного канала в фиксированной памяти: EMA и кольцо из последних window отсчетов
+// отсчеты хранятся в десятых долях градуса; медиана, минимум и максимум считаются по кольцу при запросе
+class AirConStatsChannel {
+   public:
+    // окно медианы и минимума/максимума, отсчетов (1..AC_STATS_WINDOW_MAX); смена окна начинает статистику заново
+    void set_window(uint8_t window) {
+        if (window < 1) window = 1;
+        if (window > AC_STATS_WINDOW_MAX) window = AC_STATS_WINDOW_MAX;
+        _window = window;
+        reset();
+    }
+    uint8_t get_window() { return _window; }
+
+    // вес нового отсчета в EMA (0..1]: 1 - без сглаживания
+    void set_ema_alpha(float alpha) {
+        if (alpha <= 0 || alpha > 1) alpha = 1;
+        _alpha = alpha;
+    }
+    float get_ema_alpha() { return _alpha; }
+
+    void reset() {
+        _count = 0;
+        _head = 0;
+        _ema = 0;
+    }
+
+    void add(float value) {
+        _ring[_head] = (int16_t)(value * 10 + ((value < 0) ? -0.5f : 0.5f));
+        _head = (_head + 1) % _window;
+        // первый отсчет задает EMA целиком, иначе она долго ползла бы от нуля
+        _ema = (_count == 0) ? value : _ema + _alpha * (value - _ema);
+        if (_count < _window) _count++;
+    }
+
+    // сколько отсчетов сейчас в окне; 0 - отсчетов еще не было, все значения равны нулю
+    uint8_t get_count() { return _count; }
+
+    float get_last() { return (_count == 0) ? 0 : _ring[(_head + _window - 1) % _window] / 10.0f; }
+    float get_ema() { return _ema; }
+
+    // при четном числе отсчетов - среднее двух средних
+    float get_median() {
+        if (_count == 0) return 0;
+        int16_t sorted[AC_STATS_WINDOW_MAX];
+        for (uint8_t i = 0; i < _count; i++) {
+            int16_t v = _ring[i];
+            uint8_t k = i;
+            while ((k > 0) && (sorted[k - 1] > v)) {
+                sorted[k] = sorted[k - 1];
+                k--;
+            }
+            sorted[k] = v;
+        }
+        if (_count & 1) return sorted[_count / 2] / 10.0f;
+        return (sorted[_count / 2 - 1] + sorted[_count / 2]) / 20.0f;
+    }
+
+    float get_min() {
+        if (_count == 0) return 0;
+        int16_t v = _ring[0];
+        for (uint8_t i = 1; i < _count; i++)
+            if (_ring[i] < v) v = _ring[i];
+        return v / 10.0f;
+    }
+
+    float get_max() {
+        if (_count == 0) return 0;
+        int16_t v = _ring[0];
+        for (uint8_t i = 1; i < _count; i++)
+            if (_ring[i] > v) v = _ring[i];
+        return v / 10.0f;
+    }
+
+    float get(ac_stats_value which) {
+        switch (which) {
+            case AC_STATS_EMA: return get_ema();
+            case AC_STATS_MEDIAN: return get_median();
+            case AC_STATS_MIN: return get_min();
+            case AC_STATS_MAX: return get_max();
+            default: return get_last();
+        }
+    }
+
+   protected:
+    int16_t _ring[AC_STATS_WINDOW_MAX] = {};
+    float _ema = 0;
+    float _alpha = 1;
+    uint8_t _window = 5;
+    uint8_t _count = 0;
+    uint8_t _head = 0;
+};
+
+// статистика всех температур большого пакета статуса; общая для опубликованных датчиков и внутренних решений
+// у каждого канала свое выбранное значение (output), у расчета экшина - свое; сырые значения в ac_state_t не трогаются
+class AirConTelemetryStats {
+   public:
+    AirConTelemetryStats() {
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++) _outputs[i] = AC_STATS_RAW;
+    }
+
+    void set_window(uint8_t window) {
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++) _channels[i].set_window(window);
+    }
+    void set_ema_alpha(float alpha) {
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++) _channels[i].set_ema_alpha(alpha);
+    }
+
+    // что отдает канал наружу (например, в датчик)
+    void set_output(ac_stats_channel channel, ac_stats_value which) {
+        if (channel < AC_STATS_CHANNELS) _outputs[channel] = which;
+    }
+    ac_stats_value get_output(ac_stats_channel channel) { return (channel < AC_STATS_CHANNELS) ? _outputs[channel] : AC_STATS_RAW; }
+
+    // какими значениями комнатной и входящей температур считать экшин
+    void set_action_value(ac_stats_value which) { _action_value = which; }
+    ac_stats_value get_action_value() { return _action_value; }
+
+    // хоть что-то, кроме сырых значений, кому-то нужно
+    bool is_used() {
+        if (_action_value != AC_STATS_RAW) return true;
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++)
+            if (_outputs[i] != AC_STATS_RAW) return true;
+        return false;
+    }
+
+    AirConStatsChannel &channel(ac_stats_channel channel) { return _channels[channel % AC_STATS_CHANNELS]; }
+
+    // выбранное значение канала; пока отсчетов не было - сырое значение raw
+    float get_output_value(ac_stats_channel channel, float raw) {
+        AirConStatsChannel &ch = this->channel(channel);
+        return (ch.get_count() == 0) ? raw : ch.get(get_output(channel));
+    }
+
+    // новый большой пакет статуса; true - изменилось какое-то из выбранных значений или входов экшина
+    bool sample(const ac_state_t &state) {
+        float before[AC_STATS_CHANNELS + 2];
+        _snapshot(before);
+        _channels[AC_STATS_AMBIENT].add(state.temp_ambient);
+        _channels[AC_STATS_OUTDOOR].add(state.temp_outdoor);
+        _channels[AC_STATS_INBOUND].add(state.temp_inbound);
+        _channels[AC_STATS_OUTBOUND].add(state.temp_outbound);
+        _channels[AC_STATS_COMPRESSOR].add(state.temp_compressor);
+        _samples++;
+        float after[AC_STATS_CHANNELS + 2];
+        _snapshot(after);
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS + 2; i++)
+            if (before[i] != after[i]) return true;
+        return false;
+    }
+
+    // подменяет в state комнатную и входящую температуры на значения для расчета экшина
+    void apply_action_inputs(ac_state_t *state) {
+        if ((_action_value == AC_STATS_RAW) || (_channels[AC_STATS_AMBIENT].get_count() == 0)) return;
+        state->temp_ambient = _channels[AC_STATS_AMBIENT].get(_action_value);
+        float inbound = _channels[AC_STATS_INBOUND].get(_action_value);
+        state->temp_inbound = (int8_t)(inbound + ((inbound < 0) ? -0.5f : 0.5f));
+    }
+
+    uint32_t get_samples() { return _samples; }
+
+    void reset() {
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++) _channels[i].reset();
+    }
+
+   protected:
+    AirConStatsChannel _channels[AC_STATS_CHANNELS];
+    ac_stats_value _outputs[AC_STATS_CHANNELS];
+    ac_stats_value _action_value = AC_STATS_RAW;
+    uint32_t _samples = 0;
+
+    // выбранные значения всех каналов и два входа экшина
+    void _snapshot(float *values) {
+        for (uint8_t i = 0; i < AC_STATS_CHANNELS; i++) values[i] = _channels[i].get(_outputs[i]);
+        values[AC_STATS_CHANNELS] = _channels[AC_STATS_AMBIENT].get(_action_value);
+        values[AC_STATS_CHANNELS + 1] = _channels[AC_STATS_INBOUND].get(_action_value);
+    }
+};
+
+// энергонезависимая память для накопленной энергии; в ESPHome реализуется через global_preferences
+class AirConEnergyStorage {
+   public:
+    virtual ~AirConEnergyStorage() {}
+    virtual bool load(double *energy_wh) = 0;
+    // запись вместе с синхронизацией (после нее данные уже во флеше)
+    virtual bool save(double energy_wh) = 0;
+};
+
+// оценка потребления кондиционера без внешнего счетчика
+// мощность, Вт: калибровочная кривая модели (мощность инвертора в % -> Вт) плюс вентилятор внутреннего блока на его реальной скорости;
+// энергия интегрируется методом трапеций между соседними большими пакетами статуса
+// у каждого кондиционера свой экземпляр, накопленная энергия пишется во флеш раз в save_interval и перед перезагрузкой
+#define AC_ENERGY_CURVE_POINTS 8
+#define AC_ENERGY_FAN_SPEEDS 6
+
+class AirConEnergyMeter {
+   public:
+    // точка калибровочной кривой: на мощности инвертора percent блок потребляет watts; точки хранятся по возрастанию
+    // между точками мощность интерполируется линейно, за крайними точками - как в крайней точке
+    bool add_curve_point(uint8_t percent, uint16_t watts) {
+        if ((_points >= AC_ENERGY_CURVE_POINTS) || (percent > 100)) return false;
+        uint8_t k = _points++;
+        while ((k > 0) && (_curve[k - 1].percent > percent)) {
+            _curve[k] = _curve[k - 1];
+            k--;
+        }
+        _curve[k] = {percent, watts};
+        return true;
+    }
+    uint8_t get_curve_points() { return _points; }
+
+    // вентилятор внутреннего блока на реальной скорости speed, Вт; крутится и тогда, когда компрессор стоит
+    bool set_fan_power(ac_realFan speed, uint16_t watts) {
+        uint8_t i = _fanIndex(speed);
+        if (i == 0) return false;  // выключенный вентилятор ничего не потребляет
+        _fan[i] = watts;
+        return true;
+    }
+    // выключенный кондиционер (плата, дисплей, подогрев картера), Вт
+    void set_standby_power(uint16_t watts) { _standby = watts; }
+    // перерыв между пакетами дольше max_gap не интегрируется: связи не было, и что потреблялось - неизвестно
+    void set_max_gap(uint32_t ms) { _max_gap = ms; }
+    uint32_t get_max_gap() { return _max_gap; }
+    void set_save_interval(uint32_t ms) { _save_interval = ms; }
+    uint32_t get_save_interval() { return _save_interval; }
+
+    // мощность по состоянию сплита, Вт
+    float estimate(const ac_state_t &state) {
+        if (state.power != AC_POWER_ON) return _standby;
+        return _curvePower(state.inverter_power) + _fan[_fanIndex(state.realFanSpeed)];
+    }
+
+    // подключение к памяти и чтение накопленной энергии; false - прочитать не удалось, счет начинается с нуля
+    bool begin(AirConEnergyStorage *storage) {
+        _storage = storage;
+        double energy = 0;
+        bool result = (_storage != nullptr) && _storage->load(&energy) && (energy >= 0) && (energy < 1e12);  // NaN тоже отсеивается
+        _energy_wh = result ? energy : 0;
+        _persisted_wh = _energy_wh;
+        return result;
+    }
+
+    // новый большой пакет статуса; now - время его приема, мс
+    void sample(const ac_state_t &state, uint32_t now) {
+        float power = estimate(state);
+        if (_has_sample) {
+            uint32_t dt = now - _last_ms;
+            if (dt <= _max_gap) {
+                _energy_wh += (double)(_power + power) / 2 * dt / 3600000.0;
+            } else {
+                _gaps++;
+            }
+        }
+        _has_sample = true;
+        _last_ms = now;
+        _power = power;
+        _samples++;
+    }
+
+    // пишет накопленное во флеш раз в save_interval
+    ac_store_result loop(uint32_t now) {
+        if (now - _last_save_ms < _save_interval) return AC_STORE_NOTHING;
+        return flush(now);
+    }
+
+    // немедленная запись (например, перед перезагрузкой)
+    ac_store_result flush(uint32_t now) {
+        _last_save_ms = now;
+        if (_energy_wh == _persisted_wh) return AC_STORE_NOTHING;
+        if ((_storage == nullptr) || !_storage->save(_energy_wh)) return AC_STORE_FAILED;
+        _persisted_wh = _energy_wh;
+        _flash_writes++;
+        return AC_STORE_SAVED;
+    }
+
+    // мощность по последнему пакету, Вт, и накопленная энергия, кВт*ч
+    float get_power() { return _power; }
+    double get_energy_kwh() { return _energy_wh / 1000.0; }
+    bool has_sample() { return _has_sample; }
+    uint32_t get_samples() { return _samples; }
+    // сколько перерывов между пакетами не вошло в интеграл
+    uint32_t get_gaps() { return _gaps; }
+    uint32_t get_flash_writes() { return _flash_writes; }
+
+   private:
+    struct curve_point_t {
+        uint8_t percent;
+        uint16_t watts;
+    };
+
+    static uint8_t _fanIndex(ac_realFan speed) {
+        switch (speed) {
+            case AC_REAL_FAN_MUTE: return 1;
+            case AC_REAL_FAN_LOW: return 2;
+            case AC_REAL_FAN_MID: return 3;
+            case AC_REAL_FAN_HIGH: return 4;
+            case AC_REAL_FAN_TURBO: return 5;
+            default: return 0;
+        }
+    }
+
+    float _curvePower(uint8_t percent) {
+        if (_points == 0) return 0;
+        if (percent <= _curve[0].percent) return _curve[0].watts;
+        for (uint8_t i = 1; i < _points; i++) {
+            if (percent <= _curve[i].percent) {
+                const curve_point_t &a = _curve[i - 1];
+                const curve_point_t &b = _curve[i];
+                return a.watts + (float)(b.watts - a.watts) * (percent - a.percent) / (b.percent - a.percent);
+            }
+        }
+        return _curve[_points - 1].watts;
+    }
+
+    curve_point_t _curve[AC_ENERGY_CURVE_POINTS] = {};
+    uint8_t _points = 0;
+    uint16_t _fan[AC_ENERGY_FAN_SPEEDS] = {};
+    uint16_t _standby = 0;
+    uint32_t _max_gap = 3 * Constants::AC_STATES_REQUEST_INTERVAL;
+    uint32_t _save_interval = Constants::AC_ENERGY_SAVE_INTERVAL;
+
+    AirConEnergyStorage *_storage = nullptr;
+    double _energy_wh = 0;
+    double _persisted_wh = 0;
+    float _power = 0;
+    bool _has_sample = false;
+    uint32_t _last_ms = 0;
+    uint32_t _last_save_ms = 0;
+    uint32_t _samples = 0;
+    uint32_t _gaps = 0;
+    uint32_t _flash_writes = 0;
+};
+
+// отсчет истории телеметрии: то, что приходит в большом пакете статуса
+struct ac_history_sample_t {
+    uint32_t time_s;         // секунды от старта (AirConSeconds), переполнение millis() на них не сказывается
+    int16_t ambient_x10;     // комнатная температура, десятые доли градуса
+    int8_t outdoor;          // температуры, градусы Цельсия
+    int8_t inbound;
+    int8_t outbound;
+    int8_t compressor;
+    uint8_t inverter_power;  // %
+    bool defrost;
+};
+
+// монотонные секунды от старта: millis() переполняется через 49.7 суток, а этот счетчик идет дальше
+// (uint32_t секунд хватит на 136 лет); вызывать нужно чаще, чем раз в 49.7 суток, например, из loop()
+class AirConSeconds {
+   public:
+    uint32_t get(uint32_t now_ms) {
+        _ms += now_ms - _last_ms;  // беззнаковая разность: переход millis() через 0 ей не мешает
+        _last_ms = now_ms;
+        _seconds += _ms / 1000;
+        _ms %= 1000;
+        return _seconds;
+    }
+
+   private:
+    uint32_t _last_ms = 0;
+    uint32_t _ms = 0;
+    uint32_t _seconds = 0;
+};
+
+/** история телеметрии в RAM: кольцо из блоков фиксированного размера
+ *
+ * Каждый блок начинается с опорного отсчета целиком, дальше идут только разности с предыдущим отсчетом:
+ * байт-заголовок (бит 7 - интервал изменился и следует за заголовком, биты 0-6 - какие поля изменились)
+ * и varint (zigzag) изменившихся полей. Отсчет, в котором ничего не поменялось, занимает один байт.
+ * Когда кольцо заполнено, выбрасывается самый старый блок целиком, поэтому оставшиеся блоки всегда декодируются.
+ **/
+#define AC_HISTORY_BLOCK_SIZE 256
+#define AC_HISTORY_FIELDS 7
+
+class AirConHistory {
+   public:
+    // позиция чтения; переживает запись новых отсчетов, а если ее блок выброшен - чтение продолжается с самого старого
+    struct cursor_t {
+        uint32_t block;
+        uint16_t offset;
+        uint32_t dt;
+        ac_history_sample_t sample;
+    };
+
+    AirConHistory() {}
+    AirConHistory(const AirConHistory &) = delete;
+    AirConHistory &operator=(const AirConHistory &) = delete;
+    ~AirConHistory() { delete[] _buf; }
+
+    // выделение памяти: bytes округляется вниз до целых блоков, нужно хотя бы два блока; false - памяти нет
+    bool begin(uint16_t bytes) {
+        delete[] _buf;
+        _buf = nullptr;
+        _blocks = bytes / AC_HISTORY_BLOCK_SIZE;
+        if (_blocks < 2) _blocks = 0;
+        if (_blocks > 0) _buf = new (std::nothrow) uint8_t[_blocks * AC_HISTORY_BLOCK_SIZE];
+        if (_buf == nullptr) _blocks = 0;
+        clear();
+        return _blocks > 0;
+    }
+
+    void clear() {
+        _empty = true;
+        _first = 0;
+        _tail = 0;
+        _count = 0;
+    }
+
+    // отсчеты чаще interval не пишутся; 0 - каждый большой пакет статуса
+    void set_interval(uint32_t seconds) { _interval = seconds; }
+    uint32_t get_interval() { return _interval; }
+
+    static ac_history_sample_t from_state(const ac_state_t &state, uint32_t time_s) {
+        ac_history_sample_t sample;
+        sample.time_s = time_s;
+        sample.ambient_x10 = (int16_t)(state.temp_ambient * 10 + ((state.temp_ambient < 0) ? -0.5f : 0.5f));
+        sample.outdoor = state.temp_outdoor;
+        sample.inbound = state.temp_inbound;
+        sample.outbound = state.temp_outbound;
+        sample.compressor = state.temp_compressor;
+        sample.inverter_power = state.inverter_power;
+        sample.defrost = state.defrost;
+        return sample;
+    }
+
+    // false - отсчет не записан: памяти нет или interval еще не прошел
+    bool record(const ac_history_sample_t &sample) {
+        if (_blocks == 0) return false;
+        if (!_empty && (_interval > 0) && (sample.time_s - _last.time_s < _interval)) return false;
+
+        uint8_t rec[1 + 5 + AC_HISTORY_FIELDS * 5];
+        uint8_t len = 1;
+        uint8_t head = 0;
+        uint32_t dt = sample.time_s - _last.time_s;
+        if (!_empty && (dt != _last_dt)) {
+            head |= 0x80;
+            len += _putVarint(rec + len, dt);
+        }
+        for (uint8_t i = 0; i < AC_HISTORY_FIELDS; i++) {
+            int32_t delta = _field(sample, i) - _field(_last, i);
+            if (delta == 0) continue;
+            head |= (1 << i);
+            len += _putVarint(rec + len, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        }
+        rec[0] = head;
+
+        if (_empty || (_used(_tail) + len > AC_HISTORY_BLOCK_SIZE)) {
+            _startBlock(sample);
+        } else {
+            memcpy(_block(_tail) + _used(_tail), rec, len);
+            _setHeader(_tail, _used(_tail) + len, _samples(_tail) + 1);
+            _last_dt = dt;
+        }
+        _last = sample;
+        _count++;
+        _recorded++;
+        return true;
+    }
+
+    // чтение с самого старого отсчета
+    void rewind(cursor_t &cursor) {
+        cursor.block = _first;
+        cursor.offset = 0;
+    }
+
+    // следующий отсчет; false - новых отсчетов нет
+    bool next(cursor_t &cursor, ac_history_sample_t *sample) {
+        if (_empty) return false;
+        if ((int32_t)(cursor.block - _first) < 0) rewind(cursor);  // блок курсора уже выброшен
+        while ((int32_t)(_tail - cursor.block) >= 0) {
+            const uint8_t *b = _block(cursor.block);
+            if (cursor.offset == 0) {
+                _readKey(b + HEADER_SIZE, &cursor.sample);
+                cursor.dt = 0;
+                cursor.offset = HEADER_SIZE + KEY_SIZE;
+                *sample = cursor.sample;
+                return true;
+            }
+            if (cursor.offset < _used(cursor.block)) {
+                uint8_t head = b[cursor.offset++];
+                if (head & 0x80) cursor.dt = _getVarint(b, cursor.offset);
+                cursor.sample.time_s += cursor.dt;
+                for (uint8_t i = 0; i < AC_HISTORY_FIELDS; i++) {
+                    if (!(head & (1 << i))) continue;
+                    uint32_t zz = _getVarint(b, cursor.offset);
+                    int32_t delta = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+                    _setField(cursor.sample, i, _field(cursor.sample, i) + delta);
+                }
+                *sample = cursor.sample;
+                return true;
+            }
+            cursor.block++;
+            cursor.offset = 0;
+        }
+        return false;
+    }
+
+    // сколько отсчетов сейчас в кольце и сколько записано всего
+    uint32_t get_count() { return _count; }
+    uint32_t get_recorded() { return _recorded; }
+    uint16_t get_capacity() { return _blocks * AC_HISTORY_BLOCK_SIZE; }
+    uint32_t get_bytes_used() {
+        if (_empty) return 0;
+        uint32_t bytes = 0;
+        for (uint32_t b = _first; (int32_t)(_tail - b) >= 0; b++) bytes += _used(b);
+        return bytes;
+    }
+    // время самого старого отсчета, с от старта
+    uint32_t get_oldest_time() {
+        if (_empty) return 0;
+        ac_history_sample_t sample;
+        _readKey(_block(_first) + HEADER_SIZE, &sample);
+        return sample.time_s;
+    }
+
+   private:
+    // заголовок блока: занято байт (uint16) и отсчетов в блоке (uint16); опорный отсчет - 12 байт
+    static const uint16_t HEADER_SIZE = 4;
+    static const uint16_t KEY_SIZE = 12;
+
+    uint8_t *_block(uint32_t seq) { return _buf + (seq % _blocks) * AC_HISTORY_BLOCK_SIZE; }
+    uint16_t _used(uint32_t seq) { return _block(seq)[0] | (_block(seq)[1] << 8); }
+    uint16_t _samples(uint32_t seq) { return _block(seq)[2] | (_block(seq)[3] << 8); }
+    void _setHeader(uint32_t seq, uint16_t used, uint16_t samples) {
+        uint8_t *b = _block(seq);
+        b[0] = used & 0xFF;
+        b[1] = used >> 8;
+        b[2] = samples & 0xFF;
+        b[3] = samples >> 8;
+    }
+
+    // новый блок с опорным отсчетом; если кольцо заполнено, выбрасывается самый старый блок
+    void _startBlock(const ac_history_sample_t &sample) {
+        if (_empty) {
+            _empty = false;
+        } else {
+            if (_tail - _first + 1 >= _blocks) {
+                _count -= _samples(_first);
+                _first++;
+            }
+            _tail++;
+        }
+        uint8_t *b = _block(_tail);
+        b[HEADER_SIZE + 0] = sample.time_s & 0xFF;
+        b[HEADER_SIZE + 1] = (sample.time_s >> 8) & 0xFF;
+        b[HEADER_SIZE + 2] = (sample.time_s >> 16) & 0xFF;
+        b[HEADER_SIZE + 3] = (sample.time_s >> 24) & 0xFF;
+        b[HEADER_SIZE + 4] = (uint16_t)sample.ambient_x10 & 0xFF;
+        b[HEADER_SIZE + 5] = (uint16_t)sample.ambient_x10 >> 8;
+        b[HEADER_SIZE + 6] = sample.outdoor;
+        b[HEADER_SIZE + 7] = sample.inbound;
+        b[HEADER_SIZE + 8] = sample.outbound;
+        b[HEADER_SIZE + 9] = sample.compressor;
+        b[HEADER_SIZE + 10] = sample.inverter_power;
+        b[HEADER_SIZE + 11] = sample.defrost;
+        _setHeader(_tail, HEADER_SIZE + KEY_SIZE, 1);
+        _last_dt = 0;
+    }
+
+    static void _readKey(const uint8_t *k, ac_history_sample_t *sample) {
+        sample->time_s = k[0] | (k[1] << 8) | ((uint32_t)k[2] << 16) | ((uint32_t)k[3] << 24);
+        sample->ambient_x10 = (int16_t)(k[4] | (k[5] << 8));
+        sample->outdoor = k[6];
+        sample->inbound = k[7];
+        sample->outbound = k[8];
+        sample->compressor = k[9];
+        sample->inverter_power = k[10];
+        sample->defrost = k[11];
+    }
+
+    static int32_t _field(const ac_history_sample_t &sample, uint8_t i) {
+        switch (i) {
+            case 0: return sample.ambient_x10;
+            case 1: return sample.outdoor;
+            case 2: return sample.inbound;
+            case 3: return sample.outbound;
+            case 4: return sample.compressor;
+            case 5: return sample.inverter_power;
+            default: return sample.defrost;
+        }
+    }
+
+    static void _setField(ac_history_sample_t &sample, uint8_t i, int32_t value) {
+        switch (i) {
+            case 0: sample.ambient_x10 = value; break;
+            case 1: sample.outdoor = value; break;
+            case 2: sample.inbound = value; break;
+            case 3: sample.outbound = value; break;
+            case 4: sample.compressor = value; break;
+            case 5: sample.inverter_power = value; break;
+            default: sample.defrost = value; break;
+        }
+    }
+
+    static uint8_t _putVarint(uint8_t *out, uint32_t value) {
+        uint8_t n = 0;
+        while (value >= 0x80) {
+            out[n++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        out[n++] = value;
+        return n;
+    }
+
+    static uint32_t _getVarint(const uint8_t *b, uint16_t &offset) {
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t byte = b[offset++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        return value;
+    }
+
+    uint8_t *_buf = nullptr;
+    uint16_t _blocks = 0;
+    uint32_t _interval = 0;
+    bool _empty = true;
+    uint32_t _first = 0;  // номер самого старого блока; номера растут, место в буфере - номер по модулю _blocks
+    uint32_t _tail = 0;   // номер блока, в который идет запись
+    uint32_t _count = 0;
+    uint32_t _recorded = 0;
+    ac_history_sample_t _last = {};
+    uint32_t _last_dt = 0;
+};
+
+//****************************************************************************************************************************************************
+//************************************************ КОНЕЦ ПАРАМЕТРОВ РАБОТЫ КОНДИЦИОНЕРА **************************************************************
+//****************************************************************************************************************************************************
+
+/*****************************************************************************************************************************************************
+ *                                      структуры и типы для последовательности команд
+ *****************************************************************************************************************************************************
+ *
+ * Последовательность команд позволяет выполнить несколько последовательных команд с контролем получаемых в ответ пакетов.
+ * Если требуется, в получаемых в ответ пакетах можно контролировать значение любых байт.
+ * Для входящего пакета байт, значение которого не проверяется, должен быть установлен в AC_SEQUENCE_ANY_BYTE.
+ * Контроль возможен только для входящих пакетов, исходящие отправляются "как есть".
+ *
+ * Для исходящих пакетов значения CRC могут не рассчитываться, контрольная сумма будет рассчитана автоматически.
+ * Для входящих пакетов значение CRC также можно не рассчитывать, установив байты CRC в AC_SEQUENCE_ANY_BYTE,
+ * так как контроль CRC для получаемых пакетов выполняется автоматически при получении.
+ *
+ * Для входящих пакетов в последовательности можно указать таймаут. Если таймаут равен 0, то используется значение AC_SEQUENCE_DEFAULT_TIMEOUT.
+ * Если в течение указанного времени подходящий пакет не будет получен, то последовательность прерывается с ошибкой.
+ * Пинг-пакеты в последовательности игнорируются.
+ *
+ * Пауза в последовательности задается значением timeout элемента AC_DELAY. Никакие другие параметры такого элемента можно не заполнять.
+ *
+ **/
+// максимальная длина последовательности; больше вроде бы не требовалось
+#define AC_SEQUENCE_MAX_LEN 0x0F
+
+// дефолтный таймаут входящего пакета в миллисекундах
+// если для входящего пакета в последовательности указан таймаут 0, то используется значение по-умолчанию
+// если нужный пакет не поступил в течение указанного времени, то последовательность прерывается с ошибкой
+#define AC_SEQUENCE_DEFAULT_TIMEOUT 580  // Brokly: пришлось увеличить с 500 до 580
+
+enum sequence_item_type_t : uint8_t {
+    AC_SIT_NONE = 0x00,   // пустой элемент последовательности
+    AC_SIT_DELAY = 0x01,  // пауза в последовательности на нужное количество миллисекунд
+    AC_SIT_FUNC = 0x02    // рабочий элемент последовательности
+};
+
+// тип пакета в массиве последовательности
+// информирует о том, что за пакет лежит в поле packet элемента последовательности
+enum sequence_packet_type_t : uint8_t {
+    AC_SPT_CLEAR = 0x00,            // пустой пакет
+    AC_SPT_RECEIVED_PACKET = 0x01,  // полученный пакет
+    AC_SPT_SENT_PACKET = 0x02       // отправленный пакет
+};
+
+/** элемент последовательности
+ *  Поля item_type, func, timeout и cmd устанавливаются ручками и задают параметры выполнения шага последовательности.
+ *  Поля msec, packet_type и crc заполняются движком при обработке последовательности.
+ *  Пакет целиком в шаге не хранится: из отправленного пакета следующим шагам нужна только его CRC
+ *  (ответ на команду содержит CRC команды), а полученный пакет и так лежит в _inPacket.
+ **/
+// поля упорядочены от больших к меньшим, чтобы на выравнивание не тратилось лишнего: шагов в последовательности много
+struct sequence_item_t {
+    bool (AirConCore::*func)();      // указатель на функцию, отрабатывающую шаг последовательности
+    ac_command_t cmd;                // новое состояние сплита, нужно для передачи кондиционеру команд
+    uint16_t timeout;                // допустимый таймаут в ожидании пакета (применим только для входящих пакетов)
+    sequence_item_type_t item_type;  // тип элемента последовательности
+    //******* поля ниже заполняются функциями обработки последовательности ***********
+    sequence_packet_type_t packet_type;  // тип пакета (входящий, исходящий или вовсе не пакет)
+    uint32_t msec;                       // время старта текущего шага последовательности (для входящего пакета и паузы)
+    packet_crc_t crc;                    // CRC пакета
+};
+/*****************************************************************************************************************************************************/
+
+//****************************************************************************************************************************************************
+//**************************************************** ИНТЕРФЕЙСЫ ДОСТУПА К ЖЕЛЕЗУ ******************************************************************
+//****************************************************************************************************************************************************
+// Ядро ничего не знает об окружении, в котором работает. Всё, что ему нужно снаружи, описано тремя интерфейсами ниже.
+// В ESPHome их реализует aux_ac.h, в тестах на компьютере - заглушки из tests/host.
+
+// UART, по которому идет обмен с кондиционером
+class AirConUart {
+   public:
+    virtual ~AirConUart() {}
+    // количество байт, доступных для чтения
+    virtual int available() = 0;
+    // очередной байт без извлечения из буфера; -1, если данных нет
+    virtual int peek() = 0;
+    // очередной байт с извлечением из буфера; -1, если данных нет
+    virtual int read() = 0;
+    // неблокирующая запись: байты кладутся в буфер передачи
+    virtual void write_array(const uint8_t *data, size_t len) = 0;
+};
+
+// часы
+class AirConClock {
+   public:
+    virtual ~AirConClock() {}
+    virtual uint32_t millis() = 0;
+    virtual uint32_t micros() = 0;
+};
+
+// виртуальные часы: время идет только тогда, когда его двигают вызовом advance_ms() / advance_us()
+// нужны для тестов и воспроизведения логов: часы работы кондиционера проходят за миллисекунды
+class AirConVirtualClock : public AirConClock {
+   public:
+    // текущее время, микросекунды; millis() и micros() переполняются так же, как в Arduino
+    uint64_t us = 0;
+
+    uint32_t millis() override { return (uint32_t)(us / 1000); }
+    uint32_t micros() override { return (uint32_t)us; }
+
+    void advance_us(uint64_t delta) { us += delta; }
+    void advance_ms(uint32_t delta) { us += (uint64_t)delta * 1000; }
+};
+
+// лог
+class AirConLogger {
+   public:
+    virtual ~AirConLogger() {}
+    // level - уровень ESPHOME_LOG_LEVEL_x, line - строка исходника, откуда пришло сообщение
+    virtual void logv(uint8_t level, unsigned int line, const char *format, va_list args) = 0;
+};
+
+class AirConCore {
+   protected:
+    // флаг типа кондиционера. инвертор - true,  ON/OFF - false, начальная установка false
+    // в таком режиме точность и скорость определения реального состояния системы для инвертора,
+    // будет работать, но будет ниже, переменная устанавливается при первом получении большого пакета;
+    // если эта переменная установлена, то режим работы не инверторного кондиционера будет распознаваться
+    // как "в простое" (IDLE)
+    bool _is_inverter = false;
+
+    // состояние конечного автомата
+    acsm_state _ac_state = ACSM_IDLE;
+
+    // текущее состояние задаваемых пользователем параметров системы
+    ac_state_t _current_ac_state;
+
+    // флаг подключения к UART
+    bool _hw_initialized = false;
+    // общий планировщик узла (nullptr - кондиционер работает сам по себе) и номер кондиционера в нем
+    uint8_t _scheduler_unit = 0;
+    bool _publish_deferred = false;  // публикация не влезла в бюджет прохода и ждет следующего
+    // интерфейсы доступа к UART, часам и логу
+    AirConUart *_uart = nullptr;
+    AirConClock *_clock = nullptr;
+    AirConLogger *_logger = nullptr;
+    AirConScheduler *_scheduler = nullptr;
+
+    // clock wrappers
+    uint32_t _millis() { return _clock->millis(); }
+    uint32_t _micros() { return _clock->micros(); }
+
+    // UART wrappers: peek
+    int peek() {
+        return _uart->peek();
+    }
+
+    // UART wrappers: read
+    int read() {
+        int data = _uart->read();
+        if (data < 0) return -1;
+
+        // запоминаем время последней активности на линии, по нему определяется тишина перед передачей
+        _rx_last_byte_ms = _millis();
+        // если байт пришел, пока мы еще передаем свой пакет, значит на линии коллизия
+        if (_isTransmitting() && !_tx_collision) {
+            _tx_collision = true;
+            _tx_collisions++;
+            _debugMsg(F("Receiver: byte received during transmission, collision detected."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+        }
+        return data;
+    }
+
+    // контроль занятости линии
+    // время получения последнего байта от кондиционера
+    uint32_t _rx_last_byte_ms = 0;
+    // защитный интервал тишины перед передачей
+    uint32_t _tx_guard_time = Constants::AC_TX_GUARD_TIME_DEFAULT;
+    // флаг: текущий исходящий пакет уже откладывался из-за занятой линии (чтобы считать отложенные пакеты, а не циклы loop)
+    bool _tx_deferred = false;
+    // флаг: во время текущей передачи уже была коллизия
+    bool _tx_collision = false;
+    // счетчики для оценки эффективности защиты от коллизий
+    uint32_t _tx_deferrals = 0;     // сколько пакетов было отложено из-за активности кондиционера на линии
+    uint32_t _tx_collisions = 0;    // сколько раз кондиционер начинал передачу, пока мы передавали свой пакет
+    uint32_t _sequences_done = 0;   // сколько последовательностей команд выполнено успешно
+    uint32_t _sequences_failed = 0; // сколько последовательностей команд прервано с ошибкой
+    uint32_t _commands_suppressed = 0; // сколько команд не отправлено, потому что они ничего не меняли
+
+    // оптимистичная публикация: запрошенное состояние публикуется сразу, не дожидаясь подтверждения сплита
+    bool _optimistic = false;
+    bool _pending = false;          // есть команда, которую сплит еще не подтвердил
+    ac_command_t _pending_cmd;      // все неподтвержденные изменения, наложенные одно на другое
+    uint32_t _rollbacks = 0;        // сколько раз оптимистичное состояние пришлось откатить
+
+    // доверять эху команды установки параметров: состояние обновляется по отправленной команде без финального запроса статуса
+    bool _trust_echo = false;
+
+    // очередь на публикацию entities сущностей: false - публикация отложена до следующего прохода loopCore()
+    // вызывается в начале stateChanged() адаптера
+    bool _takePublishTurn(uint16_t entities = 1) {
+        if ((_scheduler == nullptr) || _scheduler->take_entities(entities)) return true;
+        _publish_deferred = true;
+        return false;
+    }
+
+    // проверяет, можно ли начинать передачу: свой предыдущий пакет ушел в линию, входящих данных нет
+    // и с момента получения последнего байта прошел защитный интервал
+    bool _isBusFree() {
+        if (_isTransmitting()) return false;
+
+        bool rx_pending = (_uart->available() > 0);
+        if (!rx_pending && (_millis() - _rx_last_byte_ms >= _tx_guard_time)) return true;
+
+        // ожидание тишины после пакета, на который мы сами отвечаем (например, после пинга), - это норма;
+        // отложенным считаем пакет, если линию заняли уже после того, как он был поставлен в очередь
+        if (!_tx_deferred && (rx_pending || (int32_t)(_rx_last_byte_ms - _outPacket.msec) > 0)) {
+            _tx_deferred = true;
+            _tx_deferrals++;
+            _debugMsg(F("Sender: bus is busy, transmission deferred."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+        }
+        return false;
+    }
+
+    // неблокирующая передача: write_array() только кладет байты в буфер UART, а сам UART выдает их в линию
+    // еще долго (23-байтная команда на 4800 8E1 уходит около 50 мс). Раньше после записи вызывался flush(),
+    // который блокировал loop() на всё это время. Теперь окончание передачи считаем по времени передачи байт.
+    // время передачи одного байта в микросекундах, рассчитывается в setup() по настройкам UART
+    uint32_t _tx_byte_time_us = Constants::AC_UART_BYTE_TIME_US;
+    // момент начала и расчетная длительность текущей передачи, микросекунды
+    uint32_t _tx_start_us = 0;
+    uint32_t _tx_duration_us = 0;
+
+    // возвращает true, пока UART еще выдает в линию последний отправленный пакет
+    bool _isTransmitting() {
+        return (_micros() - _tx_start_us) < _tx_duration_us;
+    }
+
+    // флаг обмена пакетами с кондиционером (если проходят пинги, значит есть коннект)
+    bool _has_connection = false;
+
+    // состояние восстановлено из снимка и еще не подтверждено сплитом
+    bool _state_stale = false;
+    // от сплита пришел хотя бы один малый пакет статуса
+    bool _state_live = false;
+    // момент initCore() и задержка до первого живого состояния, мс
+    uint32_t _core_start_ms = 0;
+    uint32_t _state_live_ms = 0;
+
+    // расчет экшина кондиционера
+    AirConActionEstimator _action_estimator;
+
+    // время последнего запроса статуса у кондея
+    uint32_t _dataMillis = 0;
+    // периодичность обновления статуса кондея, по дефолту AC_STATES_REQUEST_INTERVAL
+    uint32_t _update_period = Constants::AC_STATES_REQUEST_INTERVAL;
+
+    // входящий и исходящий пакеты
+    packet_t _inPacket;
+    packet_t _outPacket;
+
+    // пакет для тестирования всякой фигни; нужен редко, поэтому память под него выделяется при первой отправке
+    std::unique_ptr<packet_t> _outTestPacket;
+
+    // таймаут загрузки пакета, по дефолту минимальный
+    uint32_t _packet_timeout = Constants::AC_PACKET_TIMEOUT_MIN;
+
+    // время получения последних большого и маленького информационных пакетов
+    ac_last_raw_data _last_raw_data;
+
+#if defined(AC_LOOP_PROFILER)
+    // статистика профайлера по точкам замера
+    ac_profiler_stat_t _profiler[AC_PROF_COUNT];
+
+    // сброс статистики профайлера
+    void _profilerReset() {
+        for (uint8_t i = 0; i < AC_PROF_COUNT; i++) {
+            _profiler[i].min_us = UINT32_MAX;
+            _profiler[i].max_us = 0;
+            _profiler[i].total_us = 0;
+            _profiler[i].calls = 0;
+        }
+    }
+
+    // учет очередного замера в статистике
+    void _profilerAdd(ac_profiler_point point, uint32_t us) {
+        if (point >= AC_PROF_COUNT) return;
+        ac_profiler_stat_t *stat = &_profiler[point];
+        if (us < stat->min_us) stat->min_us = us;
+        if (us > stat->max_us) stat->max_us = us;
+        stat->total_us += us;
+        stat->calls++;
+    }
+#endif
+
+    // нормализация показаний температуры, приведение в диапазон
+    // ядро знает только ограничения самого кондиционера; адаптер может дополнительно ограничить диапазон настройками интерфейса
+    virtual float _temp_target_normalise(float temp) {
+        if (temp < Constants::AC_MIN_TEMPERATURE) temp = Constants::AC_MIN_TEMPERATURE;
+        if (temp > Constants::AC_MAX_TEMPERATURE) temp = Constants::AC_MAX_TEMPERATURE;
+        return temp;
+    }
+
+    // нормализация лимита ограничения мощности инвертора, приведение в диапазон
+    uint8_t _power_limitation_value_normalise(uint8_t power_limitation_value) {
+        if (power_limitation_value < Constants::AC_MIN_INVERTER_POWER_LIMIT) power_limitation_value = Constants::AC_MIN_INVERTER_POWER_LIMIT;
+        if (power_limitation_value > Constants::AC_MAX_INVERTER_POWER_LIMIT) power_limitation_value = Constants::AC_MAX_INVERTER_POWER_LIMIT;
+        return power_limitation_value;
+    }
+
+    // последовательность пакетов текущий шаг в последовательности
+    sequence_item_t _sequence[AC_SEQUENCE_MAX_LEN];
+    uint8_t _sequence_current_step;
+
+    // флаг успешного выполнения стартовой последовательности команд
+    bool _startupSequenceComlete = false;
+
+    // пробный запрос статуса на старте, не дожидаясь первого пинга
+    bool _startup_probe = true;     // разрешен ли пробный запрос
+    bool _probe_done = false;       // пробный запрос уже был (или не понадобился)
+    bool _probe_pending = false;    // пробная последовательность еще в работе
+    bool _connected_by_probe = false;
+    uint32_t _connection_ms = 0;    // задержка от initCore() до появления связи, мс
+
+    // связь со сплитом появилась: по пингу или по ответу на пробный запрос
+    void _setConnected(bool by_probe) {
+        if (_has_connection) return;
+        _has_connection = true;
+        _connected_by_probe = by_probe;
+        _connection_ms = _millis() - _core_start_ms;
+        _debugMsg(F("Connection to HVAC established by %s in %u ms."), ESPHOME_LOG_LEVEL_DEBUG, __LINE__, by_probe ? "status probe" : "ping", _connection_ms);
+    }
+
+    // пробный запрос статусов сразу после старта: пинги идут раз в 3 секунды, и ждать первого из них незачем
+    // правильный ответ сплита считается признаком связи; если ответа нет, последовательность отвалится по таймауту,
+    // и связь, как и раньше, появится по первому пингу
+    void _doStartupProbe() {
+        if (_probe_done) return;
+        _probe_done = true;
+        if (!_startup_probe || _has_connection || hasSequence()) return;
+
+        // get*() без связи не работают, поэтому шаги загружаются напрямую
+        if (!_addSequenceFuncStep(&AirConCore::sq_requestSmallStatus) || !_addSequenceFuncStep(&AirConCore::sq_controlSmallStatus) ||
+            !_addSequenceFuncStep(&AirConCore::sq_requestBigStatus) || !_addSequenceFuncStep(&AirConCore::sq_controlBigStatus)) {
+            _debugMsg(F("Startup probe: sequence steps doesn't loaded."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _clearSequence();
+            return;
+        }
+        _probe_pending = true;
+        _debugMsg(F("Startup probe: status requested before the first ping."), ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+    }
+
+    // очистка последовательности команд
+    void _clearSequence() {
+        for (uint8_t i = 0; i < AC_SEQUENCE_MAX_LEN; i++) {
+            _sequence[i].item_type = AC_SIT_NONE;
+            _sequence[i].func = nullptr;
+            _sequence[i].timeout = 0;
+            _sequence[i].msec = 0;
+            _sequence[i].packet_type = AC_SPT_CLEAR;
+            _sequence[i].crc.crc16 = 0;
+            _clearCommand(&_sequence[i].cmd);
+        }
+        _sequence_current_step = 0;
+    }
+
+    // проверяет, есть ли свободные шаги в последовательности команд
+    bool _hasFreeSequenceStep() {
+        return (_getNextFreeSequenceStep() < AC_SEQUENCE_MAX_LEN);
+    }
+
+    // возвращает индекс первого пустого шага последовательности команд
+    uint8_t _getNextFreeSequenceStep() {
+        for (size_t i = 0; i < AC_SEQUENCE_MAX_LEN; i++) {
+            if (_sequence[i].item_type == AC_SIT_NONE) {
+                return i;
+            }
+        }
+        // если свободных слотов нет, то возвращаем значение за пределом диапазона
+        return AC_SEQUENCE_MAX_LEN;
+    }
+
+    // возвращает количество свободных шагов в последовательности
+    uint8_t _getFreeSequenceSpace() {
+        return (AC_SEQUENCE_MAX_LEN - _getNextFreeSequenceStep());
+    }
+
+    // добавляет шаг в последовательность команд
+    // возвращает false, если не нашлось места для шага
+    bool _addSequenceStep(const sequence_item_type_t item_type, bool (AirConCore::*func)() = nullptr, ac_command_t *cmd = nullptr, uint16_t timeout = AC_SEQUENCE_DEFAULT_TIMEOUT) {
+        if (!_hasFreeSequenceStep()) return false;                          // если места нет, то уходим
+        if (item_type == AC_SIT_NONE) return false;                         // глупость какая-то, уходим
+        if ((item_type == AC_SIT_FUNC) && (func == nullptr)) return false;  // должна быть передана функция для такого типа шага
+        if ((item_type != AC_SIT_DELAY) && (item_type != AC_SIT_FUNC)) {
+            // какой-то неизвестный тип
+            _debugMsg(F("_addSequenceStep: unknown sequence item type = %u"), ESPHOME_LOG_LEVEL_DEBUG, __LINE__, item_type);
+            return false;
+        }
+
+        uint8_t step = _getNextFreeSequenceStep();
+
+        _sequence[step].item_type = item_type;
+
+        // если задержка нулевая, то присваиваем дефолтную задержку
+        if (timeout == 0) timeout = AC_SEQUENCE_DEFAULT_TIMEOUT;
+        _sequence[step].timeout = timeout;
+
+        _sequence[step].func = func;
+        if (cmd != nullptr) _sequence[step].cmd = *cmd;  // так как в структуре команды только простые типы, то можно вот так присваивать
+
+        return true;
+    }
+
+    // добавляет в последовательность шаг с задержкой
+    bool _addSequenceDelayStep(uint16_t timeout) {
+        return this->_addSequenceStep(AC_SIT_DELAY, nullptr, nullptr, timeout);
+    }
+
+    // добавляет в последовательность функциональный шаг
+    bool _addSequenceFuncStep(bool (AirConCore::*func)(), ac_command_t *cmd = nullptr, uint16_t timeout = AC_SEQUENCE_DEFAULT_TIMEOUT) {
+        return this->_addSequenceStep(AC_SIT_FUNC, func, cmd, timeout);
+    }
+
+    // завершение последовательности: счетчики, очистка и судьба неподтвержденной команды
+    void _finishSequence(bool success) {
+        if (success) {
+            _sequences_done++;
+        } else {
+            _sequences_failed++;
+        }
+        bool had_command = _hasCommandInSequence();
+        _clearSequence();
+
+        // команда из этой последовательности подтверждена или провалилась: публикуем то, что на самом деле у сплита
+        if (_pending) {
+            _pending = false;
+            if (!success) {
+                _rollbacks++;
+                _debugMsg(F("Command was not confirmed by HVAC, optimistic state rolled back (%u total)."), ESPHOME_LOG_LEVEL_WARN, __LINE__, _rollbacks);
+                commandRolledBack();
+            }
+            stateChanged();
+        }
+
+        if (had_command) commandDone(success);
+    }
+
+    // выполняет всю логику очередного шага последовательности команд
+    void _doSequence() {
+        if (!hasSequence()) return;
+
+        // если шаг уже максимальный из возможных
+        if (_sequence_current_step >= AC_SEQUENCE_MAX_LEN) {
+            // значит последовательность закончилась, надо её очистить
+            // при очистке последовательности будет и _sequence_current_step обнулён
+            _debugMsg(F("Sequence [step %u]: maximum step reached"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+            _finishSequence(true);
+            return;
+        }
+
+        // смотрим тип текущего элемента в последовательности
+        switch (_sequence[_sequence_current_step].item_type) {
+            case AC_SIT_FUNC: {
+                // если указатель на функцию пустой, то прерываем последовательность
+                if (_sequence[_sequence_current_step].func == nullptr) {
+                    _debugMsg(F("Sequence [step %u]: function pointer is NULL, sequence broken"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step);
+                    _finishSequence(false);
+                    return;
+                }
+
+                // сохраняем время начала паузы
+                if (_sequence[_sequence_current_step].msec == 0) {
+                    _sequence[_sequence_current_step].msec = _millis();
+                    _debugMsg(F("Sequence [step %u]: step started"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+                }
+
+                // если таймаут не указан, берем значение по-умолчанию
+                if (_sequence[_sequence_current_step].timeout == 0) _sequence[_sequence_current_step].timeout = AC_SEQUENCE_DEFAULT_TIMEOUT;
+
+                // если время вышло, то отчитываемся в лог и очищаем последовательность
+                if (_millis() - _sequence[_sequence_current_step].msec >= _sequence[_sequence_current_step].timeout) {
+                    _debugMsg(F("Sequence  [step %u]: step timed out (it took %u ms instead of %u ms)"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step, _millis() - _sequence[_sequence_current_step].msec, _sequence[_sequence_current_step].timeout);
+                    _finishSequence(false);
+                    return;
+                }
+
+                // можно вызывать функцию
+                // она самомтоятельно загружает отправляемые/полученные пакеты в packet последовательности
+                // а также самостоятельно увеличивает счетчик шагов последовательности _sequence_current_step
+                // единственное исключение - таймауты
+                if (!(this->*_sequence[_sequence_current_step].func)()) {
+                    _debugMsg(F("Sequence  [step %u]: error was occur in step function"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step, _millis() - _sequence[_sequence_current_step].msec);
+                    _finishSequence(false);
+                    return;
+                }
+                break;
+            }
+
+            case AC_SIT_DELAY: {  // это пауза в последовательности
+                // пауза задается параметром timeout элемента последовательности
+                // начало паузы сохраняется в параметре msec
+
+                // сохраняем время начала паузы
+                if (_sequence[_sequence_current_step].msec == 0) {
+                    _sequence[_sequence_current_step].msec = _millis();
+                    _debugMsg(F("Sequence [step %u]: begin delay (%u ms)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step, _sequence[_sequence_current_step].timeout);
+                }
+
+                // если время вышло, то переходим на следующий шаг
+                if (_millis() - _sequence[_sequence_current_step].msec >= _sequence[_sequence_current_step].timeout) {
+                    _debugMsg(F("Sequence  [step %u]: delay culminated (plan = %u ms, fact = %u ms)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step, _sequence[_sequence_current_step].timeout, _millis() - _sequence[_sequence_current_step].msec);
+                    _sequence_current_step++;
+                }
+                break;
+            }
+
+            case AC_SIT_NONE:  // шаги закончились
+            default:           // или какой-то мусор в последовательности
+                // надо очистить последовательность и уходить
+                _debugMsg(F("Sequence [step %u]: sequence complete"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+                _finishSequence(true);
+                break;
+        }
+    }
+
+    // заполняет структуру команды нейтральными значениями
+    void _clearCommand(ac_command_t *cmd) {
+        cmd->clean = AC_CLEAN_UNTOUCHED;
+        cmd->display = AC_DISPLAY_UNTOUCHED;
+        cmd->fanMute = AC_FANMUTE_UNTOUCHED;
+        cmd->fanSpeed = AC_FANSPEED_UNTOUCHED;
+        cmd->fanTurbo = AC_FANTURBO_UNTOUCHED;
+        cmd->health = AC_HEALTH_UNTOUCHED;
+        cmd->health_status = AC_HEALTH_STATUS_UNTOUCHED;
+        cmd->louver.louver_h = AC_LOUVERH_UNTOUCHED;
+        cmd->louver.louver_v = AC_LOUVERV_UNTOUCHED;
+        cmd->mildew = AC_MILDEW_UNTOUCHED;
+        cmd->mode = AC_MODE_UNTOUCHED;
+        cmd->power = AC_POWER_UNTOUCHED;
+        cmd->sleep = AC_SLEEP_UNTOUCHED;
+        cmd->timer = AC_TIMER_UNTOUCHED;
+        cmd->timer_hours = 0;
+        cmd->timer_minutes = 0;
+        cmd->temp_target = 0;
+        cmd->temp_target_matter = false;
+        cmd->temp_ambient = 0;
+        cmd->temp_outdoor = 0;
+        cmd->temp_inbound = 0;
+        cmd->temp_outbound = 0;
+        cmd->temp_compressor = 0;
+        cmd->realFanSpeed = AC_REAL_FAN_UNTOUCHED;
+        cmd->inverter_power = 0;
+        cmd->defrost = false;
+        cmd->inverter_power_limitation_enable = false;
+        cmd->inverter_power_limitation_value = AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED;
+    };
+
+    // есть ли в последовательности еще не отправленная или не подтвержденная команда установки параметров
+    bool _hasCommandInSequence() {
+        for (uint8_t i = 0; i < AC_SEQUENCE_MAX_LEN; i++) {
+            if (_sequence[i].item_type == AC_SIT_NONE) break;
+            if (_sequence[i].func == &AirConCore::sq_requestDoCommand || _sequence[i].func == &AirConCore::sq_controlDoCommand) return true;
+        }
+        return false;
+    }
+
+    // убирает из команды параметры, которые совпадают с известным состоянием сплита
+    // пакет от этого не меняется (_fillSetCommand берет нетронутые параметры из _current_ac_state), зато пустая команда видна сразу
+    // возвращает false, если менять нечего; такая команда считается подавленной
+    // пока состояние не подтверждено сплитом или в очереди стоит другая команда, сравнивать не с чем, и команда не трогается
+    bool _stripUnchanged(ac_command_t *cmd) {
+        if (!_state_live || _state_stale || _hasCommandInSequence()) return true;
+
+        const ac_state_t &state = _current_ac_state;
+        bool changed = false;
+#define AC_STRIP_FIELD(field, untouched)     \
+    if (cmd->field != untouched) {           \
+        if (cmd->field == state.field) {     \
+            cmd->field = untouched;          \
+        } else {                             \
+            changed = true;                  \
+        }                                    \
+    }
+        AC_STRIP_FIELD(power, AC_POWER_UNTOUCHED);
+        AC_STRIP_FIELD(mode, AC_MODE_UNTOUCHED);
+        AC_STRIP_FIELD(sleep, AC_SLEEP_UNTOUCHED);
+        AC_STRIP_FIELD(fanSpeed, AC_FANSPEED_UNTOUCHED);
+        AC_STRIP_FIELD(fanTurbo, AC_FANTURBO_UNTOUCHED);
+        AC_STRIP_FIELD(fanMute, AC_FANMUTE_UNTOUCHED);
+        AC_STRIP_FIELD(louver.louver_v, AC_LOUVERV_UNTOUCHED);
+        AC_STRIP_FIELD(louver.louver_h, AC_LOUVERH_UNTOUCHED);
+        AC_STRIP_FIELD(clean, AC_CLEAN_UNTOUCHED);
+        AC_STRIP_FIELD(health, AC_HEALTH_UNTOUCHED);
+        AC_STRIP_FIELD(health_status, AC_HEALTH_STATUS_UNTOUCHED);
+        AC_STRIP_FIELD(display, AC_DISPLAY_UNTOUCHED);
+        AC_STRIP_FIELD(mildew, AC_MILDEW_UNTOUCHED);
+#undef AC_STRIP_FIELD
+
+        if (cmd->temp_target_matter) {
+            if (_temp_target_normalise(cmd->temp_target) == state.temp_target) {
+                cmd->temp_target_matter = false;
+            } else {
+                changed = true;
+            }
+        }
+
+        // ограничение мощности задано, если значение не UNTOUCHED; флаг enable - включить его или выключить
+        if (cmd->inverter_power_limitation_value != AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED) {
+            bool same = cmd->inverter_power_limitation_enable
+                            ? (state.inverter_power_limitation_enable &&
+                               _power_limitation_value_normalise(cmd->inverter_power_limitation_value) == state.inverter_power_limitation_value)
+                            : !state.inverter_power_limitation_enable;
+            if (same) {
+                cmd->inverter_power_limitation_enable = false;
+                cmd->inverter_power_limitation_value = AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED;
+            } else {
+                changed = true;
+            }
+        }
+
+        if (!changed) _commands_suppressed++;
+        return changed;
+    }
+
+    // накладывает заданные в команде параметры на состояние (или на другую команду)
+    void _applyCommand(ac_command_t *state, const ac_command_t *cmd) {
+#define AC_APPLY_FIELD(field, untouched) \
+    if (cmd->field != untouched) state->field = cmd->field;
+        AC_APPLY_FIELD(power, AC_POWER_UNTOUCHED);
+        AC_APPLY_FIELD(mode, AC_MODE_UNTOUCHED);
+        AC_APPLY_FIELD(sleep, AC_SLEEP_UNTOUCHED);
+        AC_APPLY_FIELD(fanSpeed, AC_FANSPEED_UNTOUCHED);
+        AC_APPLY_FIELD(fanTurbo, AC_FANTURBO_UNTOUCHED);
+        AC_APPLY_FIELD(fanMute, AC_FANMUTE_UNTOUCHED);
+        AC_APPLY_FIELD(louver.louver_v, AC_LOUVERV_UNTOUCHED);
+        AC_APPLY_FIELD(louver.louver_h, AC_LOUVERH_UNTOUCHED);
+        AC_APPLY_FIELD(clean, AC_CLEAN_UNTOUCHED);
+        AC_APPLY_FIELD(health, AC_HEALTH_UNTOUCHED);
+        AC_APPLY_FIELD(health_status, AC_HEALTH_STATUS_UNTOUCHED);
+        AC_APPLY_FIELD(display, AC_DISPLAY_UNTOUCHED);
+        AC_APPLY_FIELD(mildew, AC_MILDEW_UNTOUCHED);
+#undef AC_APPLY_FIELD
+        if (cmd->temp_target_matter) {
+            state->temp_target = _temp_target_normalise(cmd->temp_target);
+            state->temp_target_matter = true;
+        }
+        // при выключении ограничения его значение у сплита остается прежним; у еще пустой команды оно становится меткой "задано"
+        if (cmd->inverter_power_limitation_value != AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED) {
+            state->inverter_power_limitation_enable = cmd->inverter_power_limitation_enable;
+            if (cmd->inverter_power_limitation_enable || state->inverter_power_limitation_value == AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED)
+                state->inverter_power_limitation_value = _power_limitation_value_normalise(cmd->inverter_power_limitation_value);
+        }
+    }
+
+    // состояние для публикации: известное состояние сплита с наложенной неподтвержденной командой
+    ac_state_t _stateForPublish() {
+        ac_state_t state = _current_ac_state;
+        if (_pending) _applyCommand(&state, &_pending_cmd);
+        return state;
+    }
+
+    // очистка буфера размером AC_BUFFER_SIZE
+    void _clearBuffer(uint8_t *buf) {
+        memset(buf, 0, AC_BUFFER_SIZE);
+    }
+
+    // очистка структуры пакета по указателю
+    void _clearPacket(packet_t *pckt) {
+        if (pckt == nullptr) {
+            _debugMsg(F("Clear packet error: pointer is NULL!"), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return;
+        }
+        pckt->crc = nullptr;
+        pckt->header = (packet_header_t *)(pckt->data);  // заголовок же всегда стартует с начала пакета
+        pckt->msec = 0;
+        pckt->bytesLoaded = 0;
+        pckt->body = nullptr;
+        _clearBuffer(pckt->data);
+    }
+
+    // очистка входящего пакета
+    void _clearInPacket() {
+        _clearPacket(&_inPacket);
+    }
+
+    // очистка исходящего пакета
+    void _clearOutPacket() {
+        _clearPacket(&_outPacket);
+        _outPacket.header->start_byte = AC_PACKET_START_BYTE;  // для исходящего сразу ставим стартовый байт
+        _outPacket.header->wifi = AC_PACKET_ANSWER;            // для исходящего пакета сразу ставим признак ответа
+    }
+
+    // копирует пакет из одной структуры в другую с корректным переносом указателей на заголовки и т.п.
+    bool _copyPacket(packet_t *dest, packet_t *src) {
+        if (dest == nullptr) return false;
+        if (src == nullptr) return false;
+
+        dest->msec = src->msec;
+        dest->bytesLoaded = src->bytesLoaded;
+        memcpy(dest->data, src->data, AC_BUFFER_SIZE);
+        dest->header = (packet_header_t *)&dest->data;
+        if (dest->header->body_length > 0) dest->body = &dest->data[AC_HEADER_SIZE];
+        dest->crc = (packet_crc_t *)&dest->data[AC_HEADER_SIZE + dest->header->body_length];
+
+        return true;
+    }
+
+    // устанавливает состояние конечного автомата
+    // можно и напрямую устанавливать переменную, но для целей отладки лучше так
+    void _setStateMachineState(acsm_state state = ACSM_IDLE) {
+        if (_ac_state == state) return;  // состояние не меняется
+
+        _ac_state = state;
+
+        switch (state) {
+            case ACSM_IDLE:
+                _debugMsg(F("State changed to ACSM_IDLE."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                break;
+
+            case ACSM_RECEIVING_PACKET:
+                _debugMsg(F("State changed to ACSM_RECEIVING_PACKET."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                break;
+
+            case ACSM_PARSING_PACKET:
+                _debugMsg(F("State changed to ACSM_PARSING_PACKET."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                break;
+
+            case ACSM_SENDING_PACKET:
+                _debugMsg(F("State changed to ACSM_SENDING_PACKET."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                break;
+
+            default:
+                _debugMsg(F("State changed to ACSM_IDLE by default. Given state is %02X."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, state);
+                _ac_state = ACSM_IDLE;
+                break;
+        }
+    }
+
+    // состояние конечного автомата: IDLE
+    void _doIdleState() {
+        // вначале нужно выполнить очередной шаг последовательности команд
+        _doSequence();
+
+        // Если нет входящих данных, значит можно отправить исходящий пакет, если он есть
+        if (_uart->available() == 0) {
+            // если есть пакет на отправку, то надо отправлять
+            // вначале думал, что сейчас отправка пакетов тут не нужна, т.к. состояние ACSM_SENDING_PACKET устанавливается сразу в парсере пакетов
+            // но потом понял, что у нас пакеты уходят не только когда надо отвечать, но и мы можем быть инициаторами
+            // поэтому вызов отправки тут пригодится
+            // новый пакет не отправляем, пока UART не выдал в линию предыдущий и пока на линии не наступила тишина
+            if ((_outPacket.msec > 0) && _isBusFree()) _setStateMachineState(ACSM_SENDING_PACKET);
+            // больше дел нет - выходим
+            return;
+        };
+
+        if (this->peek() == AC_PACKET_START_BYTE) {
+            // если во входящий пакет что-то уже загружено, значит это какие-то ошибочные данные или неизвестные пакеты
+            // надо эту инфу вывалить в лог
+            if (_inPacket.bytesLoaded > 0) {
+                _debugMsg(F("Start byte received but there are some unparsed bytes in the buffer:"), ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+                _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+            }
+            _clearInPacket();
+            _inPacket.msec = _millis();
+            _setStateMachineState(ACSM_RECEIVING_PACKET);
+
+        } else {
+            while (_uart->available() > 0) {
+                // если наткнулись на старт пакета, то выходим из while
+                // если какие-то данные были загружены в буфер, то они будут выгружены в лог при загрузке нового пакета
+                if (this->peek() == AC_PACKET_START_BYTE) break;
+
+                // читаем байт в буфер входящего пакета
+                _inPacket.data[_inPacket.bytesLoaded] = this->read();
+                _inPacket.bytesLoaded++;
+
+                // если буфер уже полон, надо его вывалить в лог и очистить
+                if (_inPacket.bytesLoaded >= AC_BUFFER_SIZE) {
+                    _debugMsg(F("Some unparsed data on the bus:"), ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+                    _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+                    _clearInPacket();
+                }
+            }
+        }
+    };
+
+    // состояние конечного автомата: ACSM_RECEIVING_PACKET
+    void _doReceivingPacketState() {
+        while (_uart->available() > 0) {
+            // если в буфере пакета данных уже под завязку, то надо сообщить о проблеме и выйти
+            if (_inPacket.bytesLoaded >= AC_BUFFER_SIZE) {
+                _debugMsg(F("Receiver: packet buffer overflow!"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+                _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+                _clearInPacket();
+                _setStateMachineState(ACSM_IDLE);
+                return;
+            }
+
+            _inPacket.data[_inPacket.bytesLoaded] = this->read();
+            _inPacket.bytesLoaded++;
+
+            // данных достаточно для заголовка
+            if (_inPacket.bytesLoaded == AC_HEADER_SIZE) {
+                // указатель заголовка установлен еще при обнулении пакета, его можно не трогать
+                //_inPacket.header = (packet_header_t *)(_inPacket.data);
+
+                // пакет с таким телом в буфер не влезет, а указатель на CRC ушел бы за его границу
+                if (_inPacket.header->body_length > AC_BUFFER_SIZE - AC_HEADER_SIZE - 2) {
+                    _debugMsg(F("Receiver: wrong body length %02X in header, packet dropped."), ESPHOME_LOG_LEVEL_WARN, __LINE__, _inPacket.header->body_length);
+                    _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+                    _clearInPacket();
+                    _setStateMachineState(ACSM_IDLE);
+                    return;
+                }
+
+                // уже знаем размер пакета и можем установить указатели на тело пакета и CRC
+                _inPacket.crc = (packet_crc_t *)&(_inPacket.data[AC_HEADER_SIZE + _inPacket.header->body_length]);
+                if (_inPacket.header->body_length > 0) _inPacket.body = &(_inPacket.data[AC_HEADER_SIZE]);
+
+                _debugMsg(F("Header loaded: timestamp = %010u, start byte = %02X, packet type = %02X, body size = %02X"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _inPacket.msec, _inPacket.header->start_byte, _inPacket.header->packet_type, _inPacket.header->body_length);
+            }
+
+            // если все байты пакета загружены, надо его распарсить
+            // максимальный по размеру пакет будет упираться в размер буфера. если такой пакет здесь не уйдет на парсинг,
+            // то на следующей итерации будет ошибка о переполнении буфера, которая в начале цикла while
+            if (_inPacket.bytesLoaded == AC_HEADER_SIZE + _inPacket.header->body_length + 2) {
+                _debugMsg(F("Packet loaded: timestamp = %010u, start byte = %02X, packet type = %02X, body size = %02X, crc = [%02X, %02X]."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _inPacket.msec, _inPacket.header->start_byte, _inPacket.header->packet_type, _inPacket.header->body_length, _inPacket.crc->crc[0], _inPacket.crc->crc[1]);
+                _debugMsg(F("Loaded %02u bytes for a %u ms."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _inPacket.bytesLoaded, (_millis() - _inPacket.msec));
+                _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                _setStateMachineState(ACSM_PARSING_PACKET);
+                return;
+            }
+        }
+
+        // если пакет не загружен, а время вышло, то надо вернуться в IDLE
+        if (_millis() - _inPacket.msec >= this->_packet_timeout) {
+            _debugMsg(F("Receiver: packet timed out!"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _clearInPacket();
+            _setStateMachineState(ACSM_IDLE);
+            return;
+        }
+    };
+
+    // состояние конечного автомата: ACSM_PARSING_PACKET
+    void _doParsingPacket() {
+        if (!_checkCRC(&_inPacket)) {
+            _debugMsg(F("Parser: packet CRC fail!"), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            _clearInPacket();
+            _setStateMachineState(ACSM_IDLE);
+            return;
+        }
+
+        bool stateChangedFlag = false;  // флаг, показывающий, изменилось ли состояние кондиционера
+        uint8_t stateByte = 0;          // переменная для временного сохранения текущих параметров сплита для проверки их изменения
+        float stateFloat = 0.0;         // переменная для временного сохранения текущих параметров сплита для проверки их изменения
+
+        // вначале выводим полученный пакет в лог, чтобы он шел до информации об ответах и т.п.
+        _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+
+        // разбираем тип пакета
+        switch (_inPacket.header->packet_type) {
+            case AC_PTYPE_PING: {  // ping-пакет, рассылается кондиционером каждые 3 сек.; модуль на него отвечает
+
+                if (_inPacket.header->body_length != 0) {  // у входящего ping-пакета тело должно отсутствовать
+                    // если тело есть, то жалуемся в лог
+                    _debugMsg(F("Parser: ping packet should not to have body. Received one has body length %02X."), ESPHOME_LOG_LEVEL_WARN, __LINE__, _inPacket.header->body_length);
+                    // очищаем пакет
+                    _clearInPacket();
+                    _setStateMachineState(ACSM_IDLE);
+                    break;
+                }
+
+                _debugMsg(F("Parser: ping packet received"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                // поднимаем флаг, что есть коннект с кондиционером
+                _setConnected(false);
+
+                // надо отправлять ответ на пинг
+                _clearOutPacket();
+                _outPacket.msec = _millis();
+                _outPacket.header->packet_type = AC_PTYPE_PING;
+                _outPacket.header->ping_answer_01 = 0x01;  // магия, детали тут: https://github.com/GrKoR/AUX_HVAC_Protocol#packet_type_ping
+                _outPacket.header->body_length = 8;
+                _outPacket.body = &(_outPacket.data[AC_HEADER_SIZE]);
+
+                // заполняем тело пакета
+                packet_ping_answer_body_t *ping_body;
+                ping_body = (packet_ping_answer_body_t *)(_outPacket.body);
+                ping_body->byte_1C = 0x1C;
+                ping_body->byte_27 = 0x27;
+
+                // расчет контрольной суммы и прописывание её в пакет
+                _outPacket.crc = (packet_crc_t *)&(_outPacket.data[AC_HEADER_SIZE + _outPacket.header->body_length]);
+                _setCRC16(&_outPacket);
+                _outPacket.bytesLoaded = AC_HEADER_SIZE + _outPacket.header->body_length + 2;
+
+                _debugMsg(F("Parser: generated ping answer. Waiting for sending."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+                // до отправки пинг-ответа проверяем, не выполнялась ли стартовая последовательность команд
+                // по задумке она выполняется после подключения к кондиционеру после ответа на первый пинг
+                // нужна для максимально быстрого определния текущих параметров кондиционера
+                if (!_startupSequenceComlete) {
+                    _startupSequenceComlete = startupSequence();
+                }
+
+                _setStateMachineState(ACSM_SENDING_PACKET);
+
+                break;
+            }
+
+            case AC_PTYPE_CMD: {  // команда сплиту; модуль отправляет такие команды, когда что-то хочет от сплита
+                //  сплит такие команды отправлять не должен, поэтому жалуемся в лог
+                _debugMsg(F("Parser: packet type=0x06 received from HVAC. This isn't expected."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+                // очищаем пакет
+                _clearInPacket();
+                _setStateMachineState(ACSM_IDLE);
+                break;
+            }
+
+            case AC_PTYPE_INFO: {  // информационный пакет
+                _debugMsg(F("Parser: status packet received"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                // ответ на пробный запрос: связь есть, а стартовые статусы уже запрошены пробой
+                if (_probe_pending && !_has_connection) {
+                    _setConnected(true);
+                    _startupSequenceComlete = true;
+                }
+                // смотрим тип поступившего пакета по второму байту тела
+                // но вначале проверяем, что такое тело вообще есть
+                if ((_inPacket.body == nullptr) || (_inPacket.bytesLoaded < AC_HEADER_SIZE + 4) || (_inPacket.header->body_length < 2)) {
+                    _debugMsg(F("Parser: packet type=0x07 without body. Error!"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+                    _clearInPacket();
+                    _setStateMachineState(ACSM_IDLE);
+                    break;
+                }
+                // теперь можно проверять второй байт тела пакета
+                switch (_inPacket.body[1]) {
+                    case AC_CMD_STATUS_SMALL: {  // маленький пакет статуса кондиционера
+                        _debugMsg(F("Parser: status packet type = small"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                        if (_inPacket.header->body_length < 0x0F) {
+                            _debugMsg(F("Parser: small status packet is too short (%02X). Ignored."), ESPHOME_LOG_LEVEL_WARN, __LINE__, _inPacket.header->body_length);
+                            break;
+                        }
+                        stateChangedFlag = false;
+
+                        // будем обращаться к телу пакета через указатель на структуру
+                        packet_small_info_body_t *small_info_body;
+                        small_info_body = (packet_small_info_body_t *)(_inPacket.body);
+
+                        // в малом пакете передается большое количество установленных пользователем параметров работы
+                        //stateFloat = 8 + (small_info_body->target_temp_int_and_v_louver >> 3) + 0.5 * (float)(small_info_body->target_temp_frac >> 7);
+                        stateFloat = 8.0 + (float)(small_info_body->target_temp_int) + ( (small_info_body->target_temp_frac_bool) ? 0.5 : 0.0 );
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_target != stateFloat);
+                        _current_ac_state.temp_target = stateFloat;
+                        _current_ac_state.temp_target_matter = true;
+
+                        //stateByte = small_info_body->target_temp_int_and_v_louver & AC_LOUVERV_MASK;
+                        stateByte = small_info_body->v_louver;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.louver.louver_v != (ac_louver_V)stateByte);
+                        _current_ac_state.louver.louver_v = (ac_louver_V)stateByte;
+
+                        stateByte = small_info_body->h_louver & AC_LOUVERH_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.louver.louver_h != (ac_louver_H)stateByte);
+                        _current_ac_state.louver.louver_h = (ac_louver_H)stateByte;
+
+                        stateByte = small_info_body->fan_speed & AC_FANSPEED_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.fanSpeed != (ac_fanspeed)stateByte);
+                        _current_ac_state.fanSpeed = (ac_fanspeed)stateByte;
+
+                        stateByte = small_info_body->fan_turbo_and_mute & AC_FANTURBO_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.fanTurbo != (ac_fanturbo)stateByte);
+                        _current_ac_state.fanTurbo = (ac_fanturbo)stateByte;
+
+                        stateByte = small_info_body->fan_turbo_and_mute & AC_FANMUTE_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.fanMute != (ac_fanmute)stateByte);
+                        _current_ac_state.fanMute = (ac_fanmute)stateByte;
+
+                        stateByte = small_info_body->mode & AC_MODE_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.mode != (ac_mode)stateByte);
+                        _current_ac_state.mode = (ac_mode)stateByte;
+
+                        stateByte = small_info_body->mode & AC_SLEEP_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.sleep != (ac_sleep)stateByte);
+                        _current_ac_state.sleep = (ac_sleep)stateByte;
+
+                        stateByte = small_info_body->status & AC_POWER_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.power != (ac_power)stateByte);
+                        _current_ac_state.power = (ac_power)stateByte;
+
+                        stateByte = small_info_body->status & AC_HEALTH_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.health != (ac_health)stateByte);
+                        _current_ac_state.health = (ac_health)stateByte;
+
+                        stateByte = small_info_body->status & AC_HEALTH_STATUS_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.health_status != (ac_health_status)stateByte);
+                        _current_ac_state.health_status = (ac_health_status)stateByte;
+
+                        stateByte = small_info_body->status & AC_CLEAN_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.clean != (ac_clean)stateByte);
+                        _current_ac_state.clean = (ac_clean)stateByte;
+
+                        stateByte = small_info_body->display_and_mildew & AC_DISPLAY_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.display != (ac_display)stateByte);
+                        _current_ac_state.display = (ac_display)stateByte;
+
+                        stateByte = small_info_body->display_and_mildew & AC_MILDEW_MASK;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.mildew != (ac_mildew)stateByte);
+                        _current_ac_state.mildew = (ac_mildew)stateByte;
+
+                        // enable flag of power limitation for inverter ACs
+                        bool temp = small_info_body->inverter_power_limitation_enable;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.inverter_power_limitation_enable != temp);
+                        _current_ac_state.inverter_power_limitation_enable = temp;
+
+                        // the limit value of power limitation for inverter ACs
+                        stateByte = small_info_body->inverter_power_limitation_value;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.inverter_power_limitation_value != stateByte);
+                        _current_ac_state.inverter_power_limitation_value = stateByte;
+
+                        // первый живой статус заменяет восстановленное состояние, публикуем его в любом случае
+                        if (!_state_live) {
+                            _state_live = true;
+                            _state_stale = false;
+                            _state_live_ms = _millis() - _core_start_ms;
+                            stateChangedFlag = true;
+                            _debugMsg(F("First status from HVAC in %u ms."), ESPHOME_LOG_LEVEL_DEBUG, __LINE__, _state_live_ms);
+                        }
+
+                        // уведомляем об изменении статуса сплита
+                        if (stateChangedFlag) stateChanged();
+
+                        break;
+                    }
+
+                    case AC_CMD_STATUS_BIG:         // большой пакет статуса кондиционера
+                    case AC_CMD_STATUS_PERIODIC: {  // раз в 10 минут рассылается сплитом, структура аналогична большому пакету статуса
+                        // TODO: вроде как AC_CMD_STATUS_PERIODIC могут быть и с другими кодами; пока что другие будут игнорироваться; если это будет критично, надо будет поправить
+                        _debugMsg(F("Parser: status packet type = big or periodic"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+                        if (_inPacket.header->body_length < 0x18) {
+                            _debugMsg(F("Parser: big status packet is too short (%02X). Ignored."), ESPHOME_LOG_LEVEL_WARN, __LINE__, _inPacket.header->body_length);
+                            break;
+                        }
+                        stateChangedFlag = false;
+
+                        // будем обращаться к телу пакета через указатель на структуру
+                        packet_big_info_body_t *big_info_body;
+                        big_info_body = (packet_big_info_body_t *)(_inPacket.body);
+
+                        // тип кондея (инвертор или старт стоп)
+                        _is_inverter = big_info_body->is_inverter;
+                        
+                        // температура воздуха в помещении по версии сплит-системы
+                        stateFloat = big_info_body->ambient_temperature_int - 0x20 + (float)(big_info_body->ambient_temperature_frac & 0x0f) / 10.0;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_ambient != stateFloat);
+                        _current_ac_state.temp_ambient = stateFloat;
+
+                        // некая температура из наружного блока, скорее всего температура испарителя
+                        // GK: фильтрацию тут убрал. Лучше это делать в ESPHome. Для этого у сенсора есть возможности. А тут лучше иметь чистые значения для аналлиза.
+                        stateFloat = big_info_body->outdoor_temperature - 0x20;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_outdoor != stateFloat);
+                        _current_ac_state.temp_outdoor = stateFloat;
+
+                        // температура входящей магистрали
+                        stateFloat = big_info_body->in_temperature_int - 0x20;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_inbound != stateFloat);
+                        _current_ac_state.temp_inbound = stateFloat;
+
+                        // температура исходящей магистрали
+                        stateFloat = big_info_body->out_temperature_int - 0x20;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_outbound != stateFloat);
+                        _current_ac_state.temp_outbound = stateFloat;
+
+                        // температура компрессора внешнего блока
+                        stateFloat = big_info_body->compressor_temperature_int - 0x20;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.temp_compressor != stateFloat);
+                        _current_ac_state.temp_compressor = stateFloat;
+
+                        // реальная скорость пропеллера
+                        stateFloat = big_info_body->realFanSpeed;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.realFanSpeed != (ac_realFan)stateFloat);
+                        _current_ac_state.realFanSpeed = (ac_realFan)stateFloat;
+
+                        // мощность инвертора
+                        stateFloat = big_info_body->inverter_power;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.inverter_power != stateFloat);
+                        _current_ac_state.inverter_power = stateFloat;
+
+                        // режим разморозки
+                        //bool temp = (big_info_body->needDefrost && big_info_body->defrostMode);
+                        // TODO: need additional info for bit big_info_body->needDefrost
+                        // Some HVACs use it but others don't (they use bit 3 instead of bit 4 (needDefrost))
+                        bool temp = big_info_body->defrostMode;
+                        stateChangedFlag = stateChangedFlag || (_current_ac_state.defrost != temp);
+                        _current_ac_state.defrost = temp;
+
+                        // статистика адаптера могла измениться и при неизменных сырых значениях
+                        if (telemetryParsed()) stateChangedFlag = true;
+
+                        // уведомляем об изменении статуса сплита
+                        if (stateChangedFlag) stateChanged();
+
+                        break;
+                    }
+
+                    case AC_CMD_SET_PARAMS: {  // такой статусный пакет присылается кондиционером в ответ на команду установки параметров
+                        // в теле пакета нет ничего примечательного
+                        // в байтах 2 и 3 тела передается CRC пакета поступившей команды, на которую сплит отвечает
+                        // я решил этот момент тут не проверять и не контролировать.
+                        // корректную установку параметров можно определить, запросив статус кондиционера сразу после получения этой команды кондея
+                        // в настоящий момент проверка сделана в механизме sequences
+                        break;
+                    }
+
+                    default:
+                        _debugMsg(F("Parser: status packet type = unknown (%02X)"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _inPacket.body[1]);
+                        break;
+                }
+                _setStateMachineState(ACSM_IDLE);
+                break;
+            }
+
+            case AC_PTYPE_INIT:  // инициирующий пакет; присылается сплитом, если кнопка HEALTH на пульте нажимается 8 раз; как там и что работает - не разбирался.
+            case AC_PTYPE_UNKN:  // какой-то странный пакет, отправляемый пультом при инициации и иногда при включении питания... как работает и зачем нужен - не разбирался, сплит на него вроде бы не реагирует
+            default:
+                // игнорируем. Для нашего случая эти пакеты не важны
+                _setStateMachineState(ACSM_IDLE);
+                break;
+        }
+
+        // если есть последовательность команд, то надо отработать проверку последовательности
+        if (hasSequence()) _doSequence();
+
+        // после разбора входящего пакета его надо очистить
+        _clearInPacket();
+    }
+
+    // состояние конечного автомата: ACSM_SENDING_PACKET
+    void _doSendingPacketState() {
+        // если нет исходящего пакета, то выходим
+        if ((_outPacket.msec == 0) || (_outPacket.crc == nullptr) || (_outPacket.bytesLoaded == 0)) {
+            _debugMsg(F("Sender: no packet to send."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+            _setStateMachineState(ACSM_IDLE);
+            return;
+        }
+
+        // UART еще выдает предыдущий пакет или линия занята кондиционером;
+        // пакет остается в очереди, а мы возвращаемся слушать линию
+        // так передача никогда не начнется посреди входящего пакета
+        if (!_isBusFree()) {
+            _setStateMachineState(ACSM_IDLE);
+            return;
+        }
+
+        _debugMsg(F("Sender: sending packet."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // flush() не вызываем: байты уходят в линию без нас, а приемник в это время продолжает работать
+        _uart->write_array(_outPacket.data, _outPacket.bytesLoaded);
+        _tx_start_us = _micros();
+        _tx_duration_us = _outPacket.bytesLoaded * _tx_byte_time_us;
+        _tx_collision = false;
+        _tx_deferred = false;
+
+        _debugPrintPacket(&_outPacket, ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+        _debugMsg(F("Sender: %u bytes queued (%u ms), transmission takes about %u us."), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _outPacket.bytesLoaded, _millis() - _outPacket.msec, _tx_duration_us);
+        _clearOutPacket();
+
+        _setStateMachineState(ACSM_IDLE);
+    };
+
+    // один шаг конечного автомата, вызывается из loop()
+    void _doStateMachine() {
+        AC_PROFILER_START();
+        switch (_ac_state) {
+            case ACSM_RECEIVING_PACKET:
+                // находимся в процессе получения пакета, никакие отправки в этом состоянии невозможны
+                _doReceivingPacketState();
+                AC_PROFILER_STOP(AC_PROF_RECEIVING);
+                break;
+
+            case ACSM_PARSING_PACKET:
+                // разбираем полученный пакет; если бюджет узла на этот проход исчерпан, пакет ждет следующего
+                if ((_scheduler == nullptr) || _scheduler->take_bytes(_inPacket.bytesLoaded)) _doParsingPacket();
+                AC_PROFILER_STOP(AC_PROF_PARSING);
+                break;
+
+            case ACSM_SENDING_PACKET:
+                // отправляем пакет сплиту
+                _doSendingPacketState();
+                AC_PROFILER_STOP(AC_PROF_SENDING);
+                break;
+
+            case ACSM_IDLE:  // ничего не делаем, ждем, на что бы среагировать
+            default:         // если состояние какое-то посторонее, то считаем, что IDLE
+                _doIdleState();
+                AC_PROFILER_STOP(AC_PROF_IDLE);
+                break;
+        }
+    }
+
+    // раз в _update_period миллисекунд запрашивает обновление статуса кондиционера
+    void _doStatusPolling() {
+        if ((_millis() - _dataMillis) > _update_period) {
+            // опрос другого кондиционера узла начался недавно: ждем своей очереди
+            if ((_scheduler != nullptr) && get_has_connection() && !_scheduler->take_poll(_millis())) return;
+            _dataMillis = _millis();
+
+            // обычный wifi-модуль запрашивает маленький пакет статуса
+            // но нам никто не мешает запрашивать и большой и маленький, чтобы чаще обновлять комнатную температуру
+            // делаем этот запрос только в случае, если есть коннект с кондиционером
+            if (get_has_connection()) getStatusBigAndSmall();
+        }
+    }
+
+    /** вывод отладочной информации в лог
+     *
+     * dbgLevel - уровень сообщения, определен в ESPHome. За счет его использования можно из ESPHome управлять полнотой сведений в логе.
+     * msg - сообщение, выводимое в лог
+     * line - строка, на которой произошел вызов (удобно при отладке)
+     */
+    void _debugMsg(ac_log_msg_t msg, uint8_t dbgLevel = ESPHOME_LOG_LEVEL_DEBUG, unsigned int line = 0, ...) {
+        if (_logger == nullptr) return;
+        if (dbgLevel < ESPHOME_LOG_LEVEL_NONE) dbgLevel = ESPHOME_LOG_LEVEL_NONE;
+        if (dbgLevel > ESPHOME_LOG_LEVEL_VERY_VERBOSE) dbgLevel = ESPHOME_LOG_LEVEL_VERY_VERBOSE;
+
+        if (line == 0) line = __LINE__;  // если строка не передана, берем текущую строку
+
+        va_list vl;
+        va_start(vl, line);
+#if defined(ARDUINO)
+        _logger->logv(dbgLevel, line, msg.c_str(), vl);
+#else
+        _logger->logv(dbgLevel, line, msg, vl);
+#endif
+        va_end(vl);
+    }
+
+    /** выводим данные пакета в лог для отладки
+     *
+     * dbgLevel - уровень сообщения, определен в ESPHome. За счет его использования можно из ESPHome управлять полнотой сведений в логе.
+     * packet - указатель на пакет для вывода;
+     *          если указатель на crc равен nullptr или первый байт в буфере не AC_PACKET_START_BYTE, то считаем, что передан битый пакет
+     *          или не пакет вовсе. Для такого выводим только массив байт.
+     *          Для нормального пакета данные выводятся с форматированием.
+     * line - строка, на которой произошел вызов (удобно при отладке)
+     **/
+    void _debugPrintPacket(packet_t *packet, uint8_t dbgLevel = ESPHOME_LOG_LEVEL_DEBUG, unsigned int line = __LINE__) {
+        // определяем, полноценный ли пакет нам передан
+        bool notAPacket = false;
+        // указатель заголовка всегда установден на начало буфера
+        notAPacket = notAPacket || (packet->crc == nullptr);
+        notAPacket = notAPacket || (packet->data[0] != AC_PACKET_START_BYTE);
+
+        // если пакет по длине меньше, чем указано в фильтре, то не выводим.
+        // если вывод пакетов отключен с помощью директивы HOLMES_WORKS, то тоже не выводим.
+        // "не пакеты" выводим всегда, так как от них зависит отладка багов
+        if ((!notAPacket) && (packet->header->body_length < HOLMES_FILTER_LEN)) return;
+        if ((!notAPacket) && (!HOLMES_WORKS)) return;
+
+        // строка собирается в буфере на стеке, без String: так код не зависит от Arduino
+        // на каждый байт пакета с запасом отводим 8 символов (байт, разделитель и скобки)
+        char st[AC_DEBUG_PACKET_STR_LEN];
+        size_t len = 0;
+
+        // заполняем время получения пакета
+        _strAppend(st, len, "%010u: ", packet->msec);
+
+        // формируем преамбулы
+        if (packet == &_inPacket) {
+            _strAppend(st, len, "[<=] ");  // преамбула входящего пакета
+        } else if (packet == &_outPacket) {
+            _strAppend(st, len, "[=>] ");  // преамбула исходящего пакета
+        } else {
+            _strAppend(st, len, "[--] ");  // преамбула для "непакета"
+        }
+
+        // формируем данные
+        for (int i = 0; i < packet->bytesLoaded; i++) {
+            // для заголовков нормальных пакетов надо отработать скобки (если они есть)
+            if ((!notAPacket) && (i == 0)) _strAppend(st, len, HOLMES_HEADER_BRACKET_OPEN);
+            // для CRC нормальных пакетов надо отработать скобки (если они есть)
+            if ((!notAPacket) && (i == packet->header->body_length + AC_HEADER_SIZE)) _strAppend(st, len, HOLMES_CRC_BRACKET_OPEN);
+
+            _strAppend(st, len, HOLMES_BYTE_FORMAT, packet->data[i]);
+
+            // для заголовков нормальных пакетов надо отработать скобки (если они есть)
+            if ((!notAPacket) && (i == AC_HEADER_SIZE - 1)) _strAppend(st, len, HOLMES_HEADER_BRACKET_CLOSE);
+            // для CRC нормальных пакетов надо отработать скобки (если они есть)
+            if ((!notAPacket) && (i == packet->header->body_length + AC_HEADER_SIZE + 2 - 1)) _strAppend(st, len, HOLMES_CRC_BRACKET_CLOSE);
+
+            _strAppend(st, len, HOLMES_DELIMITER);
+        }
+
+        _debugMsg(F("%s"), dbgLevel, line, st);
+    }
+
+    // дописывает форматированный текст в конец строки st размером AC_DEBUG_PACKET_STR_LEN
+    // len - текущая длина строки; при нехватке места строка обрезается
+    void _strAppend(char *st, size_t &len, const char *format, ...) {
+        if (len >= AC_DEBUG_PACKET_STR_LEN - 1) return;
+        va_list vl;
+        va_start(vl, format);
+        int n = vsnprintf(st + len, AC_DEBUG_PACKET_STR_LEN - len, format, vl);
+        va_end(vl);
+        if (n < 0) return;
+        len += n;
+        if (len > AC_DEBUG_PACKET_STR_LEN - 1) len = AC_DEBUG_PACKET_STR_LEN - 1;
+    }
+
+    /** расчет CRC16 для блока данных data длиной len
+     *      data    - данные для расчета CRC16, указатель на массив байт
+     *      len     - длина блока данных для расчета, в байтах
+     *
+     * возвращаем uint16_t CRC16
+     **/
+    uint16_t _CRC16(uint8_t *data, uint8_t len) {
+        uint32_t crc = 0;
+
+        // выделяем буфер для расчета CRC и копируем в него переданные данные
+        // это нужно для того, чтобы в случае нечетной длины данных можно было дополнить тело пакета
+        // одним нулевым байтом и не попортить загруженный пакет (ведь в загруженном сразу за телом идёт CRC)
+        uint8_t _crcBuffer[AC_BUFFER_SIZE];
+        memset(_crcBuffer, 0, AC_BUFFER_SIZE);
+        memcpy(_crcBuffer, data, len);
+
+        // если длина данных нечетная, то надо сделать четной, дополнив данные в конце нулевым байтом
+        // но так как выше буфер заполняли нулями, то отдельно тут присваивать 0x00 нет смысла
+        if ((len % 2) == 1) len++;
+
+        // рассчитываем CRC16
+        uint32_t word = 0;
+        for (uint8_t i = 0; i < len; i += 2) {
+            word = (_crcBuffer[i] << 8) + _crcBuffer[i + 1];
+            crc += word;
+        }
+        crc = (crc >> 16) + (crc & 0xFFFF);
+        crc = ~crc;
+
+        return crc & 0xFFFF;
+    }
+
+    // расчитываем CRC16 и заполняем эти данные в структуре пакета
+    void _setCRC16(packet_t *pack = nullptr) {
+        // если пакет не указан, то устанавливаем CRC для исходящего пакета
+        if (pack == nullptr) pack = &_outPacket;
+
+        packet_crc_t crc;
+        crc.crc16 = _CRC16(pack->data, AC_HEADER_SIZE + pack->header->body_length);
+
+        // если забыли указатель на crc установить, то устанавливаем
+        if (pack->crc == nullptr) pack->crc = (packet_crc_t *)&(pack->data[AC_HEADER_SIZE + pack->header->body_length]);
+
+        pack->crc->crc[0] = crc.crc[1];
+        pack->crc->crc[1] = crc.crc[0];
+        return;
+    }
+
+    // проверяет CRC пакета по указателю
+    bool _checkCRC(packet_t *pack = nullptr) {
+        // если пакет не указан, то проверяем входящий
+        if (pack == nullptr) pack = &_inPacket;
+        if (pack->bytesLoaded < AC_HEADER_SIZE) {
+            _debugMsg(F("CRC check: incoming packet size error."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        // если забыли указатель на crc установить, то устанавливаем
+        if (pack->crc == nullptr) pack->crc = (packet_crc_t *)&(pack->data[AC_HEADER_SIZE + pack->header->body_length]);
+
+        packet_crc_t crc;
+        crc.crc16 = _CRC16(pack->data, AC_HEADER_SIZE + pack->header->body_length);
+
+        return ((pack->crc->crc[0] == crc.crc[1]) && (pack->crc->crc[1] == crc.crc[0]));
+    }
+
+    // заполняет пакет по ссылке командой запроса маленького пакета статуса
+    void _fillStatusSmall(packet_t *pack = nullptr) {
+        // по умолчанию заполняем исходящий пакет
+        if (pack == nullptr) pack = &_outPacket;
+
+        // присваиваем параметры пакета
+        pack->msec = _millis();
+        pack->header->start_byte = AC_PACKET_START_BYTE;
+        pack->header->wifi = AC_PACKET_ANSWER;  // для исходящего пакета ставим признак ответа
+        pack->header->packet_type = AC_PTYPE_CMD;
+        pack->header->body_length = 2;  // тело команды 2 байта
+        pack->body = &(pack->data[AC_HEADER_SIZE]);
+        pack->body[0] = AC_CMD_STATUS_SMALL;
+        pack->body[1] = 0x01;  // он всегда 0x01
+        pack->bytesLoaded = AC_HEADER_SIZE + pack->header->body_length + 2;
+
+        // рассчитываем и записываем в пакет CRC
+        pack->crc = (packet_crc_t *)&(pack->data[AC_HEADER_SIZE + pack->header->body_length]);
+        _setCRC16(pack);
+    }
+
+    // заполняет пакет по ссылке командой запроса большого пакета статуса
+    void _fillStatusBig(packet_t *pack = nullptr) {
+        // по умолчанию заполняем исходящий пакет
+        if (pack == nullptr) pack = &_outPacket;
+
+        // присваиваем параметры пакета
+        pack->msec = _millis();
+        pack->header->start_byte = AC_PACKET_START_BYTE;
+        pack->header->wifi = AC_PACKET_ANSWER;  // для исходящего пакета ставим признак ответа
+        pack->header->packet_type = AC_PTYPE_CMD;
+        pack->header->body_length = 2;  // тело команды 2 байта
+        pack->body = &(pack->data[AC_HEADER_SIZE]);
+        pack->body[0] = AC_CMD_STATUS_BIG;
+        pack->body[1] = 0x01;  // он всегда 0x01
+        pack->bytesLoaded = AC_HEADER_SIZE + pack->header->body_length + 2;
+
+        // рассчитываем и записываем в пакет CRC
+        pack->crc = (packet_crc_t *)&(pack->data[AC_HEADER_SIZE + pack->header->body_length]);
+        _setCRC16(pack);
+    }
+
+    /** заполняет пакет по ссылке командой установки параметров
+     *
+     * указатель на пакет может отсутствовать, тогда заполняется _outPacket
+     * указатель на команду также может отсутствовать, тогда используется текущее состояние из _current_ac_state
+     * все *__UNTOUCHED параметры заполняются из _current_ac_state
+     **/
+    void _fillSetCommand(bool clrPacket = false, packet_t *pack = nullptr, ac_state_t *cmd = nullptr) {
+        // по умолчанию заполняем исходящий пакет
+        if (pack == nullptr) pack = &_outPacket;
+
+        // очищаем пакет, если это указано
+        if (clrPacket) _clearPacket(pack);
+
+        // заполняем его параметрами из _current_ac_state
+        if (cmd != &_current_ac_state) _fillSetCommand(false, pack, &_current_ac_state);
+
+        // если команда не указана, значит выходим
+        if (cmd == nullptr) return;
+
+        // команда указана, дополнительно внесем в пакет те параметры, которые установлены в команде
+        // присваиваем параметры пакета
+        pack->msec = _millis();
+        pack->header->start_byte = AC_PACKET_START_BYTE;
+        pack->header->wifi = AC_PACKET_ANSWER;  // для исходящего пакета ставим признак ответа
+        pack->header->packet_type = AC_PTYPE_CMD;
+        pack->header->body_length = 0x0F;  // тело команды 15 (0x0F) байт, как у Small status
+        pack->body = &(pack->data[AC_HEADER_SIZE]);
+        pack->body[0] = AC_CMD_SET_PARAMS;  // устанавливаем параметры
+        pack->body[1] = 0x01;               // он всегда 0x01
+        pack->bytesLoaded = AC_HEADER_SIZE + pack->header->body_length + 2;
+
+        // целевая температура кондиционера
+        if (cmd->temp_target_matter) {
+            // устраняем выход за границы диапазона (это ограничение самого кондиционера)
+            cmd->temp_target = _temp_target_normalise(cmd->temp_target);
+            // целая часть температуры
+            pack->body[2] = (pack->body[2] & ~AC_TEMP_TARGET_INT_PART_MASK) | (((uint8_t)(cmd->temp_target) - 8) << 3);
+
+            // дробная часть температуры
+            if (cmd->temp_target - (uint8_t)(cmd->temp_target) > 0) {
+                pack->body[4] = (pack->body[4] | AC_TEMP_TARGET_FRAC_PART_MASK);
+            } else {
+                pack->body[4] = (pack->body[4] & ~AC_TEMP_TARGET_FRAC_PART_MASK);
+            }
+        }
+
+        // ограничение мощности инвертора: задано, если значение не UNTOUCHED
+        // при выключении сбрасывается только бит включения, значение остается таким, какое было у сплита
+        if (cmd->inverter_power_limitation_value != AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED) {
+            pack->body[13] = (pack->body[13] & ~AC_INVERTER_POWER_LIMITATION_ENABLE_MASK) | (cmd->inverter_power_limitation_enable << 7);
+            if (cmd->inverter_power_limitation_enable) {
+                cmd->inverter_power_limitation_value = _power_limitation_value_normalise(cmd->inverter_power_limitation_value);
+                pack->body[13] = (pack->body[13] & ~AC_INVERTER_POWER_LIMITATION_VALUE_MASK) | cmd->inverter_power_limitation_value;
+            }
+        }
+
+        //  обнулить счетчик минут с последней команды
+        // GK: считаю, что так делать не надо. Штатный wifi-модуль не сбрасывает счетчик минут.
+        // pack->body[4] &= ~ AC_MIN_COUNTER_MASK ;
+
+        // вертикальные жалюзи
+        if (cmd->louver.louver_v != AC_LOUVERV_UNTOUCHED) {
+            pack->body[2] = (pack->body[2] & ~AC_LOUVERV_MASK) | cmd->louver.louver_v;
+        }
+
+        // горизонтальные жалюзи
+        if (cmd->louver.louver_h != AC_LOUVERH_UNTOUCHED) {
+            pack->body[3] = (pack->body[3] & ~AC_LOUVERH_MASK) | cmd->louver.louver_h;
+        }
+
+        // скорость вентилятора
+        if (cmd->fanSpeed != AC_FANSPEED_UNTOUCHED) {
+            pack->body[5] = (pack->body[5] & ~AC_FANSPEED_MASK) | cmd->fanSpeed;
+        }
+
+        // спец.режимы вентилятора: TURBO
+        if (cmd->fanTurbo != AC_FANTURBO_UNTOUCHED) {
+            pack->body[6] = (pack->body[6] & ~AC_FANTURBO_MASK) | cmd->fanTurbo;
+        }
+
+        // спец.режимы вентилятора: MUTE
+        if (cmd->fanMute != AC_FANMUTE_UNTOUCHED) {
+            pack->body[6] = (pack->body[6] & ~AC_FANMUTE_MASK) | cmd->fanMute;
+        }
+
+        // режим кондея
+        if (cmd->mode != AC_MODE_UNTOUCHED) {
+            pack->body[7] = (pack->body[7] & ~AC_MODE_MASK) | cmd->mode;
+        }
+        if (cmd->sleep != AC_SLEEP_UNTOUCHED) {
+            pack->body[7] = (pack->body[7] & ~AC_SLEEP_MASK) | cmd->sleep;
+        }
+
+        // питание вкл/выкл
+        if (cmd->power != AC_POWER_UNTOUCHED) {
+            pack->body[10] = (pack->body[10] & ~AC_POWER_MASK) | cmd->power;
+        }
+
+        // просушка
+        if (cmd->clean != AC_CLEAN_UNTOUCHED) {
+            pack->body[10] = (pack->body[10] & ~AC_CLEAN_MASK) | cmd->clean;
+        }
+
+        // ионизатор
+        if (cmd->health != AC_HEALTH_UNTOUCHED) {
+            pack->body[10] = (pack->body[10] & ~AC_HEALTH_MASK) | cmd->health;
+        }
+
+        // какой то флаг ионизатора
+        if (cmd->health_status != AC_HEALTH_STATUS_UNTOUCHED) {
+            pack->body[10] = (pack->body[10] & ~AC_HEALTH_STATUS_MASK) | cmd->health_status;
+        }
+
+        // дисплей
+        if (cmd->display != AC_DISPLAY_UNTOUCHED) {
+            pack->body[12] = (pack->body[12] & ~AC_DISPLAY_MASK) | cmd->display;
+        }
+
+        // антиплесень
+        if (cmd->mildew != AC_MILDEW_UNTOUCHED) {
+            pack->body[12] = (pack->body[12] & ~AC_MILDEW_MASK) | cmd->mildew;
+        }
+
+        // рассчитываем и записываем в пакет CRC
+        pack->crc = (packet_crc_t *)&(pack->data[AC_HEADER_SIZE + pack->header->body_length]);
+        _setCRC16(pack);
+    }
+
+    // запоминает в текущем шаге последовательности отправленный пакет (только его CRC)
+    void _storeSentPacket(packet_t *pack) {
+        _sequence[_sequence_current_step].packet_type = AC_SPT_SENT_PACKET;
+        _sequence[_sequence_current_step].crc = *pack->crc;
+    }
+
+    // отмечает в текущем шаге последовательности полученный пакет
+    void _storeReceivedPacket(packet_t *pack) {
+        _sequence[_sequence_current_step].packet_type = AC_SPT_RECEIVED_PACKET;
+        _sequence[_sequence_current_step].crc = *pack->crc;
+    }
+
+    // отправка запроса на маленький статусный пакет
+    bool sq_requestSmallStatus() {
+        // если исходящий пакет не пуст, то выходим и ждем освобождения
+        if (_outPacket.bytesLoaded > 0) return true;
+
+        _fillStatusSmall(&_outPacket);
+        _storeSentPacket(&_outPacket);
+
+        // Отчитываемся в лог
+        _debugMsg(F("Sequence [step %u]: small status request generated:"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+        _debugPrintPacket(&_outPacket, ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // увеличиваем текущий шаг
+        _sequence_current_step++;
+        return true;
+    }
+
+    // проверка ответа на запрос маленького статусного пакета
+    bool sq_controlSmallStatus() {
+        // если по каким-то причинам нет входящего пакета, значит проверять нам нечего - просто выходим
+        // мусор с линии, собранный в состоянии IDLE, пакетом не является (у него нет CRC) - его тоже не проверяем
+        if ((_inPacket.bytesLoaded == 0) || (_inPacket.crc == nullptr)) return true;
+
+        // Пинги игнорируем
+        if (_inPacket.header->packet_type == AC_PTYPE_PING) return true;
+
+        // отмечаем в последовательности полученный пакет
+        _storeReceivedPacket(&_inPacket);
+
+        // проверяем ответ
+        bool relevant = true;
+        relevant = (relevant && (_inPacket.header->packet_type == AC_PTYPE_INFO));
+        relevant = (relevant && (_inPacket.header->body_length == 0x0F));
+        relevant = (relevant && (_inPacket.body[0] == 0x01));
+        relevant = (relevant && (_inPacket.body[1] == AC_CMD_STATUS_SMALL));
+
+        // если пакет подходит...
+        if (relevant) {
+            // ...значит можно переходить к следующему шагу
+            // так как пакет корректный, то запоминаем время его получения
+            _last_raw_data.last_small_info_msec = _inPacket.msec;
+
+            // отчитываемся в лог и переходим к следующему шагу
+            _debugMsg(F("Sequence [step %u]: correct small status packet received"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+            _sequence_current_step++;
+        } else {
+            // если пакет не подходящий, то отчитываемся в лог...
+            _debugMsg(F("Sequence [step %u]: irrelevant incoming packet"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step);
+            _debugMsg(F("Incoming packet:"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugMsg(F("Sequence packet needed: PACKET_TYPE = %02X, CMD = %02X"), ESPHOME_LOG_LEVEL_WARN, __LINE__, AC_PTYPE_INFO, AC_CMD_STATUS_SMALL);
+            // ...и прерываем последовательность, так как вернем false
+        }
+        return relevant;
+    }
+
+    // отправка запроса на большой статусный пакет
+    bool sq_requestBigStatus() {
+        // если исходящий пакет не пуст, то выходим и ждем освобождения
+        if (_outPacket.bytesLoaded > 0) return true;
+
+        _fillStatusBig(&_outPacket);
+        _storeSentPacket(&_outPacket);
+
+        // Отчитываемся в лог
+        _debugMsg(F("Sequence [step %u]: big status request generated:"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+        _debugPrintPacket(&_outPacket, ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // увеличиваем текущий шаг
+        _sequence_current_step++;
+        return true;
+    }
+
+    // проверка ответа на запрос большого статусного пакета
+    bool sq_controlBigStatus() {
+        // если по каким-то причинам нет входящего пакета, значит проверять нам нечего - просто выходим
+        // мусор с линии, собранный в состоянии IDLE, пакетом не является (у него нет CRC) - его тоже не проверяем
+        if ((_inPacket.bytesLoaded == 0) || (_inPacket.crc == nullptr)) return true;
+
+        // Пинги игнорируем
+        if (_inPacket.header->packet_type == AC_PTYPE_PING) return true;
+
+        // отмечаем в последовательности полученный пакет
+        _storeReceivedPacket(&_inPacket);
+
+        // проверяем ответ
+        bool relevant = true;
+        relevant = (relevant && (_inPacket.header->packet_type == AC_PTYPE_INFO));
+        relevant = (relevant && (_inPacket.header->body_length == 0x18 || _inPacket.header->body_length == 0x19));  // канальник Royal Clima отвечает пакетом длиной 0x19
+        relevant = (relevant && (_inPacket.body[0] == 0x01));
+        relevant = (relevant && (_inPacket.body[1] == AC_CMD_STATUS_BIG));
+
+        // если пакет подходит...
+        if (relevant) {
+            // ...значит можно переходить к следующему шагу
+            // так как пакет корректный, то запоминаем время его получения
+            _last_raw_data.last_big_info_msec = _inPacket.msec;
+
+            // отчитываемся в лог и переходим к следующему шагу
+            _debugMsg(F("Sequence [step %u]: correct big status packet received"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+            _sequence_current_step++;
+        } else {
+            // если пакет не подходящий, то отчитываемся в лог...
+            _debugMsg(F("Sequence [step %u]: irrelevant incoming packet"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step);
+            _debugMsg(F("Incoming packet:"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugMsg(F("Sequence packet needed: PACKET_TYPE = %02X, CMD = %02X"), ESPHOME_LOG_LEVEL_WARN, __LINE__, AC_PTYPE_INFO, AC_CMD_STATUS_BIG);
+            // ...и прерываем последовательность
+        }
+        return relevant;
+    }
+
+    // отправка запроса на выполнение команды
+    bool sq_requestDoCommand() {
+        // если исходящий пакет не пуст, то выходим и ждем освобождения
+        if (_outPacket.bytesLoaded > 0) return true;
+
+        _fillSetCommand(true, &_outPacket, &_sequence[_sequence_current_step].cmd);
+        _storeSentPacket(&_outPacket);
+
+        // Отчитываемся в лог
+        _debugMsg(F("Sequence [step %u]: doCommand request generated:"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+        _debugPrintPacket(&_outPacket, ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // увеличиваем текущий шаг
+        _sequence_current_step++;
+        return true;
+    }
+
+    // проверка ответа на выполнение команды
+    bool sq_controlDoCommand() {
+        // если по каким-то причинам нет входящего пакета, значит проверять нам нечего - просто выходим
+        // мусор с линии, собранный в состоянии IDLE, пакетом не является (у него нет CRC) - его тоже не проверяем
+        if ((_inPacket.bytesLoaded == 0) || (_inPacket.crc == nullptr)) return true;
+
+        // Пинги игнорируем
+        if (_inPacket.header->packet_type == AC_PTYPE_PING) return true;
+
+        // отмечаем в последовательности полученный пакет
+        _storeReceivedPacket(&_inPacket);
+
+        // CRC отправленной команды лежит в предыдущем шаге; без нее сверять ответ не с чем
+        packet_crc_t *sent_crc = nullptr;
+        if ((_sequence_current_step > 0) && (_sequence[_sequence_current_step - 1].packet_type == AC_SPT_SENT_PACKET)) {
+            sent_crc = &_sequence[_sequence_current_step - 1].crc;
+        }
+
+        // проверяем ответ
+        bool relevant = (sent_crc != nullptr);
+        relevant = (relevant && (_inPacket.header->packet_type == AC_PTYPE_INFO));
+        relevant = (relevant && (_inPacket.header->body_length == 0x04));
+        relevant = (relevant && (_inPacket.body[0] == 0x01));
+        relevant = (relevant && (_inPacket.body[1] == AC_CMD_SET_PARAMS));
+        // байты 2 и 3 обычно равны CRC отправленного пакета с командой
+        relevant = (relevant && (_inPacket.body[2] == sent_crc->crc[0]));
+        relevant = (relevant && (_inPacket.body[3] == sent_crc->crc[1]));
+
+        // если пакет подходит, значит можно переходить к следующему шагу
+        if (relevant) {
+            _debugMsg(F("Sequence [step %u]: correct doCommand packet received"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+            // сплит вернул CRC ровно тех байт, что мы отправили, значит команда принята как есть:
+            // применяем ее к состоянию сами, без финального запроса статуса (расхождения поймает следующий опрос)
+            if (_trust_echo && _sequence[_sequence_current_step - 1].func == &AirConCore::sq_requestDoCommand) {
+                _applyCommand(&_current_ac_state, &_sequence[_sequence_current_step - 1].cmd);
+                stateChanged();
+            }
+            _sequence_current_step++;
+        } else {
+            // если пакет не подходящий, то отчитываемся в лог...
+            _debugMsg(F("Sequence [step %u]: irrelevant incoming packet"), ESPHOME_LOG_LEVEL_WARN, __LINE__, _sequence_current_step);
+            _debugMsg(F("Incoming packet:"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugPrintPacket(&_inPacket, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            _debugMsg(F("Sequence packet needed: PACKET_TYPE = %02X, CMD = %02X"), ESPHOME_LOG_LEVEL_WARN, __LINE__, AC_PTYPE_INFO, AC_CMD_SET_PARAMS);
+            // ...и прерываем последовательность
+        }
+        return relevant;
+    }
+
+    // отправка запроса с тестовым пакетом
+    bool sq_requestTestPacket() {
+        // если исходящий пакет не пуст, то выходим и ждем освобождения
+        if (_outPacket.bytesLoaded > 0) return true;
+
+        // тестовый пакет мог и не создаваться
+        if (!_outTestPacket) return false;
+
+        _copyPacket(&_outPacket, _outTestPacket.get());
+        _storeSentPacket(&_outPacket);
+
+        // Отчитываемся в лог
+        _debugMsg(F("Sequence [step %u]: Test Packet request generated:"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, _sequence_current_step);
+        _debugPrintPacket(&_outPacket, ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // увеличиваем текущий шаг
+        _sequence_current_step++;
+        return true;
+    }
+
+    // загружает на выполнение последовательность команд на включение/выключение табло с температурой
+    bool _displaySequence(ac_display dsp = AC_DISPLAY_ON) {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("displaySequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+        if (dsp == AC_DISPLAY_UNTOUCHED) return false;  // выходим, чтобы не тратить время
+
+        // формируем команду
+        ac_command_t cmd;
+        _clearCommand(&cmd);  // не забываем очищать, а то будет мусор
+        cmd.display = dsp;
+        // добавляем команду в последовательность
+        if (!commandSequence(&cmd)) return false;
+
+        _debugMsg(F("displaySequence: loaded (display = %02X)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, dsp);
+        return true;
+    }
+
+
+   public:
+    virtual ~AirConCore() {}
+
+    // инициализация ядра: подключение интерфейсов и приведение всех структур в начальное состояние
+    // если uart равен nullptr, то считается, что железо не подключено, и конечный автомат не работает
+    // clock обязателен
+    void initCore(AirConUart *uart, AirConClock *clock, AirConLogger *logger = nullptr) {
+        _uart = uart;
+        _clock = clock;
+        _logger = logger;
+
+        _clearInPacket();
+        _clearOutPacket();
+        _outTestPacket.reset();
+        _last_raw_data.last_big_info_msec = 0;
+        _last_raw_data.last_small_info_msec = 0;
+
+#if defined(AC_LOOP_PROFILER)
+        _profilerReset();
+#endif
+
+        _setStateMachineState(ACSM_IDLE);
+        _dataMillis = _millis();
+        _hw_initialized = (_uart != nullptr);
+        _has_connection = false;
+        _probe_done = false;
+        _probe_pending = false;
+        _pending = false;
+        _publish_deferred = false;
+        _connected_by_probe = false;
+        _connection_ms = 0;
+        _state_stale = false;
+        _state_live = false;
+        _core_start_ms = _millis();
+        _state_live_ms = 0;
+        _packet_timeout = Constants::AC_PACKET_TIMEOUT_MIN;
+
+        // заполняем структуру состояния начальными значениями
+        _clearCommand((ac_command_t *)&_current_ac_state);
+
+        // очищаем последовательность пакетов
+        _clearSequence();
+
+        // выполнена ли уже стартовая последовательность команд (сбор информации о статусе кондея)
+        _startupSequenceComlete = false;
+    }
+
+    // вызывается ядром для публикации нового состояния кондиционера; реализуется адаптером
+    virtual void stateChanged() = 0;
+
+    // вызывается ядром, когда сплит не подтвердил команду и оптимистичное состояние откачено
+    // сразу после этого ядро вызывает stateChanged() с настоящим состоянием
+    virtual void commandRolledBack() {}
+
+    // вызывается ядром, когда закончилась последовательность с командой установки параметров:
+    // success - сплит команду подтвердил; все команды, загруженные в одну последовательность, отчитываются вместе
+    virtual void commandDone(bool success) {}
+
+    // вызывается ядром после разбора большого пакета статуса, до stateChanged(); сырые температуры уже в _current_ac_state
+    // true - адаптеру нужно опубликовать состояние, даже если сырые значения не изменились (например, сдвинулась статистика)
+    virtual bool telemetryParsed() { return false; }
+
+    // вызывается ядром, когда ограничение мощности задали командой (действия, send_command, лямбды):
+    // limit - новое ограничение, %; AC_MAX_INVERTER_POWER_LIMIT - ограничение выключено
+    virtual void powerLimitationCommanded(uint8_t limit) {}
+
+    // подмена часов, например, на AirConVirtualClock в тестах
+    // менять часы нужно, пока обмен не идет: отметки времени приема и последовательностей взяты по старым часам
+    // отсчет периода опроса статуса начинается заново
+    void set_clock(AirConClock *clock) {
+        _clock = clock;
+        _rx_last_byte_ms = _millis();
+        _dataMillis = _millis();
+        if (!_state_live) _core_start_ms = _millis();
+    }
+    AirConClock *get_clock() { return _clock; }
+
+    // восстановление последнего известного состояния (например, снимка из флеша) до первого ответа сплита
+    // восстанавливается только общая часть команды (режим, температура, вентилятор, шторки...), датчики остаются пустыми
+    // состояние считается устаревшим, пока не придет малый пакет статуса; false - живое состояние уже есть
+    bool restoreState(const ac_save_command_t *snapshot) {
+        if (_state_live) return false;
+        memcpy(&_current_ac_state, snapshot, AC_COMMAND_BASE_SIZE);
+        _state_stale = true;
+        return true;
+    }
+    bool is_state_stale() { return _state_stale; }
+    bool has_live_state() { return _state_live; }
+    // сколько прошло от initCore() до первого малого пакета статуса, мс; 0 - статуса еще не было
+    uint32_t get_first_state_latency() { return _state_live_ms; }
+
+    // один проход основного цикла: шаг конечного автомата и периодический опрос статуса
+    void loopCore() {
+        if (_scheduler != nullptr) {
+            _scheduler->unit_loop(_scheduler_unit);
+            // публикация, отложенная в прошлом проходе
+            if (_publish_deferred) {
+                _publish_deferred = false;
+                stateChanged();
+            }
+        }
+        _doStartupProbe();
+        _doStateMachine();
+        if (_probe_pending && !hasSequence()) _probe_pending = false;
+        _doStatusPolling();
+    }
+
+    // пробный запрос статуса на старте (по умолчанию включен); менять до первого loopCore()
+    void set_startup_probe(bool probe) { _startup_probe = probe; }
+    bool get_startup_probe() { return _startup_probe; }
+    // как и через сколько после initCore() появилась связь со сплитом; 0 мс - связи еще не было
+    bool get_connected_by_probe() { return _connected_by_probe; }
+    // сколько команд из control() не отправлено, потому что они совпадали с текущим состоянием
+    uint32_t get_commands_suppressed() { return _commands_suppressed; }
+
+    // оптимистичная публикация команд (по умолчанию выключена)
+    void set_optimistic(bool optimistic) { _optimistic = optimistic; }
+    bool get_optimistic() { return _optimistic; }
+    // есть ли опубликованная, но еще не подтвержденная сплитом команда
+    bool has_pending_command() { return _pending; }
+    uint32_t get_rollbacks() { return _rollbacks; }
+
+    // доверие эху команды (по умолчанию выключено): на один обмен по линии на каждую команду меньше
+    void set_trust_echo(bool trust_echo) { _trust_echo = trust_echo; }
+    bool get_trust_echo() { return _trust_echo; }
+
+    // подключение к общему планировщику узла; период опроса к этому моменту должен быть уже задан
+    bool set_scheduler(AirConScheduler *scheduler) {
+        _scheduler = nullptr;
+        if (scheduler == nullptr) return true;
+        _scheduler_unit = scheduler->attach(_update_period);
+        if (_scheduler_unit >= AC_SCHEDULER_MAX_UNITS) {
+            _debugMsg(F("Scheduler: no free slots, this unit runs on its own."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        _scheduler = scheduler;
+        return true;
+    }
+    AirConScheduler *get_scheduler() { return _scheduler; }
+    uint8_t get_scheduler_unit() { return _scheduler_unit; }
+
+    // состояние сплита, как его видит ядро, - например, для бюджета мощности узла
+    const ac_state_t &get_current_state() { return _current_ac_state; }
+    bool get_is_inverter() { return _is_inverter; }
+    // когда пришел последний большой пакет статуса, мс; 0 - еще не приходил
+    uint32_t get_big_status_time() { return _last_raw_data.last_big_info_msec; }
+    uint32_t get_connection_latency() { return _connection_ms; }
+
+    void set_period(uint32_t ms) { this->_update_period = ms; }
+    uint32_t get_period() { return this->_update_period; }
+
+    // отчет о памяти, которую занимает ядро одного кондиционера, байт
+    // размеры считаются компилятором для той платформы, под которую идет сборка
+    struct footprint_t {
+        uint32_t core;      // весь объект ядра
+        uint32_t packets;   // входящий и исходящий пакеты
+        uint32_t sequence;  // последовательность команд
+        uint32_t state;     // текущее состояние сплита
+        uint32_t heap;      // выделенное по требованию (тестовый пакет)
+    };
+    footprint_t get_footprint() {
+        footprint_t fp;
+        fp.core = sizeof(AirConCore);
+        fp.packets = sizeof(_inPacket) + sizeof(_outPacket);
+        fp.sequence = sizeof(_sequence);
+        fp.state = sizeof(_current_ac_state);
+        fp.heap = _outTestPacket ? sizeof(packet_t) : 0;
+        return fp;
+    }
+
+    bool get_hw_initialized() { return _hw_initialized; };
+    bool get_has_connection() { return _has_connection; };
+
+    // возвращает, есть ли елементы в последовательности команд
+    bool hasSequence() {
+        return (_sequence[0].item_type != AC_SIT_NONE);
+    }
+
+    // запрос маленького пакета статуса кондиционера
+    bool getStatusSmall() {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("getStatusSmall: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+        // есть ли место на запрос в последовательности команд?
+        if (_getFreeSequenceSpace() < 2) {
+            _debugMsg(F("getStatusSmall: not enough space in command sequence. Sequence steps doesn't loaded."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        /*************************************** getSmallInfo request ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_requestSmallStatus)) {
+            _debugMsg(F("getStatusSmall: getSmallInfo request sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /*************************************** getSmallInfo control ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_controlSmallStatus)) {
+            _debugMsg(F("getStatusSmall: getSmallInfo control sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /**************************************************************************************/
+
+        _debugMsg(F("getStatusSmall: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+        return true;
+    }
+
+    // запрос большого пакета статуса кондиционера
+    bool getStatusBig() {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("getStatusBig: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+        // есть ли место на запрос в последовательности команд?
+        if (_getFreeSequenceSpace() < 2) {
+            _debugMsg(F("getStatusBig: not enough space in command sequence. Sequence steps doesn't loaded."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        /*************************************** getBigInfo request ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_requestBigStatus)) {
+            _debugMsg(F("getStatusBig: getBigInfo request sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /*************************************** getBigInfo control ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_controlBigStatus)) {
+            _debugMsg(F("getStatusBig: getBigInfo control sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /**************************************************************************************/
+
+        _debugMsg(F("getStatusBig: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+        return true;
+    }
+
+    // запрос большого и малого пакетов статуса последовательно
+    bool getStatusBigAndSmall() {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("getStatusBigAndSmall: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        if (!getStatusSmall()) {
+            _debugMsg(F("getStatusBigAndSmall: error with small status sequence."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        if (!getStatusBig()) {
+            _debugMsg(F("getStatusBigAndSmall: error with big status sequence."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        _debugMsg(F("getStatusBigAndSmall: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+        return true;
+    }
+
+    /** стартовая последовательность пакетов
+     *
+     * нужна, чтобы не ждать долго обновления статуса кондиционера
+     * запускаем сразу, как только удалось подключиться к кондиционеру и прошел первый пинг-пакет
+     * возвращаемое значение будет присвоено флагу выполнения последовательности
+     * то есть при возврате false последовательность считается не запущенной и будет вызоваться до тех пор, пока не вернет true
+     **/
+    bool startupSequence() {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("startupSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // по сути на старте надо получить от кондиционера два статуса
+        if (!getStatusBigAndSmall()) {
+            _debugMsg(F("startupSequence: error with big&small status sequence."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        };
+
+        _debugMsg(F("startupSequence: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+        return true;
+    }
+
+    /** загружает на выполнение команду
+     *
+     * стандартная последовательность - это запрос маленького статусного пакета, выполнение команды и повторный запрос
+     * такого же статуса для проверки, что всё включилось, ну и для обновления интерфейсов всяких связанных компонентов
+     **/
+    bool commandSequence(ac_command_t *cmd) {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("commandSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // добавление начального запроса маленького статусного пакета в последовательность команд
+        if (!getStatusSmall()) {
+            _debugMsg(F("commandSequence: error with first small status sequence."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        // есть ли место на запрос в последовательности команд?
+        if (_getFreeSequenceSpace() < 2) {
+            _debugMsg(F("commandSequence: not enough space in command sequence. Sequence steps doesn't loaded."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        /*************************************** set params request ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_requestDoCommand, cmd)) {
+            _debugMsg(F("commandSequence: request sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /*************************************** set params control ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_controlDoCommand)) {
+            _debugMsg(F("commandSequence: control sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /**************************************************************************************/
+
+        // добавление финального запроса маленького статусного пакета в последовательность команд
+        // если эху команды доверяем, состояние обновляется по нему, и запрос не нужен
+        if (!_trust_echo && !getStatusSmall()) {
+            _debugMsg(F("commandSequence: error with last small status sequence."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        _debugMsg(F("commandSequence: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        // в оптимистичном режиме команда публикуется сразу, а сплит ее потом подтверждает или она откатывается
+        if (_optimistic) {
+            if (!_pending) _clearCommand(&_pending_cmd);
+            _applyCommand(&_pending_cmd, cmd);
+            _pending = true;
+            stateChanged();
+        }
+        return true;
+    }
+
+    /** сборка одной команды из нескольких параметров (действие aux_ac.send_command)
+     *
+     * все параметры уходят сплиту одним пакетом установки, вместо отдельной последовательности на каждый.
+     * newCommand() возвращает пустую команду, функции command...() проверяют значение и дописывают его в команду;
+     * если значение не подходит, команда не меняется, и возвращается false
+     **/
+    ac_command_t newCommand() {
+        ac_command_t cmd;
+        _clearCommand(&cmd);  // не забываем очищать, а то будет мусор
+        return cmd;
+    }
+
+    bool commandVLouver(ac_command_t *cmd, const ac_louver_V vLouver) {
+        if (vLouver == AC_LOUVERV_UNTOUCHED) return false;
+        if ((vLouver > AC_LOUVERV_OFF) || (vLouver == 0x06)) return false;  // нет таких команд
+        cmd->louver.louver_v = vLouver;
+        return true;
+    }
+
+    // ограничение мощности; при выключении значение ограничения остается прежним
+    // в команде ограничение считается заданным, если значение не AC_INVERTER_POWER_LIMITATION_VALUE_UNTOUCHED
+    bool commandPowerLimitation(ac_command_t *cmd, bool enable, uint8_t power_limit = Constants::AC_MIN_INVERTER_POWER_LIMIT) {
+        if (!this->_is_inverter) {  // у неинверторных кондиционеров ограничения мощности нет
+            _debugMsg(F("commandPowerLimitation: unsupported for noninverter AC."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        cmd->inverter_power_limitation_enable = enable;
+        cmd->inverter_power_limitation_value = enable ? this->_power_limitation_value_normalise(power_limit)
+                                                      : (this->_current_ac_state.inverter_power_limitation_value & AC_INVERTER_POWER_LIMITATION_VALUE_MASK);
+        powerLimitationCommanded(enable ? cmd->inverter_power_limitation_value : Constants::AC_MAX_INVERTER_POWER_LIMIT);
+        return true;
+    }
+
+    // скорость вентилятора; турбо и тихий режим при выборе скорости выключаются, как с пульта
+    bool commandFanSpeed(ac_command_t *cmd, const ac_fanspeed fanSpeed) {
+        if (fanSpeed == AC_FANSPEED_UNTOUCHED) return false;
+        cmd->fanSpeed = fanSpeed;
+        cmd->fanTurbo = AC_FANTURBO_OFF;
+        cmd->fanMute = AC_FANMUTE_OFF;
+        return true;
+    }
+
+    // TURBO и MUTE взаимоисключающие: включение одного выключает другой
+    bool commandFanTurbo(ac_command_t *cmd, bool on) {
+        cmd->fanTurbo = on ? AC_FANTURBO_ON : AC_FANTURBO_OFF;
+        if (on) cmd->fanMute = AC_FANMUTE_OFF;  // зависимость от fanturbo
+        return true;
+    }
+
+    bool commandFanMute(ac_command_t *cmd, bool on) {
+        cmd->fanMute = on ? AC_FANMUTE_ON : AC_FANMUTE_OFF;
+        if (on) cmd->fanTurbo = AC_FANTURBO_OFF;  // зависимость от fanmute
+        return true;
+    }
+
+    // горизонтальные жалюзи умеют только качаться или стоять
+    bool commandHLouverSwing(ac_command_t *cmd, bool swing) {
+        cmd->louver.louver_h = swing ? AC_LOUVERH_SWING_LEFTRIGHT : AC_LOUVERH_OFF_ALTERNATIVE;
+        return true;
+    }
+
+    // ионизатор включается только у работающего сплита
+    bool commandHealth(ac_command_t *cmd, bool on) {
+        if (!on) {
+            cmd->health = AC_HEALTH_OFF;
+            return true;
+        }
+        if (cmd->power != AC_POWER_ON && _current_ac_state.power != AC_POWER_ON) {
+            _debugMsg(F("HEALTH preset is suitable in POWER_ON mode only."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        cmd->health = AC_HEALTH_ON;
+        // cmd->health_status = AC_HEALTH_STATUS_ON;  // GK: статус кондей сам поднимает
+        cmd->fanTurbo = AC_FANTURBO_OFF;  // зависимость от health
+        cmd->fanMute = AC_FANMUTE_OFF;    // зависимость от health
+        cmd->sleep = AC_SLEEP_OFF;        // для логики пресетов
+
+        if (cmd->mode == AC_MODE_COOL ||
+            cmd->mode == AC_MODE_HEAT ||
+            cmd->mode == AC_MODE_AUTO ||
+            _current_ac_state.mode == AC_MODE_COOL ||
+            _current_ac_state.mode == AC_MODE_HEAT ||
+            _current_ac_state.mode == AC_MODE_AUTO) {
+            cmd->fanSpeed = AC_FANSPEED_AUTO;  // зависимость от health
+        } else if (cmd->mode == AC_MODE_FAN ||
+                   _current_ac_state.mode == AC_MODE_FAN) {
+            cmd->fanSpeed = AC_FANSPEED_MEDIUM;  // зависимость от health
+        }
+        return true;
+    }
+
+    // режим очистки включается (или должен включаться) только при AC_POWER_OFF
+    // TODO: надо отдебажить выключение этого режима
+    bool commandClean(ac_command_t *cmd, bool on) {
+        if (!on) {
+            cmd->clean = AC_CLEAN_OFF;
+            return true;
+        }
+        if (cmd->power != AC_POWER_OFF && _current_ac_state.power != AC_POWER_OFF) {
+            _debugMsg(F("CLEAN preset is suitable in POWER_OFF mode only."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        cmd->clean = AC_CLEAN_ON;
+        cmd->mildew = AC_MILDEW_OFF;  // для логики пресетов
+        return true;
+    }
+
+    // "Антиплесень"; в каких режимах сплит ее штатно принимает, пока не ясно, поэтому не проверяем
+    bool commandMildew(ac_command_t *cmd, bool on) {
+        cmd->mildew = on ? AC_MILDEW_ON : AC_MILDEW_OFF;
+        if (on) cmd->clean = AC_CLEAN_OFF;  // для логики пресетов
+        return true;
+    }
+
+    // загружает на выполнение последовательность команд на включение/выключение
+    bool powerSequence(ac_power pwr = AC_POWER_ON) {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("powerSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+        if (pwr == AC_POWER_UNTOUCHED) return false;  // выходим, чтобы не тратить время
+
+        // формируем команду
+        ac_command_t cmd;
+        _clearCommand(&cmd);  // не забываем очищать, а то будет мусор
+        cmd.power = pwr;
+        // добавляем команду в последовательность
+        if (!commandSequence(&cmd)) return false;
+
+        _debugMsg(F("powerSequence: loaded (power = %02X)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, pwr);
+        return true;
+    }
+
+    // отправляет сплиту заданный набор байт
+    // Перед отправкой:
+    //      устанавливает первый байт в 0xBB
+    //      проверяет, чтобы длина тела пакета в заголовке не превышала длину буфера
+    //      рассчитывает и записывает в конец пакета CRC
+    bool sendTestPacket(const std::vector<uint8_t> &data) {
+        if (data.size() == 0) {
+            _debugMsg(F("sendTestPacket: no data to send."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+        // if (data.size() > AC_BUFFER_SIZE) return false;
+
+        // нет смысла в отправке, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("sendTestPacket: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // память под тестовый пакет выделяется только при первой отправке
+        if (!_outTestPacket) _outTestPacket.reset(new packet_t);
+        packet_t *test = _outTestPacket.get();
+
+        // очищаем пакет
+        _clearPacket(test);
+
+        // копируем данные в пакет
+        uint8_t i = 0;
+        for (uint8_t n : data) {
+            // всё, что не влезет в буфер - игнорируем
+            if (i >= AC_BUFFER_SIZE) {
+                _debugMsg(F("sendTestPacket: buffer size =  %02d, data length = %02d. Extra data was omitted."), ESPHOME_LOG_LEVEL_ERROR, __LINE__, AC_BUFFER_SIZE, data.size());
+                break;
+            }
+            // что влезает - копируем в буфер
+            test->data[i] = n;
+            i++;
+        }
+
+        // на всякий случай указываем правильные некоторые байты:
+        //    - установим стартовый байт
+        test->header->start_byte = AC_PACKET_START_BYTE;
+        //    - установим длину тела, если она больше возможной для нашего буфера
+        if (test->header->body_length > (AC_BUFFER_SIZE - AC_HEADER_SIZE - 2)) test->header->body_length = AC_BUFFER_SIZE - AC_HEADER_SIZE - 2;
+
+        test->msec = _millis();
+        test->body = &(test->data[AC_HEADER_SIZE]);
+        test->bytesLoaded = AC_HEADER_SIZE + test->header->body_length + 2;
+
+        // рассчитываем и записываем в пакет CRC
+        test->crc = (packet_crc_t *)&(test->data[AC_HEADER_SIZE + test->header->body_length]);
+        _setCRC16(test);
+
+        _debugMsg(F("sendTestPacket: test packet loaded:"), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+        _debugPrintPacket(test, ESPHOME_LOG_LEVEL_WARN, __LINE__);
+
+        // ниже блок добавления отправки пакета в последовательность команд
+        //*****************************************************************
+        // есть ли место на запрос в последовательности команд?
+        if (_getFreeSequenceSpace() < 1) {
+            _debugMsg(F("sendTestPacket: not enough space in command sequence. Sequence steps doesn't loaded."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+
+        /*************************************** sendTestPacket request ***********************************************/
+        if (!_addSequenceFuncStep(&AirConCore::sq_requestTestPacket)) {
+            _debugMsg(F("sendTestPacket: sendTestPacket request sequence step fail."), ESPHOME_LOG_LEVEL_WARN, __LINE__);
+            return false;
+        }
+        /**************************************************************************************/
+
+        _debugMsg(F("sendTestPacket: loaded to sequence"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__);
+
+        return true;
+    }
+
+    // выключает ограничение мощности сплита
+    bool powerLimitationOffSequence() {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("powerLimitationOffSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // формируем команду
+        ac_command_t cmd = newCommand();
+        if (!commandPowerLimitation(&cmd, false)) return false;  // если кондиционер не инверторный, то выходим
+        // добавляем команду в последовательность
+        if (!commandSequence(&cmd)) return false;
+
+        _debugMsg(F("powerLimitationOffSequence: loaded (value = %02X)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, cmd.inverter_power_limitation_enable);
+        return true;
+    }
+
+    // включает ограничение мощности сплита на нужный уровень
+    bool powerLimitationOnSequence(uint8_t power_limit = Constants::AC_MIN_INVERTER_POWER_LIMIT) {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("powerLimitationOnSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // формируем команду
+        ac_command_t cmd = newCommand();
+        if (!commandPowerLimitation(&cmd, true, power_limit)) return false;  // если кондиционер не инверторный, то выходим
+        // добавляем команду в последовательность
+        if (!commandSequence(&cmd)) return false;
+
+        _debugMsg(F("powerLimitationOnSequence: loaded (power limit = %02X)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, cmd.inverter_power_limitation_value);
+        return true;
+    }
+
+
+    // конвертирует состояние жалюзи из кодов сплита в коды для фронтенда
+    ac_vlouver_frontend AUXvlouverToVlouverFrontend(const ac_louver_V vLouver) {
+        switch (vLouver) {
+            case AC_LOUVERV_SWING_UPDOWN:
+                return AC_VLOUVER_FRONTEND_SWING;
+
+            case AC_LOUVERV_OFF:
+                return AC_VLOUVER_FRONTEND_STOP;
+
+            case AC_LOUVERV_SWING_TOP:
+                return AC_VLOUVER_FRONTEND_TOP;
+
+            case AC_LOUVERV_SWING_MIDDLE_ABOVE:
+                return AC_VLOUVER_FRONTEND_MIDDLE_ABOVE;
+
+            case AC_LOUVERV_SWING_MIDDLE:
+                return AC_VLOUVER_FRONTEND_MIDDLE;
+
+            case AC_LOUVERV_SWING_MIDDLE_BELOW:
+                return AC_VLOUVER_FRONTEND_MIDDLE_BELOW;
+
+            case AC_LOUVERV_SWING_BOTTOM:
+                return AC_VLOUVER_FRONTEND_BOTTOM;
+
+            default:
+                _debugMsg(F("AUXvlouverToVlouverFrontend: unknown vertical louver state = %u"), ESPHOME_LOG_LEVEL_DEBUG, __LINE__, _current_ac_state.louver.louver_v);
+                return AC_VLOUVER_FRONTEND_STOP;
+        }
+    }
+
+    // возвращает текущее положение шторок в кодах для фронтенда
+    ac_vlouver_frontend getCurrentVlouverFrontendState() {
+        return AUXvlouverToVlouverFrontend(_current_ac_state.louver.louver_v);
+    }
+
+    // конвертирует состояние жалюзи из кодов для фронтенда в коды сплита
+    ac_louver_V vlouverFrontendToAUXvlouver(const ac_vlouver_frontend vLouver) {
+        switch (vLouver) {
+            case AC_VLOUVER_FRONTEND_SWING:
+                return AC_LOUVERV_SWING_UPDOWN;
+
+            case AC_VLOUVER_FRONTEND_STOP:
+                return AC_LOUVERV_OFF;
+
+            case AC_VLOUVER_FRONTEND_TOP:
+                return AC_LOUVERV_SWING_TOP;
+
+            case AC_VLOUVER_FRONTEND_MIDDLE_ABOVE:
+                return AC_LOUVERV_SWING_MIDDLE_ABOVE;
+
+            case AC_VLOUVER_FRONTEND_MIDDLE:
+                return AC_LOUVERV_SWING_MIDDLE;
+
+            case AC_VLOUVER_FRONTEND_MIDDLE_BELOW:
+                return AC_LOUVERV_SWING_MIDDLE_BELOW;
+
+            case AC_VLOUVER_FRONTEND_BOTTOM:
+                return AC_LOUVERV_SWING_BOTTOM;
+
+            default:
+                _debugMsg(F("vlouverFrontendToAUXvlouver: unknown vertical louver state = %u"), ESPHOME_LOG_LEVEL_DEBUG, __LINE__, _current_ac_state.louver.louver_v);
+                return AC_LOUVERV_OFF;
+        }
+    }
+
+    // устанавливает жалюзи в нужное положение по коду сплита
+    bool setVLouverSequence(const ac_louver_V vLouver) {
+        // нет смысла в последовательности, если нет коннекта с кондиционером
+        if (!get_has_connection()) {
+            _debugMsg(F("setVLouverSequence: no pings from HVAC. It seems like no AC connected."), ESPHOME_LOG_LEVEL_ERROR, __LINE__);
+            return false;
+        }
+
+        // формируем команду
+        ac_command_t cmd = newCommand();
+        if (!commandVLouver(&cmd, vLouver)) return false;  // нет таких команд
+        // добавляем команду в последовательность
+        if (!commandSequence(&cmd)) return false;
+
+        _debugMsg(F("setVLouverSequence: loaded (vLouver = %02X)"), ESPHOME_LOG_LEVEL_VERBOSE, __LINE__, vLouver);
+        return true;
+    }
+
+    // устанавливает жалюзи в нужное положение по коду для фронтенда
+    bool setVLouverFrontendSequence(const ac_vlouver_frontend vLouver) {
+        return setVLouverSequence(vlouverFrontendToAUXvlouver(vLouver));
+    }
+
+    // установка жалюзи в определенные положения
+    bool setVLouverSwingSequence() { return setVLouverSequence(AC_LOUVERV_SWING_UPDOWN); }
+    bool setVLouverStopSequence() { return setVLouverSequence(AC_LOUVERV_OFF); }
+    bool setVLouverTopSequence() { return setVLouverSequence(AC_LOUVERV_SWING_TOP); }
+    bool setVLouverMiddleAboveSequence() { return setVLouverSequence(AC_LOUVERV_SWING_MIDDLE_ABOVE); }
+    bool setVLouverMiddleSequence() { return setVLouverSequence(AC_LOUVERV_SWING_MIDDLE); }
+    bool setVLouverMiddleBelowSequence() { return setVLouverSequence(AC_LOUVERV_SWING_MIDDLE_BELOW); }
+    bool setVLouverBottomSequence() { return setVLouverSequence(AC_LOUVERV_SWING_BOTTOM); }
+
+    void set_packet_timeout(uint32_t ms) {
+        if (ms < Constants::AC_PACKET_TIMEOUT_MIN) ms = Constants::AC_PACKET_TIMEOUT_MIN;
+        if (ms > Constants::AC_PACKET_TIMEOUT_MAX) ms = Constants::AC_PACKET_TIMEOUT_MIN;
+        this->_packet_timeout = ms;
+    }
+    uint32_t get_packet_timeout() { return this->_packet_timeout; }
+
+    void set_tx_guard_time(uint32_t ms) {
+        if (ms > Constants::AC_TX_GUARD_TIME_MAX) ms = Constants::AC_TX_GUARD_TIME_MAX;
+        this->_tx_guard_time = ms;
+    }
+    uint32_t get_tx_guard_time() { return this->_tx_guard_time; }
+
+};
+
+//*****************************************************************************
+// Бюджет мощности узла: несколько инверторных кондиционеров делят общий лимит потребления.
+// Потребление блока - мощность инвертора из большого статуса (%) от паспортной мощности блока.
+// Кондиционерам раздаются ограничения мощности так, чтобы в сумме не выйти за лимит;
+// первыми мощность получают те, кому дальше всего до целевой температуры, а уже добравшиеся до цели
+// получают на удержание то, что осталось.
+// Примененным считается ограничение, которое сплит сам сообщил в малом статусе.
+// Ограничение, заданное пользователем командой, - потолок для кондиционера: бюджет может его снизить, но не поднять.
+#define AC_POWER_BUDGET_MAX_UNITS 8
+
+class AirConPowerBudget {
+   public:
+    // регистрация кондиционера; rated_power - потребление блока на 100% мощности инвертора, Вт
+    // возвращает номер кондиционера в бюджете или AC_POWER_BUDGET_MAX_UNITS, если мест нет
+    uint8_t attach(AirConCore *unit, uint16_t rated_power, uint32_t hold_time = Constants::AC_POWER_BUDGET_HOLD_TIME) {
+        if ((unit == nullptr) || (rated_power == 0) || (_count >= AC_POWER_BUDGET_MAX_UNITS)) return AC_POWER_BUDGET_MAX_UNITS;
+        _units[_count] = {unit, rated_power, hold_time, 0, false, 0, Constants::AC_MAX_INVERTER_POWER_LIMIT};
+        return _count++;
+    }
+
+    // ограничение, заданное пользователем (из powerLimitationCommanded() адаптера), %; 100 - без ограничения
+    void set_user_limit(uint8_t unit, uint8_t limit) {
+        if (unit >= _count) return;
+        if (limit > Constants::AC_MAX_INVERTER_POWER_LIMIT) limit = Constants::AC_MAX_INVERTER_POWER_LIMIT;
+        _units[unit].ceiling = limit;
+    }
+    uint8_t get_user_limit(uint8_t unit) { return (unit < _count) ? _units[unit].ceiling : Constants::AC_MAX_INVERTER_POWER_LIMIT; }
+
+    // лимит потребления узла, Вт; если кондиционеры задают разные лимиты, действует наименьший
+    void set_max_power(uint16_t watts) {
+        if (watts == 0) return;
+        if ((_max_power == 0) || (watts < _max_power)) _max_power = watts;
+    }
+    uint16_t get_max_power() { return _max_power; }
+
+    // вызывается из loop() кондиционеров узла, пересчет идет не чаще AC_POWER_BUDGET_INTERVAL
+    void loop(uint32_t now) {
+        if ((_count == 0) || (_max_power == 0)) return;
+        if (_started && (now - _last_run < Constants::AC_POWER_BUDGET_INTERVAL)) return;
+        _started = true;
+        _last_run = now;
+        rebalance(now);
+    }
+
+    // пересчет ограничений и отправка изменившихся
+    void rebalance(uint32_t now) {
+        uint16_t alloc[AC_POWER_BUDGET_MAX_UNITS] = {};
+        float demand[AC_POWER_BUDGET_MAX_UNITS] = {};
+        uint8_t order[AC_POWER_BUDGET_MAX_UNITS];
+        uint8_t active = 0;
+        uint32_t total = 0;
+        uint32_t full = 0;
+        uint32_t floor_sum = 0;
+
+        // пока кто-то из подключенных кондиционеров еще не прислал оба статуса, раскладка была бы неполной
+        for (uint8_t i = 0; i < _count; i++) {
+            if (_units[i].core->get_has_connection() && !_isKnown(_units[i])) return;
+        }
+
+        for (uint8_t i = 0; i < _count; i++) {
+            unit_t &u = _units[i];
+            uint32_t draw = _draw(u);
+            total += draw;
+            if (!_isActive(u)) {
+                u.limit = 0;
+                continue;
+            }
+            demand[i] = _demand(u.core->get_current_state());
+            // сортировка вставкой: сначала те, кому дальше до цели
+            uint8_t k = active++;
+            while ((k > 0) && (demand[order[k - 1]] < demand[i])) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = i;
+            alloc[i] = _floor(u);
+            full += _cap(u);
+            floor_sum += alloc[i];
+        }
+
+        _total_power = total;
+        if (total > _peak_power) _peak_power = total;
+        if (total > _max_power) _over_budget++;
+        if (active == 0) return;
+
+        if (full <= _max_power) {
+            // все влезают в лимит и на полной мощности, ограничения не нужны
+            for (uint8_t k = 0; k < active; k++) alloc[order[k]] = _cap(_units[order[k]]);
+        } else {
+            uint32_t left = (floor_sum < _max_power) ? _max_power - floor_sum : 0;
+            // сначала тем, кто еще не добрался до цели, до полной мощности: кому дальше до цели, тому первому
+            for (uint8_t k = 0; k < active; k++) {
+                uint8_t i = order[k];
+                if (demand[i] < Constants::AC_POWER_BUDGET_DEADBAND) continue;
+                left -= _grant(alloc[i], _cap(_units[i]), left);
+            }
+            // из остатка добравшимся до цели - текущее потребление с запасом, чтобы они ее удержали
+            for (uint8_t k = 0; k < active; k++) {
+                uint8_t i = order[k];
+                if (demand[i] >= Constants::AC_POWER_BUDGET_DEADBAND) continue;
+                unit_t &u = _units[i];
+                uint32_t want = _draw(u) + (uint32_t)u.rated_power * Constants::AC_POWER_BUDGET_HEADROOM / 100;
+                if (want > _cap(u)) want = _cap(u);
+                left -= _grant(alloc[i], want, left);
+            }
+            // что и после этого осталось - им же до полной мощности
+            for (uint8_t k = 0; k < active; k++) {
+                uint8_t i = order[k];
+                left -= _grant(alloc[i], _cap(_units[i]), left);
+            }
+        }
+
+        for (uint8_t k = 0; k < active; k++) {
+            uint8_t i = order[k];
+            _apply(_units[i], _toLimit(_units[i], alloc[i]), now);
+        }
+    }
+
+    uint8_t get_units() { return _count; }
+    // потребление узла по последним большим статусам и его максимум, Вт
+    uint32_t get_total_power() { return _total_power; }
+    uint32_t get_peak_power() { return _peak_power; }
+    // назначенное кондиционеру ограничение, %: 100 - без ограничения, 0 - кондиционер сейчас в бюджете не участвует
+    uint8_t get_limit(uint8_t unit) { return (unit < _count) ? _units[unit].limit : 0; }
+    // сколько раз ограничения отправлялись сплитам, сколько изменений ждали паузы между ними,
+    // на скольких пересчетах потребление было выше лимита
+    uint32_t get_changes() { return _changes; }
+    uint32_t get_held() { return _held; }
+    uint32_t get_over_budget() { return _over_budget; }
+
+   private:
+    struct unit_t {
+        AirConCore *core;
+        uint16_t rated_power;
+        uint32_t hold_time;
+        uint32_t last_change_ms;
+        bool changed;   // ограничение уже менялось, пауза отсчитывается от last_change_ms
+        uint8_t limit;
+        uint8_t ceiling;  // ограничение пользователя, %; выше него бюджет ограничение не поднимает
+    };
+
+    static bool _isKnown(unit_t &u) { return u.core->has_live_state() && (u.core->get_big_status_time() != 0); }
+
+    // в бюджете участвуют включенные инверторы, состояние которых уже известно; вентилятору компрессор не нужен
+    static bool _isActive(unit_t &u) {
+        const ac_state_t &state = u.core->get_current_state();
+        return _isKnown(u) && u.core->get_is_inverter() && (state.power == AC_POWER_ON) && (state.mode != AC_MODE_FAN);
+    }
+
+    // сколько градусов осталось до цели в сторону, в которую работает режим
+    static float _demand(const ac_state_t &state) {
+        float diff = state.temp_ambient - state.temp_target;
+        switch (state.mode) {
+            case AC_MODE_COOL:
+            case AC_MODE_DRY:
+                return (diff > 0) ? diff : 0;
+            case AC_MODE_HEAT:
+                return (diff < 0) ? -diff : 0;
+            default:
+                return (diff < 0) ? -diff : diff;
+        }
+    }
+
+    static uint32_t _draw(unit_t &u) {
+        if (!_isKnown(u) || !u.core->get_is_inverter()) return 0;
+        return (uint32_t)u.core->get_current_state().inverter_power * u.rated_power / 100;
+    }
+
+    // больше этого кондиционеру не нужно: паспортная мощность под ограничением пользователя
+    static uint32_t _cap(unit_t &u) {
+        return (uint32_t)u.rated_power * u.ceiling / 100;
+    }
+
+    // меньше минимального ограничения сплит не принимает, столько кондиционер получает в любом случае
+    static uint16_t _floor(unit_t &u) {
+        return (uint32_t)u.rated_power * Constants::AC_MIN_INVERTER_POWER_LIMIT / 100;
+    }
+
+    // добавляет к выделенной мощности до want, но не больше left; возвращает, сколько добавлено
+    static uint32_t _grant(uint16_t &alloc, uint32_t want, uint32_t left) {
+        if (want <= alloc) return 0;
+        uint32_t extra = want - alloc;
+        if (extra > left) extra = left;
+        alloc += extra;
+        return extra;
+    }
+
+    // мощность в Вт в ограничение в %, вниз до шага
+    static uint8_t _toLimit(unit_t &u, uint32_t watts) {
+        uint32_t limit = watts * 100 / u.rated_power;
+        limit -= limit % Constants::AC_POWER_BUDGET_STEP;
+        if (limit < Constants::AC_MIN_INVERTER_POWER_LIMIT) limit = Constants::AC_MIN_INVERTER_POWER_LIMIT;
+        if (limit > Constants::AC_MAX_INVERTER_POWER_LIMIT) limit = Constants::AC_MAX_INVERTER_POWER_LIMIT;
+        return limit;
+    }
+
+    void _apply(unit_t &u, uint8_t limit, uint32_t now) {
+        if (limit > u.ceiling) limit = u.ceiling;
+        u.limit = limit;
+        const ac_state_t &state = u.core->get_current_state();
+        uint8_t applied = state.inverter_power_limitation_enable ? state.inverter_power_limitation_value : Constants::AC_MAX_INVERTER_POWER_LIMIT;
+        if (limit == applied) return;
+        // снижение, когда узел уже вышел за лимит, паузу не ждет: лимит важнее тишины на линии
+        bool urgent = (limit < applied) && (_total_power > _max_power);
+        if (u.changed && !urgent && (now - u.last_change_ms < u.hold_time)) {
+            _held++;
+            return;
+        }
+        if (u.core->hasSequence()) return;  // кондиционер занят обменом, попробуем на следующем пересчете
+        // команду собираем сами, мимо commandPowerLimitation(): иначе свое ограничение бюджет принял бы за пользовательское
+        // на 100% ограничение выключается, как его и оставил пользователь
+        ac_command_t cmd = u.core->newCommand();
+        cmd.inverter_power_limitation_enable = (limit < Constants::AC_MAX_INVERTER_POWER_LIMIT);
+        cmd.inverter_power_limitation_value = cmd.inverter_power_limitation_enable ? limit : (state.inverter_power_limitation_value & AC_INVERTER_POWER_LIMITATION_VALUE_MASK);
+        if (!u.core->commandSequence(&cmd)) return;
+        u.changed = true;
+        u.last_change_ms = now;
+        _changes++;
+    }
+
+    unit_t _units[AC_POWER_BUDGET_MAX_UNITS] = {};
+    uint8_t _count = 0;
+    uint16_t _max_power = 0;
+    bool _started = false;
+    uint32_t _last_run = 0;
+    uint32_t _total_power = 0;
+    uint32_t _peak_power = 0;
+    uint32_t _changes = 0;
+    uint32_t _held = 0;
+    uint32_t _over_budget = 0;
+};
+
+}  // namespace aux_ac
+}  // namespace esphome
@@ -8,24 +8,39 @@ from esphome.const import (
     CONF_CUSTOM_FAN_MODES,
     CONF_CUSTOM_PRESETS,
     CONF_DATA,
+    CONF_ENERGY,
+    CONF_FAN_MODE,
     CONF_ID,
     CONF_INTERNAL,
+    CONF_INTERVAL,
+    CONF_MODE,
+    CONF_OPTIMISTIC,
     CONF_PERIOD,
     CONF_POSITION,
+    CONF_POWER,
+    CONF_SIZE,
     CONF_SUPPORTED_MODES,
     CONF_SUPPORTED_SWING_MODES,
     CONF_SUPPORTED_PRESETS,
+    CONF_TARGET_TEMPERATURE,
     CONF_TIMEOUT,
+    CONF_TRIGGER_ID,
     CONF_UART_ID,
     UNIT_CELSIUS,
+    UNIT_KILOWATT_HOURS,
     UNIT_PERCENT,
+    UNIT_WATT,
     ICON_POWER,
     ICON_THERMOMETER,
     DEVICE_CLASS_TEMPERATURE,
+    DEVICE_CLASS_ENERGY,
+    DEVICE_CLASS_POWER,
     DEVICE_CLASS_POWER_FACTOR,
     STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
 )
 from esphome.components.climate import (
+    ClimateFanMode,
     ClimateMode,
     ClimatePreset,
     ClimateSwingMode,
@@ -38,6 +53,52 @@ DEPENDENCIES = ["climate", "uart"]
 AUTO_LOAD = ["sensor", "binary_sensor", "text_sensor"]
 
 CONF_SHOW_ACTION = "show_action"
+CONF_TX_GUARD_TIME = "tx_guard_time"
+CONF_ON_COMMAND_ROLLBACK = "on_command_rollback"
+CONF_ON_COMMAND_DONE = "on_command_done"
+CONF_TRUST_ECHO = "trust_echo"
+CONF_SHARED_SCHEDULER = "shared_scheduler"
+CONF_POWER_BUDGET = "power_budget"
+CONF_RATED_POWER = "rated_power"
+CONF_MAX_POWER = "max_power"
+CONF_HOLD_TIME = "hold_time"
+CONF_ENERGY_METER = "energy_meter"
+CONF_CURVE = "curve"
+CONF_FAN_POWER = "fan_power"
+CONF_STANDBY_POWER = "standby_power"
+CONF_SAVE_INTERVAL = "save_interval"
+CONF_HISTORY = "history"
+CONF_CHUNK_SIZE = "chunk_size"
+CONF_ON_CHUNK = "on_chunk"
+AC_HISTORY_BLOCK_SIZE = 256
+CONF_STATISTICS = "statistics"
+CONF_STATISTIC = "statistic"
+CONF_WINDOW = "window"
+CONF_EMA_ALPHA = "ema_alpha"
+CONF_ACTION = "action"
+AC_STATS_WINDOW_MAX = 15
+# значения статистики (ac_stats_value) и каналы температур (ac_stats_channel)
+STATS_VALUES = {
+    "raw": 0,
+    "ema": 1,
+    "median": 2,
+    "min": 3,
+    "max": 4,
+}
+AC_STATS_AMBIENT = 0
+AC_STATS_OUTDOOR = 1
+AC_STATS_INBOUND = 2
+AC_STATS_OUTBOUND = 3
+AC_STATS_COMPRESSOR = 4
+AC_ENERGY_CURVE_POINTS = 8
+# коды реальной скорости вентилятора (ac_realFan)
+ENERGY_FAN_SPEEDS = {
+    "mute": 0x01,
+    "low": 0x02,
+    "medium": 0x04,
+    "high": 0x06,
+    "turbo": 0x07,
+}
 
 CONF_INDOOR_TEMPERATURE = "indoor_temperature"
 CONF_OUTDOOR_TEMPERATURE = "outdoor_temperature"
@@ -69,6 +130,16 @@ CONF_VLOUVER_STATE = "vlouver_state"
 ICON_VLOUVER_STATE = "mdi:compare-vertical"
 
 CONF_LIMIT = "limit"
+CONF_VLOUVER = "vlouver"
+CONF_DISPLAY = "display"
+CONF_POWER_LIMIT = "power_limit"
+CONF_FAN_TURBO = "fan_turbo"
+CONF_FAN_MUTE = "fan_mute"
+CONF_HLOUVER_SWING = "hlouver_swing"
+CONF_HEALTH = "health"
+CONF_CLEAN = "clean"
+CONF_MILDEW = "mildew"
+CONF_UNITS = "units"
 CONF_INVERTER_POWER_LIMIT_VALUE = "inverter_power_limit_value"
 ICON_INVERTER_POWER_LIMIT_VALUE = "mdi:meter-electric-outline"
 CONF_INVERTER_POWER_LIMIT_STATE = "inverter_power_limit_state"
@@ -117,6 +188,26 @@ AirConPowerLimitationOffAction = aux_ac_ns.class_(
 AirConPowerLimitationOnAction = aux_ac_ns.class_(
     "AirConPowerLimitationOnAction", automation.Action
 )
+AirConSendCommandAction = aux_ac_ns.class_(
+    "AirConSendCommandAction", automation.Action
+)
+AirConGroupCommandAction = aux_ac_ns.class_(
+    "AirConGroupCommandAction", automation.Action
+)
+AirConHistoryDumpAction = aux_ac_ns.class_(
+    "AirConHistoryDumpAction", automation.Action
+)
+
+# Triggers
+AirConCommandRollbackTrigger = aux_ac_ns.class_(
+    "AirConCommandRollbackTrigger", automation.Trigger.template()
+)
+AirConCommandDoneTrigger = aux_ac_ns.class_(
+    "AirConCommandDoneTrigger", automation.Trigger.template(cg.bool_)
+)
+AirConHistoryChunkTrigger = aux_ac_ns.class_(
+    "AirConHistoryChunkTrigger", automation.Trigger.template(cg.std_string, cg.bool_)
+)
 
 
 AC_PACKET_TIMEOUT_MIN = 150
@@ -129,6 +220,17 @@ def validate_packet_timeout(value):
     raise cv.Invalid(f"Timeout should be in range: {minV}..{maxV}.")
 
 
+AC_TX_GUARD_TIME_DEFAULT = 10
+AC_TX_GUARD_TIME_MAX = 100
+def validate_tx_guard_time(value):
+    maxV = AC_TX_GUARD_TIME_MAX
+    if value in range(0, maxV+1):
+        return cv.Schema(cv.uint32_t)(value)
+    raise cv.Invalid(f"TX guard time should be in range: 0..{maxV}.")
+
+
+AC_GROUP_MAX_UNITS = 8
+
 AC_POWER_LIMIT_MIN = 30
 AC_POWER_LIMIT_MAX = 100
 def validate_power_limit_range(value):
@@ -185,6 +287,76 @@ def output_info(config):
     return config
 
 
+def validate_energy_curve(value):
+    percents = [point[CONF_INVERTER_POWER] for point in value]
+    if len(set(percents)) != len(percents):
+        raise cv.Invalid("Each inverter_power value may appear in the curve only once")
+    return value
+
+
+ENERGY_WATTS = cv.All(cv.power, cv.Range(min=0, max=65535))
+
+ENERGY_METER_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_CURVE): cv.All(
+            cv.ensure_list(
+                cv.Schema(
+                    {
+                        cv.Required(CONF_INVERTER_POWER): cv.int_range(min=0, max=100),
+                        cv.Required(CONF_POWER): ENERGY_WATTS,
+                    }
+                )
+            ),
+            cv.Length(min=1, max=AC_ENERGY_CURVE_POINTS),
+            validate_energy_curve,
+        ),
+        cv.Optional(CONF_FAN_POWER, default={}): cv.Schema(
+            {cv.Optional(speed): ENERGY_WATTS for speed in ENERGY_FAN_SPEEDS}
+        ),
+        cv.Optional(CONF_STANDBY_POWER, default="0W"): ENERGY_WATTS,
+        cv.Optional(CONF_SAVE_INTERVAL, default="10min"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_POWER): sensor.sensor_schema(
+            unit_of_measurement=UNIT_WATT,
+            icon=ICON_POWER,
+            accuracy_decimals=0,
+            device_class=DEVICE_CLASS_POWER,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(CONF_ENERGY): sensor.sensor_schema(
+            unit_of_measurement=UNIT_KILOWATT_HOURS,
+            icon=ICON_POWER,
+            accuracy_decimals=3,
+            device_class=DEVICE_CLASS_ENERGY,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+        ),
+    }
+)
+
+STATISTICS_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_WINDOW, default=5): cv.int_range(min=1, max=AC_STATS_WINDOW_MAX),
+        cv.Optional(CONF_EMA_ALPHA, default=0.3): cv.float_range(min=0.01, max=1.0),
+        cv.Optional(CONF_ACTION, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
+    }
+)
+
+# кольцо истории делится на блоки по 256 байт, блоков нужно хотя бы два
+HISTORY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_SIZE, default=4096): cv.int_range(
+            min=2 * AC_HISTORY_BLOCK_SIZE, max=32768
+        ),
+        cv.Optional(CONF_INTERVAL, default="0s"): cv.positive_time_period_seconds,
+        cv.Optional(CONF_CHUNK_SIZE, default=16): cv.int_range(min=1, max=64),
+        cv.Optional(CONF_ON_CHUNK): automation.validate_automation(
+            {
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(AirConHistoryChunkTrigger),
+            }
+        ),
+    }
+)
+
+
 CONFIG_SCHEMA = cv.All(
     climate.CLIMATE_SCHEMA.extend(
         {
@@ -193,6 +365,30 @@ CONFIG_SCHEMA = cv.All(
             cv.Optional(CONF_SHOW_ACTION, default="true"): cv.boolean,
             cv.Optional(CONF_DISPLAY_INVERTED, default="false"): cv.boolean,
             cv.Optional(CONF_TIMEOUT, default=AC_PACKET_TIMEOUT_MIN): validate_packet_timeout,
+            cv.Optional(CONF_TX_GUARD_TIME, default=AC_TX_GUARD_TIME_DEFAULT): validate_tx_guard_time,
+            cv.Optional(CONF_OPTIMISTIC, default="false"): cv.boolean,
+            cv.Optional(CONF_TRUST_ECHO, default="false"): cv.boolean,
+            cv.Optional(CONF_SHARED_SCHEDULER, default="true"): cv.boolean,
+            cv.Optional(CONF_POWER_BUDGET): cv.Schema(
+                {
+                    cv.Required(CONF_RATED_POWER): cv.All(cv.power, cv.Range(min=1, max=65535)),
+                    cv.Required(CONF_MAX_POWER): cv.All(cv.power, cv.Range(min=1, max=65535)),
+                    cv.Optional(CONF_HOLD_TIME, default="60s"): cv.positive_time_period_milliseconds,
+                }
+            ),
+            cv.Optional(CONF_ENERGY_METER): ENERGY_METER_SCHEMA,
+            cv.Optional(CONF_HISTORY): HISTORY_SCHEMA,
+            cv.Optional(CONF_STATISTICS, default={}): STATISTICS_SCHEMA,
+            cv.Optional(CONF_ON_COMMAND_ROLLBACK): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(AirConCommandRollbackTrigger),
+                }
+            ),
+            cv.Optional(CONF_ON_COMMAND_DONE): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(AirConCommandDoneTrigger),
+                }
+            ),
             
             cv.Optional(CONF_INVERTER_POWER_DEPRICATED): cv.invalid(
                 "The name of sensor was changed in v.0.2.9 from 'invertor_power' to 'inverter_power'. Update your config please."
@@ -218,6 +414,7 @@ CONFIG_SCHEMA = cv.All(
             ).extend(
                 {
                     cv.Optional(CONF_INTERNAL, default="true"): cv.boolean,
+                    cv.Optional(CONF_STATISTIC, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
                 }
             ),
             cv.Optional(CONF_OUTDOOR_TEMPERATURE): sensor.sensor_schema(
@@ -229,6 +426,7 @@ CONFIG_SCHEMA = cv.All(
             ).extend(
                 {
                     cv.Optional(CONF_INTERNAL, default="true"): cv.boolean,
+                    cv.Optional(CONF_STATISTIC, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
                 }
             ),
             cv.Optional(CONF_INBOUND_TEMPERATURE): sensor.sensor_schema(
@@ -240,6 +438,7 @@ CONFIG_SCHEMA = cv.All(
             ).extend(
                 {
                     cv.Optional(CONF_INTERNAL, default="true"): cv.boolean,
+                    cv.Optional(CONF_STATISTIC, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
                 }
             ),
             cv.Optional(CONF_OUTBOUND_TEMPERATURE): sensor.sensor_schema(
@@ -251,6 +450,7 @@ CONFIG_SCHEMA = cv.All(
             ).extend(
                 {
                     cv.Optional(CONF_INTERNAL, default="true"): cv.boolean,
+                    cv.Optional(CONF_STATISTIC, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
                 }
             ),
             cv.Optional(CONF_COMPRESSOR_TEMPERATURE): sensor.sensor_schema(
@@ -262,6 +462,7 @@ CONFIG_SCHEMA = cv.All(
             ).extend(
                 {
                     cv.Optional(CONF_INTERNAL, default="true"): cv.boolean,
+                    cv.Optional(CONF_STATISTIC, default="raw"): cv.one_of(*STATS_VALUES, lower=True),
                 }
             ),
             cv.Optional(CONF_VLOUVER_STATE): sensor.sensor_schema(
@@ -340,26 +541,31 @@ async def to_code(config):
         conf = config[CONF_INDOOR_TEMPERATURE]
         sens = await sensor.new_sensor(conf)
         cg.add(var.set_indoor_temperature_sensor(sens))
+        cg.add(var.set_stats_output(AC_STATS_AMBIENT, STATS_VALUES[conf[CONF_STATISTIC]]))
 
     if CONF_OUTDOOR_TEMPERATURE in config:
         conf = config[CONF_OUTDOOR_TEMPERATURE]
         sens = await sensor.new_sensor(conf)
         cg.add(var.set_outdoor_temperature_sensor(sens))
+        cg.add(var.set_stats_output(AC_STATS_OUTDOOR, STATS_VALUES[conf[CONF_STATISTIC]]))
 
     if CONF_OUTBOUND_TEMPERATURE in config:
         conf = config[CONF_OUTBOUND_TEMPERATURE]
         sens = await sensor.new_sensor(conf)
         cg.add(var.set_outbound_temperature_sensor(sens))
+        cg.add(var.set_stats_output(AC_STATS_OUTBOUND, STATS_VALUES[conf[CONF_STATISTIC]]))
 
     if CONF_INBOUND_TEMPERATURE in config:
         conf = config[CONF_INBOUND_TEMPERATURE]
         sens = await sensor.new_sensor(conf)
         cg.add(var.set_inbound_temperature_sensor(sens))
+        cg.add(var.set_stats_output(AC_STATS_INBOUND, STATS_VALUES[conf[CONF_STATISTIC]]))
 
     if CONF_COMPRESSOR_TEMPERATURE in config:
         conf = config[CONF_COMPRESSOR_TEMPERATURE]
         sens = await sensor.new_sensor(conf)
         cg.add(var.set_compressor_temperature_sensor(sens))
+        cg.add(var.set_stats_output(AC_STATS_COMPRESSOR, STATS_VALUES[conf[CONF_STATISTIC]]))
 
     if CONF_VLOUVER_STATE in config:
         conf = config[CONF_VLOUVER_STATE]
@@ -400,6 +606,57 @@ async def to_code(config):
     cg.add(var.set_show_action(config[CONF_SHOW_ACTION]))
     cg.add(var.set_display_inverted(config[CONF_DISPLAY_INVERTED]))
     cg.add(var.set_packet_timeout(config[CONF_TIMEOUT]))
+    cg.add(var.set_tx_guard_time(config[CONF_TX_GUARD_TIME]))
+    cg.add(var.set_optimistic(config[CONF_OPTIMISTIC]))
+    cg.add(var.set_trust_echo(config[CONF_TRUST_ECHO]))
+    cg.add(var.set_shared_scheduler(config[CONF_SHARED_SCHEDULER]))
+    if CONF_ENERGY_METER in config:
+        conf = config[CONF_ENERGY_METER]
+        for point in conf[CONF_CURVE]:
+            cg.add(var.add_energy_curve_point(point[CONF_INVERTER_POWER], int(point[CONF_POWER])))
+        for speed, watts in conf[CONF_FAN_POWER].items():
+            cg.add(var.set_energy_fan_power(ENERGY_FAN_SPEEDS[speed], int(watts)))
+        cg.add(var.set_energy_standby_power(int(conf[CONF_STANDBY_POWER])))
+        cg.add(var.set_energy_save_interval(conf[CONF_SAVE_INTERVAL].total_milliseconds))
+        if CONF_POWER in conf:
+            sens = await sensor.new_sensor(conf[CONF_POWER])
+            cg.add(var.set_estimated_power_sensor(sens))
+        if CONF_ENERGY in conf:
+            sens = await sensor.new_sensor(conf[CONF_ENERGY])
+            cg.add(var.set_estimated_energy_sensor(sens))
+    conf = config[CONF_STATISTICS]
+    cg.add(var.set_stats_window(conf[CONF_WINDOW]))
+    cg.add(var.set_stats_ema_alpha(conf[CONF_EMA_ALPHA]))
+    cg.add(var.set_stats_action_value(STATS_VALUES[conf[CONF_ACTION]]))
+    if CONF_HISTORY in config:
+        conf = config[CONF_HISTORY]
+        cg.add(
+            var.set_history(
+                conf[CONF_SIZE],
+                conf[CONF_INTERVAL].total_seconds,
+                conf[CONF_CHUNK_SIZE],
+            )
+        )
+        for trig_conf in conf.get(CONF_ON_CHUNK, []):
+            trigger = cg.new_Pvariable(trig_conf[CONF_TRIGGER_ID], var)
+            await automation.build_automation(
+                trigger, [(cg.std_string, "chunk"), (cg.bool_, "last")], trig_conf
+            )
+    if CONF_POWER_BUDGET in config:
+        conf = config[CONF_POWER_BUDGET]
+        cg.add(
+            var.set_power_budget(
+                int(conf[CONF_RATED_POWER]),
+                int(conf[CONF_MAX_POWER]),
+                conf[CONF_HOLD_TIME].total_milliseconds,
+            )
+        )
+    for conf in config.get(CONF_ON_COMMAND_ROLLBACK, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [], conf)
+    for conf in config.get(CONF_ON_COMMAND_DONE, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(cg.bool_, "success")], conf)
     if CONF_SUPPORTED_MODES in config:
         cg.add(var.set_supported_modes(config[CONF_SUPPORTED_MODES]))
     if CONF_SUPPORTED_SWING_MODES in config:
@@ -434,6 +691,21 @@ async def display_on_to_code(config, action_id, template_arg, args):
     return cg.new_Pvariable(action_id, template_arg, paren)
 
 
+# выгрузка истории телеметрии; куски CSV приходят в триггер on_chunk из секции history
+HISTORY_DUMP_ACTION_SCHEMA = maybe_simple_id(
+    {
+        cv.Required(CONF_ID): cv.use_id(AirCon),
+    }
+)
+
+@automation.register_action(
+    "aux_ac.history_dump", AirConHistoryDumpAction, HISTORY_DUMP_ACTION_SCHEMA
+)
+async def history_dump_to_code(config, action_id, template_arg, args):
+    paren = await cg.get_variable(config[CONF_ID])
+    return cg.new_Pvariable(action_id, template_arg, paren)
+
+
 
 VLOUVER_ACTION_SCHEMA = maybe_simple_id(
     {
@@ -545,6 +817,136 @@ async def power_limit_on_to_code(config, action_id, template_arg, args):
 
 
 
+# любой набор параметров одной командой сплиту; power_limit: 0 выключает ограничение мощности
+def validate_send_command_power_limit(value):
+    value = cv.int_(value)
+    if value == 0:
+        return value
+    return validate_power_limit_range(value)
+
+
+# режимы и скорости, которые понимает control(); OFF выключает сплит
+SEND_COMMAND_MODES = {
+    "OFF": ClimateMode.CLIMATE_MODE_OFF,
+    **ALLOWED_CLIMATE_MODES,
+}
+SEND_COMMAND_FAN_MODES = {
+    "AUTO": ClimateFanMode.CLIMATE_FAN_AUTO,
+    "LOW": ClimateFanMode.CLIMATE_FAN_LOW,
+    "MEDIUM": ClimateFanMode.CLIMATE_FAN_MEDIUM,
+    "HIGH": ClimateFanMode.CLIMATE_FAN_HIGH,
+}
+
+SEND_COMMAND_FIELDS = {
+    cv.Optional(CONF_MODE): cv.templatable(cv.enum(SEND_COMMAND_MODES, upper=True)),
+    cv.Optional(CONF_POWER): cv.templatable(cv.boolean),
+    cv.Optional(CONF_TARGET_TEMPERATURE): cv.templatable(cv.temperature),
+    cv.Optional(CONF_FAN_MODE): cv.templatable(cv.enum(SEND_COMMAND_FAN_MODES, upper=True)),
+    cv.Optional(CONF_FAN_TURBO): cv.templatable(cv.boolean),
+    cv.Optional(CONF_FAN_MUTE): cv.templatable(cv.boolean),
+    cv.Optional(CONF_VLOUVER): cv.templatable(cv.int_range(0, 6)),
+    cv.Optional(CONF_HLOUVER_SWING): cv.templatable(cv.boolean),
+    cv.Optional(CONF_HEALTH): cv.templatable(cv.boolean),
+    cv.Optional(CONF_CLEAN): cv.templatable(cv.boolean),
+    cv.Optional(CONF_MILDEW): cv.templatable(cv.boolean),
+    cv.Optional(CONF_DISPLAY): cv.templatable(cv.boolean),
+    cv.Optional(CONF_POWER_LIMIT): cv.templatable(validate_send_command_power_limit),
+}
+
+validate_send_command_fields = cv.has_at_least_one_key(
+    CONF_MODE, CONF_POWER, CONF_TARGET_TEMPERATURE, CONF_FAN_MODE, CONF_FAN_TURBO, CONF_FAN_MUTE,
+    CONF_VLOUVER, CONF_HLOUVER_SWING, CONF_HEALTH, CONF_CLEAN, CONF_MILDEW, CONF_DISPLAY, CONF_POWER_LIMIT
+)
+
+
+async def send_command_fields_to_code(var, config, args):
+    if CONF_MODE in config:
+        template_ = await cg.templatable(config[CONF_MODE], args, ClimateMode)
+        cg.add(var.set_mode(template_))
+    if CONF_POWER in config:
+        template_ = await cg.templatable(config[CONF_POWER], args, bool)
+        cg.add(var.set_power(template_))
+    if CONF_TARGET_TEMPERATURE in config:
+        template_ = await cg.templatable(config[CONF_TARGET_TEMPERATURE], args, float)
+        cg.add(var.set_target_temperature(template_))
+    if CONF_FAN_MODE in config:
+        template_ = await cg.templatable(config[CONF_FAN_MODE], args, ClimateFanMode)
+        cg.add(var.set_fan_mode(template_))
+    if CONF_FAN_TURBO in config:
+        template_ = await cg.templatable(config[CONF_FAN_TURBO], args, bool)
+        cg.add(var.set_fan_turbo(template_))
+    if CONF_FAN_MUTE in config:
+        template_ = await cg.templatable(config[CONF_FAN_MUTE], args, bool)
+        cg.add(var.set_fan_mute(template_))
+    if CONF_VLOUVER in config:
+        template_ = await cg.templatable(config[CONF_VLOUVER], args, cg.uint8)
+        cg.add(var.set_vlouver(template_))
+    if CONF_HLOUVER_SWING in config:
+        template_ = await cg.templatable(config[CONF_HLOUVER_SWING], args, bool)
+        cg.add(var.set_hlouver_swing(template_))
+    if CONF_HEALTH in config:
+        template_ = await cg.templatable(config[CONF_HEALTH], args, bool)
+        cg.add(var.set_health(template_))
+    if CONF_CLEAN in config:
+        template_ = await cg.templatable(config[CONF_CLEAN], args, bool)
+        cg.add(var.set_clean(template_))
+    if CONF_MILDEW in config:
+        template_ = await cg.templatable(config[CONF_MILDEW], args, bool)
+        cg.add(var.set_mildew(template_))
+    if CONF_DISPLAY in config:
+        template_ = await cg.templatable(config[CONF_DISPLAY], args, bool)
+        cg.add(var.set_display(template_))
+    if CONF_POWER_LIMIT in config:
+        template_ = await cg.templatable(config[CONF_POWER_LIMIT], args, cg.uint8)
+        cg.add(var.set_power_limit(template_))
+
+
+SEND_COMMAND_ACTION_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Required(CONF_ID): cv.use_id(AirCon),
+            **SEND_COMMAND_FIELDS,
+        }
+    ),
+    validate_send_command_fields,
+)
+
+@automation.register_action(
+    "aux_ac.send_command", AirConSendCommandAction, SEND_COMMAND_ACTION_SCHEMA
+)
+async def send_command_to_code(config, action_id, template_arg, args):
+    paren = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, paren)
+    await send_command_fields_to_code(var, config, args)
+    return var
+
+
+
+# одна команда нескольким кондиционерам узла, обмены идут одновременно
+GROUP_COMMAND_ACTION_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Required(CONF_UNITS): cv.All(
+                cv.ensure_list(cv.use_id(AirCon)), cv.Length(min=1, max=AC_GROUP_MAX_UNITS)
+            ),
+            **SEND_COMMAND_FIELDS,
+        }
+    ),
+    validate_send_command_fields,
+)
+
+@automation.register_action(
+    "aux_ac.group_command", AirConGroupCommandAction, GROUP_COMMAND_ACTION_SCHEMA
+)
+async def group_command_to_code(config, action_id, template_arg, args):
+    units = []
+    for unit in config[CONF_UNITS]:
+        units.append(await cg.get_variable(unit))
+    var = cg.new_Pvariable(action_id, template_arg, units)
+    await send_command_fields_to_code(var, config, args)
+    return var
+
+
 # *********************************************************************************************************
 # ВАЖНО! Только для инженеров!
 # Вызывайте метод aux_ac.send_packet только если понимаете, что делаете! Он не проверяет данные, а передаёт
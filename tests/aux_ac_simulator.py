@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+# Виртуальный внутренний блок AUX: говорит по протоколу AUX через псевдотерминал (pty) Linux.
+# Рассылает ping раз в 3 секунды, отвечает на запросы 0x11 / 0x21 / 0x01, иногда присылает
+# периодический пакет 0x2C. Умеет добавлять задержку, джиттер, порчу и потерю пакетов.
+#
+# Запуск в режиме сервера (путь к pty печатается в консоль, его можно отдать любой программе, открывающей порт):
+#   python3 tests/aux_ac_simulator.py --link /tmp/aux_ac_tty
+# Запуск теста: симулятор создает pty, запускает команду (вместо {port} подставляется путь к pty)
+# и работает, пока команда не завершится; код возврата - код команды:
+#   python3 tests/aux_ac_simulator.py --latency 20 --jitter 10 --run "./aux_ac_pty_driver {port}"
+import argparse
+import json
+import os
+import pty
+import random
+import select
+import shlex
+import subprocess
+import sys
+import time
+import tty
+
+PACKET_START_BYTE = 0xBB
+HEADER_SIZE = 8
+
+PTYPE_PING = 0x01
+PTYPE_CMD = 0x06
+PTYPE_INFO = 0x07
+
+CMD_SET_PARAMS = 0x01
+CMD_STATUS_SMALL = 0x11
+CMD_STATUS_BIG = 0x21
+CMD_STATUS_PERIODIC = 0x2C
+
+
+def createParser():
+    parser = argparse.ArgumentParser(
+        description='''Virtual AUX indoor unit. Speaks the AUX protocol over a Linux pseudo-terminal.''',
+        add_help=False)
+    parent_group = parser.add_argument_group(title='Params')
+    parent_group.add_argument('--help', '-h', action='help', help='show this help message and exit')
+    parent_group.add_argument('--link', help='create a symlink to the pty with this name')
+    parent_group.add_argument('--run', help='command to test; {port} is replaced with the pty path')
+    parent_group.add_argument('--baud', type=int, default=4800, help='emulated line speed for outgoing bytes (default 4800, 0 = no pacing)')
+    parent_group.add_argument('--frame-bits', type=int, default=11, help='bits per byte on the line, 8E1 = start + 8 data + parity + stop (default 11)')
+    parent_group.add_argument('--ping-interval', type=float, default=3.0, help='seconds between pings (default 3)')
+    parent_group.add_argument('--broadcast-interval', type=float, default=600.0, help='seconds between unsolicited 0x2C packets (default 600, 0 = off)')
+    parent_group.add_argument('--answer-delay', type=float, default=8.0, help='base answer delay in ms, as a real split (default 8)')
+    parent_group.add_argument('--latency', type=float, default=0.0, help='extra answer latency in ms (default 0)')
+    parent_group.add_argument('--jitter', type=float, default=0.0, help='random extra latency 0..N ms (default 0)')
+    parent_group.add_argument('--corrupt', type=float, default=0.0, help='probability to corrupt one byte of a sent packet (default 0)')
+    parent_group.add_argument('--drop', type=float, default=0.0, help='probability to not answer a request (default 0)')
+    parent_group.add_argument('--royal-clima', action='store_true', help='answer with 0x19-long big status as Royal Clima ducted units do')
+    parent_group.add_argument('--seed', type=int, help='random seed for reproducible runs')
+    parent_group.add_argument('--verbose', '-v', action='store_true', help='print every packet')
+    return parser
+
+
+def crc16(data):
+    """CRC пакета AUX: сумма 16-битных слов big-endian, перенос и инверсия."""
+    if len(data) % 2:
+        data = data + bytes(1)
+    crc = 0
+    for i in range(0, len(data), 2):
+        crc += (data[i] << 8) + data[i + 1]
+    crc = (crc >> 16) + (crc & 0xFFFF)
+    return ~crc & 0xFFFF
+
+
+def make_packet(packet_type, body):
+    packet = bytes([PACKET_START_BYTE, 0x00, packet_type, 0x00, 0x00, 0x00, len(body), 0x00]) + bytes(body)
+    crc = crc16(packet)
+    return packet + bytes([crc >> 8, crc & 0xFF])
+
+
+def hexstr(data):
+    return ' '.join('%02X' % b for b in data)
+
+
+class Split:
+    """Состояние внутреннего блока: тело малого статуса хранится как есть, команды его меняют."""
+
+    def __init__(self, royal_clima):
+        # 24.5 градуса, жалюзи стоп, охлаждение, авто-скорость, выключен
+        self.small = bytearray([0x01, CMD_STATUS_SMALL, (16 << 3) | 0x07, 0xE0, 0x80, 0xA0, 0x00, 0x20,
+                                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00])
+        self.big_length = 0x19 if royal_clima else 0x18
+        self.ambient = 27.0
+        self.outdoor = 31
+        self.last_update = time.monotonic()
+
+    def power(self):
+        return bool(self.small[10] & 0x20)
+
+    def target(self):
+        return 8 + (self.small[2] >> 3) + (0.5 if self.small[4] & 0x80 else 0.0)
+
+    def update(self):
+        # комнатная температура медленно тянется к целевой, если сплит работает, и к уличной, если нет
+        now = time.monotonic()
+        dt = now - self.last_update
+        self.last_update = now
+        goal = self.target() if self.power() else self.outdoor
+        self.ambient += (goal - self.ambient) * min(1.0, dt / 300.0)
+
+    def apply(self, body):
+        # команда 0x01 несет тот же набор байт, что и малый статус
+        self.small[2:15] = body[2:15]
+
+    def big(self, cmd=CMD_STATUS_BIG):
+        self.update()
+        body = bytearray(self.big_length)
+        body[0] = 0x01
+        body[1] = cmd
+        body[2] = 0x20  # инвертор
+        power = self.power()
+        mode = self.small[7] & 0xE0
+        body[3] = (mode | 0x01) if power else 0x00
+        body[5] = 0x02 if power else 0x00
+        body[7] = 0x20 + int(self.ambient)
+        body[9] = 0x20 + int(self.ambient) - (8 if power else 0)
+        body[12] = 0x20 + self.outdoor
+        body[13] = 0x20 + self.outdoor + (6 if power else 0)
+        body[14] = 0x20 + (62 if power else self.outdoor)
+        body[16] = min(100, int(abs(self.ambient - self.target()) * 15)) if power else 0
+        body[23] = int((self.ambient - int(self.ambient)) * 10) & 0x0F
+        return body
+
+
+class Simulator:
+    def __init__(self, args, fd):
+        self.args = args
+        self.fd = fd
+        self.split = Split(args.royal_clima)
+        self.rx = bytearray()
+        self.outbox = []  # (время отправки, пакет)
+        self.stats = {'pings': 0, 'ping_answers': 0, 'requests': 0, 'commands': 0, 'broadcasts': 0,
+                      'crc_errors': 0, 'dropped': 0, 'corrupted': 0, 'answer_latency_ms': []}
+        self.byte_time = float(args.frame_bits) / args.baud if args.baud else 0.0
+
+    def log(self, text):
+        if self.args.verbose:
+            print('[sim %9.3f] %s' % (time.monotonic(), text), flush=True)
+
+    def schedule(self, packet, delay_ms):
+        self.outbox.append((time.monotonic() + delay_ms / 1000.0, packet))
+        self.outbox.sort(key=lambda item: item[0])
+
+    def answer_delay(self):
+        return self.args.answer_delay + self.args.latency + random.uniform(0, self.args.jitter)
+
+    def send(self, packet):
+        if random.random() < self.args.corrupt:
+            packet = bytearray(packet)
+            packet[random.randrange(1, len(packet))] ^= 1 << random.randrange(8)
+            self.stats['corrupted'] += 1
+        self.log('=> ' + hexstr(packet))
+        try:
+            if self.byte_time:
+                for b in packet:
+                    os.write(self.fd, bytes([b]))
+                    time.sleep(self.byte_time)
+            else:
+                os.write(self.fd, packet)
+        except OSError:
+            pass  # вторая сторона pty закрыта
+
+    def handle(self, packet):
+        self.log('<= ' + hexstr(packet))
+        packet_type = packet[2]
+        body = packet[HEADER_SIZE:-2]
+
+        if packet_type == PTYPE_PING:
+            self.stats['ping_answers'] += 1
+            return
+        if packet_type != PTYPE_CMD or len(body) < 2:
+            return
+
+        self.stats['requests'] += 1
+        if random.random() < self.args.drop:
+            self.stats['dropped'] += 1
+            return
+
+        delay = self.answer_delay()
+        self.stats['answer_latency_ms'].append(delay)
+        # pty отдает пакет сразу, а по настоящей линии он шел бы len * byte_time; отвечаем после его "окончания"
+        delay += len(packet) * self.byte_time * 1000.0
+        if body[0] == CMD_STATUS_SMALL:
+            self.schedule(make_packet(PTYPE_INFO, self.split.small), delay)
+        elif body[0] == CMD_STATUS_BIG:
+            self.schedule(make_packet(PTYPE_INFO, self.split.big()), delay)
+        elif body[0] == CMD_SET_PARAMS and len(body) >= 15:
+            self.stats['commands'] += 1
+            self.split.apply(body)
+            self.schedule(make_packet(PTYPE_INFO, [0x01, CMD_SET_PARAMS, packet[-2], packet[-1]]), delay)
+
+    def parse(self):
+        while True:
+            start = self.rx.find(PACKET_START_BYTE)
+            if start < 0:
+                self.rx.clear()
+                return
+            del self.rx[:start]
+            if len(self.rx) < HEADER_SIZE:
+                return
+            length = HEADER_SIZE + self.rx[6] + 2
+            if len(self.rx) < length:
+                return
+            packet = bytes(self.rx[:length])
+            if crc16(packet[:-2]) != (packet[-2] << 8) | packet[-1]:
+                self.stats['crc_errors'] += 1
+                self.log('CRC error: ' + hexstr(packet))
+                del self.rx[:1]
+                continue
+            del self.rx[:length]
+            self.handle(packet)
+
+    def step(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if ready:
+            try:
+                data = os.read(self.fd, 256)
+            except OSError:
+                data = b''
+            self.rx.extend(data)
+            self.parse()
+        now = time.monotonic()
+        while self.outbox and self.outbox[0][0] <= now:
+            self.send(self.outbox.pop(0)[1])
+
+    def serve(self, until=None):
+        next_ping = time.monotonic() + 0.5
+        interval = self.args.broadcast_interval
+        next_broadcast = time.monotonic() + interval if interval > 0 else None
+        while until is None or until():
+            now = time.monotonic()
+            if now >= next_ping:
+                self.stats['pings'] += 1
+                self.schedule(make_packet(PTYPE_PING, []), 0)
+                next_ping += self.args.ping_interval
+            if next_broadcast is not None and now >= next_broadcast:
+                self.stats['broadcasts'] += 1
+                self.schedule(make_packet(PTYPE_INFO, self.split.big(CMD_STATUS_PERIODIC)), 0)
+                next_broadcast += interval
+            self.step(0.002)
+
+    def report(self):
+        latency = self.stats.pop('answer_latency_ms')
+        if latency:
+            self.stats['answer_latency_ms'] = {'min': round(min(latency), 1), 'avg': round(sum(latency) / len(latency), 1),
+                                               'max': round(max(latency), 1)}
+        print('simulator: ' + json.dumps(self.stats), flush=True)
+
+
+def main():
+    args = createParser().parse_args()
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    port = os.ttyname(slave)
+    if args.link:
+        if os.path.lexists(args.link):
+            os.unlink(args.link)
+        os.symlink(port, args.link)
+        port = args.link
+    print('simulator: AUX indoor unit on %s' % port, flush=True)
+
+    sim = Simulator(args, master)
+    code = 0
+    try:
+        if args.run:
+            proc = subprocess.Popen(shlex.split(args.run.replace('{port}', port)))
+            sim.serve(until=lambda: proc.poll() is None)
+            code = proc.returncode
+        else:
+            sim.serve()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sim.report()
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+    return code
+
+
+if __name__ == '__main__':
+    sys.exit(main())
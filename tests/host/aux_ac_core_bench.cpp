@@ -0,0 +1,147 @@
+// Микробенчмарки горячих путей протокольного ядра aux_ac (Google Benchmark)
+// Базовые результаты лежат в benchmark_baseline.json, сравнение - compare_benchmarks.py
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include "host_hal.h"
+
+using namespace aux_ac_host;
+
+namespace {
+
+// пакеты от сплита в том виде, как они идут по линии
+const std::vector<uint8_t> SMALL_STATUS = {0xBB, 0x00, 0x07, 0x00, 0x00, 0x00, 0x0F, 0x00, 0x01, 0x11, 0x87, 0xE0, 0x80,
+                                           0xA0, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x05, 0x4D};
+const std::vector<uint8_t> BIG_STATUS = {0xBB, 0x00, 0x07, 0x00, 0x00, 0x00, 0x18, 0x00, 0x01, 0x21, 0x20, 0x21,
+                                         0x00, 0x02, 0x00, 0x3B, 0x00, 0x33, 0x00, 0x00, 0x3F, 0x45, 0x5E, 0x00,
+                                         0x52, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x15, 0x02};
+// канальник Royal Clima: большой статус длиной 0x19, 35 байт на пакет
+const std::vector<uint8_t> ROYAL_CLIMA_BIG_STATUS = {0xBB, 0x00, 0x07, 0x00, 0x00, 0x00, 0x19, 0x00, 0x01, 0x21, 0x20, 0x21,
+                                                     0x00, 0x02, 0x00, 0x3B, 0x00, 0x33, 0x00, 0x00, 0x3F, 0x45, 0x5E, 0x00,
+                                                     0x52, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x14, 0x02};
+const std::vector<uint8_t> PING = {0xBB, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0xFF};
+
+// лог, который ничего не выводит: форматирование строк остается, вывод - нет
+class NullLogger : public AirConLogger {
+   public:
+    void logv(uint8_t, unsigned int, const char *, va_list) override {}
+};
+
+class BenchAirCon : public HostAirCon {
+   public:
+    NullLogger null_logger;
+
+    BenchAirCon() {
+        initCore(&uart, &clock, &null_logger);
+        set_tx_guard_time(0);
+    }
+
+    // кладет готовый пакет во входной буфер так же, как это делает приемник
+    void loadInPacket(const std::vector<uint8_t> &data) {
+        memcpy(_inPacket.data, data.data(), data.size());
+        _inPacket.bytesLoaded = data.size();
+        _inPacket.crc = (packet_crc_t *)&(_inPacket.data[AC_HEADER_SIZE + _inPacket.header->body_length]);
+        _inPacket.body = (_inPacket.header->body_length > 0) ? &(_inPacket.data[AC_HEADER_SIZE]) : nullptr;
+    }
+};
+
+void BM_CRC16(benchmark::State &state, const std::vector<uint8_t> &packet) {
+    BenchAirCon ac;
+    std::vector<uint8_t> data(packet.begin(), packet.end() - 2);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ac._CRC16(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK_CAPTURE(BM_CRC16, ping, PING);
+BENCHMARK_CAPTURE(BM_CRC16, small_status, SMALL_STATUS);
+BENCHMARK_CAPTURE(BM_CRC16, royal_clima_big_status, ROYAL_CLIMA_BIG_STATUS);
+
+// прием потока байт: поиск стартового байта, заголовок, тело, CRC и разбор
+void BM_Framing(benchmark::State &state) {
+    BenchAirCon ac;
+    std::vector<uint8_t> stream = {0x00, 0x5A};  // мусор на линии перед пакетами
+    stream.insert(stream.end(), SMALL_STATUS.begin(), SMALL_STATUS.end());
+    stream.insert(stream.end(), BIG_STATUS.begin(), BIG_STATUS.end());
+    stream.insert(stream.end(), ROYAL_CLIMA_BIG_STATUS.begin(), ROYAL_CLIMA_BIG_STATUS.end());
+    for (auto _ : state) {
+        ac.uart.push(stream);
+        while (!ac.uart.rx.empty() || ac._ac_state != ACSM_IDLE) ac.run(1);
+    }
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+BENCHMARK(BM_Framing);
+
+void BM_Decode(benchmark::State &state, const std::vector<uint8_t> &packet) {
+    BenchAirCon ac;
+    for (auto _ : state) {
+        ac.loadInPacket(packet);
+        ac._doParsingPacket();
+    }
+}
+BENCHMARK_CAPTURE(BM_Decode, small_status, SMALL_STATUS);
+BENCHMARK_CAPTURE(BM_Decode, big_status, BIG_STATUS);
+BENCHMARK_CAPTURE(BM_Decode, royal_clima_big_status, ROYAL_CLIMA_BIG_STATUS);
+
+void BM_FillSetCommand(benchmark::State &state) {
+    BenchAirCon ac;
+    ac.loadInPacket(SMALL_STATUS);
+    ac._doParsingPacket();
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.power = AC_POWER_ON;
+    cmd.mode = AC_MODE_HEAT;
+    cmd.fanSpeed = AC_FANSPEED_LOW;
+    cmd.temp_target = 22.5;
+    cmd.temp_target_matter = true;
+    for (auto _ : state) {
+        ac._fillSetCommand(true, nullptr, &cmd);
+        benchmark::DoNotOptimize(ac._outPacket.data);
+    }
+}
+BENCHMARK(BM_FillSetCommand);
+
+void BM_DebugPrintPacket(benchmark::State &state, const std::vector<uint8_t> &packet) {
+    BenchAirCon ac;
+    ac.loadInPacket(packet);
+    for (auto _ : state) {
+        ac._debugPrintPacket(&ac._inPacket, ESPHOME_LOG_LEVEL_DEBUG, __LINE__);
+    }
+}
+BENCHMARK_CAPTURE(BM_DebugPrintPacket, small_status, SMALL_STATUS);
+BENCHMARK_CAPTURE(BM_DebugPrintPacket, royal_clima_big_status, ROYAL_CLIMA_BIG_STATUS);
+
+// путь команды целиком, как из control(): команда, последовательность и все пакеты туда и обратно
+void BM_CommandToPacket(benchmark::State &state) {
+    BenchAirCon ac;
+    SplitEmulator split(ac);
+    ac.uart.push(PING);
+    split.run(500);
+    unsigned i = 0;
+    for (auto _ : state) {
+        ac_command_t cmd;
+        ac._clearCommand(&cmd);
+        cmd.temp_target = 20 + (i++ & 3);
+        cmd.temp_target_matter = true;
+        ac.commandSequence(&cmd);
+        while (ac.hasSequence()) split.run(1);
+    }
+    if (ac._sequences_failed > 0) state.SkipWithError("command sequence failed");
+}
+BENCHMARK(BM_CommandToPacket);
+
+// главный цикл узла с несколькими кондиционерами: range(0) - число блоков, range(1) - общий планировщик
+// время - средний проход цикла, в счетчиках - пиковая работа за один проход
+void BM_NodeTick(benchmark::State &state) {
+    NodeSimulation node(state.range(0), state.range(1) != 0);
+    node.run_ms(1000);  // пинг и стартовые запросы
+    for (auto _ : state) node.tick();
+    state.counters["max_tick_polls"] = node.scheduler.get_max_tick_polls();
+    state.counters["max_tick_bytes"] = node.scheduler.get_max_tick_bytes();
+    state.counters["max_tick_entities"] = node.scheduler.get_max_tick_entities();
+}
+BENCHMARK(BM_NodeTick)->ArgsProduct({{1, 2, 4}, {0, 1}})->Iterations(60000);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1914 @@
+// Тесты протокольного ядра aux_ac на компьютере: кодирование, разбор пакетов, приемник и последовательности
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <memory>
+#include <random>
+
+#include "host_hal.h"
+
+using namespace aux_ac_host;
+
+namespace {
+
+// ping от кондиционера и ожидаемый ответ модуля (сняты с реального сплита)
+const std::vector<uint8_t> PING = {0xBB, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0xFF};
+const std::vector<uint8_t> PING_ANSWER = {0xBB, 0x00, 0x01, 0x80, 0x01, 0x00, 0x08, 0x00, 0x1C, 0x27,
+                                          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x58};
+const std::vector<uint8_t> SMALL_STATUS_REQUEST = {0xBB, 0x00, 0x06, 0x80, 0x00, 0x00, 0x02, 0x00, 0x11, 0x01, 0x2B, 0x7E};
+
+// подключает модуль к сплиту: ping, ответ и стартовая последовательность
+void connect(HostAirCon &ac, SplitEmulator &split) {
+    ac.uart.push(PING);
+    split.run(500);
+    ASSERT_TRUE(ac.get_has_connection());
+    ASSERT_FALSE(ac.hasSequence());
+}
+
+// состояние сплита для расчета экшина
+ac_state_t action_state(ac_power power, ac_realFan fan, float ambient, int8_t inbound, uint8_t inverter_power = 0) {
+    ac_state_t state{};
+    state.power = power;
+    state.realFanSpeed = fan;
+    state.temp_ambient = ambient;
+    state.temp_inbound = inbound;
+    state.inverter_power = inverter_power;
+    return state;
+}
+
+}  // namespace
+
+// строковые константы собираются при компиляции
+static_assert(Constants::ANTIFUNGUS.len == 10, "constant length is computed at compile time");
+static_assert(Constants::MUTE.str[0] == 'm', "constant text is available at compile time");
+
+TEST(Constants, StringComparison) {
+    EXPECT_TRUE(std::string("turbo") == Constants::TURBO);
+    EXPECT_TRUE(Constants::HEALTH == std::string("Health"));
+    EXPECT_FALSE(std::string("Turbo") == Constants::TURBO);   // регистр важен
+    EXPECT_FALSE(std::string("turbo ") == Constants::TURBO);  // длина тоже
+    EXPECT_FALSE(std::string("mut") == Constants::MUTE);
+    EXPECT_FALSE(std::string() == Constants::CLEAN);
+    EXPECT_TRUE(std::string("Clean") != Constants::ANTIFUNGUS);
+    EXPECT_EQ("Antifungus", Constants::ANTIFUNGUS.to_string());
+    EXPECT_STREQ("0.2.10", Constants::AC_FIRMWARE_VERSION.c_str());
+}
+
+TEST(Crc, MatchesCapturedPing) {
+    HostAirCon ac;
+    std::vector<uint8_t> ping(PING.begin(), PING.begin() + AC_HEADER_SIZE);
+    EXPECT_EQ(0x43FF, ac._CRC16(ping.data(), ping.size()));
+    EXPECT_EQ(0x43FF, reference_crc(ping));
+}
+
+TEST(Crc, OddLengthIsPadded) {
+    HostAirCon ac;
+    std::vector<uint8_t> data = {0xBB, 0x00, 0x06, 0x80, 0x00, 0x00, 0x0F, 0x00, 0x01};
+    EXPECT_EQ(reference_crc(data), ac._CRC16(data.data(), data.size()));
+}
+
+TEST(Encode, StatusRequests) {
+    HostAirCon ac;
+    ac._fillStatusSmall();
+    EXPECT_EQ(SMALL_STATUS_REQUEST, std::vector<uint8_t>(ac._outPacket.data, ac._outPacket.data + ac._outPacket.bytesLoaded));
+
+    ac._fillStatusBig();
+    std::vector<uint8_t> big(ac._outPacket.data, ac._outPacket.data + ac._outPacket.bytesLoaded);
+    ASSERT_EQ(12u, big.size());
+    EXPECT_EQ(AC_CMD_STATUS_BIG, big[8]);
+    EXPECT_EQ(reference_crc(std::vector<uint8_t>(big.begin(), big.end() - 2)), (big[10] << 8) | big[11]);
+}
+
+TEST(Encode, SetCommand) {
+    HostAirCon ac;
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.power = AC_POWER_ON;
+    cmd.mode = AC_MODE_HEAT;
+    cmd.temp_target = 22.5;
+    cmd.temp_target_matter = true;
+    ac._fillSetCommand(true, nullptr, &cmd);
+
+    std::vector<uint8_t> p(ac._outPacket.data, ac._outPacket.data + ac._outPacket.bytesLoaded);
+    ASSERT_EQ((size_t)AC_HEADER_SIZE + 0x0F + 2, p.size());
+    EXPECT_EQ(AC_PTYPE_CMD, p[2]);
+    EXPECT_EQ(AC_CMD_SET_PARAMS, p[8]);
+    EXPECT_EQ((22 - 8) << 3, p[10] & AC_TEMP_TARGET_INT_PART_MASK);
+    EXPECT_EQ(AC_TEMP_TARGET_FRAC_PART_MASK, p[12] & AC_TEMP_TARGET_FRAC_PART_MASK);
+    EXPECT_EQ(AC_MODE_HEAT, p[15] & AC_MODE_MASK);
+    EXPECT_EQ(AC_POWER_ON, p[18] & AC_POWER_MASK);
+    EXPECT_TRUE(ac._checkCRC(&ac._outPacket));
+}
+
+TEST(Receiver, AnswersPing) {
+    HostAirCon ac;
+    ac.uart.push(PING);
+    ac.run(20);
+    ASSERT_GE(ac.uart.tx.size(), PING_ANSWER.size());
+    EXPECT_EQ(PING_ANSWER, std::vector<uint8_t>(ac.uart.tx.begin(), ac.uart.tx.begin() + PING_ANSWER.size()));
+    EXPECT_TRUE(ac.get_has_connection());
+}
+
+TEST(Receiver, StartupRequestsSmallStatus) {
+    HostAirCon ac;
+    ac.uart.push(PING);
+    ac.run(100);
+    ASSERT_GE(ac.uart.tx.size(), PING_ANSWER.size() + SMALL_STATUS_REQUEST.size());
+    EXPECT_EQ(SMALL_STATUS_REQUEST, std::vector<uint8_t>(ac.uart.tx.begin() + PING_ANSWER.size(),
+                                                         ac.uart.tx.begin() + PING_ANSWER.size() + SMALL_STATUS_REQUEST.size()));
+}
+
+TEST(Receiver, GarbageBeforeStartByteIsDropped) {
+    HostAirCon ac;
+    ac.uart.push({0x00, 0x13, 0xFF, 0x42});
+    ac.uart.push(PING);
+    ac.run(20);
+    EXPECT_TRUE(ac.get_has_connection());
+}
+
+TEST(Receiver, BadCrcIsRejected) {
+    HostAirCon ac;
+    std::vector<uint8_t> ping = PING;
+    ping.back() ^= 0x01;
+    ac.uart.push(ping);
+    ac.run(20);
+    EXPECT_FALSE(ac.get_has_connection());
+    EXPECT_TRUE(ac.uart.tx.empty());
+}
+
+TEST(Receiver, PartialPacketTimesOut) {
+    HostAirCon ac;
+    ac.uart.push(std::vector<uint8_t>(PING.begin(), PING.begin() + 5));
+    ac.run(ac.get_packet_timeout() + 10);
+    EXPECT_EQ(0, ac._inPacket.bytesLoaded);
+    EXPECT_TRUE(ac.logger.contains("packet timed out"));
+
+    // после таймаута приемник снова готов
+    ac.uart.push(PING);
+    ac.run(20);
+    EXPECT_TRUE(ac.get_has_connection());
+}
+
+TEST(Receiver, OversizedBodyLengthIsDroppedAtHeader) {
+    // длина тела 0xFF: такой пакет в буфер не влезет, CRC оказалась бы за его границей
+    HostAirCon ac;
+    ac.uart.push({0xBB, 0x00, 0x07, 0x00, 0x00, 0x00, 0xFF, 0x00});
+    ac.run(2);
+    EXPECT_EQ(0, ac._inPacket.bytesLoaded);
+    EXPECT_EQ(nullptr, ac._inPacket.crc);
+    EXPECT_TRUE(ac.logger.contains("wrong body length FF"));
+
+    ac.uart.push(PING);
+    ac.run(20);
+    EXPECT_TRUE(ac.get_has_connection());
+}
+
+TEST(Parser, SmallStatus) {
+    HostAirCon ac;
+    ac.uart.push(make_packet(AC_PTYPE_INFO, small_body()));
+    ac.run(20);
+    EXPECT_EQ(1u, ac.state_changes);
+    EXPECT_FLOAT_EQ(24.5, ac._current_ac_state.temp_target);
+    EXPECT_EQ(AC_POWER_ON, ac._current_ac_state.power);
+    EXPECT_EQ(AC_MODE_COOL, ac._current_ac_state.mode);
+    EXPECT_EQ(AC_FANSPEED_LOW, ac._current_ac_state.fanSpeed);
+
+    // повтор того же статуса не должен вызывать публикацию
+    ac.uart.push(make_packet(AC_PTYPE_INFO, small_body()));
+    ac.run(20);
+    EXPECT_EQ(1u, ac.state_changes);
+}
+
+TEST(Parser, BigStatus) {
+    HostAirCon ac;
+    ac.uart.push(make_packet(AC_PTYPE_INFO, big_body()));
+    ac.run(40);
+    EXPECT_EQ(1u, ac.state_changes);
+    EXPECT_TRUE(ac._is_inverter);
+    EXPECT_FLOAT_EQ(23.5, ac._current_ac_state.temp_ambient);
+    EXPECT_EQ(5, ac._current_ac_state.temp_outdoor);
+    EXPECT_EQ(18, ac._current_ac_state.temp_inbound);
+    EXPECT_EQ(30, ac._current_ac_state.temp_outbound);
+    EXPECT_EQ(60, ac._current_ac_state.temp_compressor);
+    EXPECT_EQ(40, ac._current_ac_state.inverter_power);
+}
+
+TEST(Parser, ShortStatusIsIgnored) {
+    // малый статус с телом из двух байт не должен разбираться по чужим байтам буфера
+    HostAirCon ac;
+    ac.uart.push(make_packet(AC_PTYPE_INFO, {0x01, AC_CMD_STATUS_SMALL}));
+    ac.uart.push(make_packet(AC_PTYPE_INFO, {0x01, AC_CMD_STATUS_BIG, 0x20}));
+    ac.run(40);
+    EXPECT_EQ(0u, ac.state_changes);
+    EXPECT_TRUE(ac.logger.contains("small status packet is too short"));
+    EXPECT_TRUE(ac.logger.contains("big status packet is too short"));
+}
+
+TEST(Parser, RoyalClimaBigStatus) {
+    // канальник Royal Clima присылает большой статус длиной 0x19, весь пакет - 35 байт
+    HostAirCon ac;
+    std::vector<uint8_t> packet = make_packet(AC_PTYPE_INFO, big_body(0x19));
+    ASSERT_EQ((size_t)AC_BUFFER_SIZE, packet.size());
+    ac.uart.push(packet);
+    ac.run(40);
+    EXPECT_EQ(1u, ac.state_changes);
+    EXPECT_FLOAT_EQ(23.5, ac._current_ac_state.temp_ambient);
+}
+
+TEST(Sequence, StartupCollectsBothStatuses) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    EXPECT_EQ(1u, ac._sequences_done);  // малый и большой статус грузятся одной последовательностью
+    EXPECT_EQ(0u, ac._sequences_failed);
+    EXPECT_FLOAT_EQ(24.5, ac._current_ac_state.temp_target);
+    EXPECT_FLOAT_EQ(23.5, ac._current_ac_state.temp_ambient);
+}
+
+TEST(Sequence, RoyalClimaStartup) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    split.big_length = 0x19;
+    connect(ac, split);
+    EXPECT_EQ(0u, ac._sequences_failed);
+    EXPECT_FLOAT_EQ(23.5, ac._current_ac_state.temp_ambient);
+}
+
+TEST(Sequence, CommandIsAppliedAndConfirmed) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    uint32_t done = ac._sequences_done;
+
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.mode = AC_MODE_HEAT;
+    cmd.temp_target = 21;
+    cmd.temp_target_matter = true;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(1000);
+
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(1u, split.commands);
+    EXPECT_EQ(done + 1, ac._sequences_done);
+    EXPECT_EQ(0u, ac._sequences_failed);
+    EXPECT_EQ(AC_MODE_HEAT, ac._current_ac_state.mode);
+    EXPECT_FLOAT_EQ(21, ac._current_ac_state.temp_target);
+    EXPECT_EQ(AC_POWER_ON, ac._current_ac_state.power);  // не тронутые командой параметры сохранились
+}
+
+TEST(Sequence, TimesOutWithoutAnswer) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    split.mute = true;
+
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.power = AC_POWER_OFF;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(AC_SEQUENCE_DEFAULT_TIMEOUT + 100);
+
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(1u, ac._sequences_failed);
+    EXPECT_EQ(0u, split.commands);
+}
+
+TEST(Sequence, IdleGarbageIsNotTakenForAnswer) {
+    // мусор без стартового байта, похожий на заголовок статуса, копится в буфере в IDLE;
+    // проверка ответа в последовательности не должна принимать его за пакет (у него нет тела)
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ASSERT_TRUE(ac.getStatusSmall());
+    ac.uart.push({0x00, 0x00, AC_PTYPE_INFO, 0x00, 0x00, 0x00, 0x0F, 0x00, 0x01, 0x11});
+    split.run(1000);
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(0u, ac._sequences_failed);
+}
+
+TEST(Sequence, DoCommandControlWithoutSentCommandFails) {
+    // шаг контроля команды без предыдущего шага с отправленной командой - ответ сверять не с чем
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ASSERT_TRUE(ac._addSequenceFuncStep(&HostAirCon::sq_controlDoCommand));
+    ac.uart.push(make_packet(AC_PTYPE_INFO, {0x01, AC_CMD_SET_PARAMS, 0x00, 0x00}));
+    ac.run(40);
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(1u, ac._sequences_failed);
+    EXPECT_TRUE(ac.logger.contains("CMD = 01"));
+}
+
+TEST(Clock, VirtualClockWrapsLikeArduino) {
+    AirConVirtualClock clock;
+    clock.us = 0xFFFFFFFFull - 500;
+    EXPECT_EQ(0xFFFFFFFFu - 500, clock.micros());
+    clock.advance_us(1000);
+    EXPECT_EQ(499u, clock.micros());
+    EXPECT_EQ(4294967u, clock.millis());
+
+    clock.us = 0xFFFFFFFFull * 1000;
+    clock.advance_ms(2);
+    EXPECT_EQ(1u, clock.millis());
+}
+
+TEST(Clock, StatusIsPolledEveryPeriod) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    unsigned requests = split.status_requests;
+    uint32_t done = ac._sequences_done;
+
+    // 6 часов работы по виртуальным часам
+    const uint64_t hours = 6;
+    split.fast_forward(hours * 3600 * 1000);
+
+    // опрос идет, когда с прошлого прошло больше периода, то есть раз в period + 1 мс
+    unsigned polls = hours * 3600 * 1000 / (ac.get_period() + 1);
+    EXPECT_NEAR(polls, split.status_requests - requests, 1);
+    EXPECT_NEAR(polls, ac._sequences_done - done, 1);
+    EXPECT_EQ(0u, ac._sequences_failed);
+}
+
+TEST(Clock, PollingSurvivesMillisOverflow) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    // за 20 секунд до переполнения millis()
+    ac.clock.us = (0x100000000ull - 20000) * 1000;
+    ac.set_clock(&ac.clock);
+    connect(ac, split);
+    unsigned requests = split.status_requests;
+
+    split.fast_forward(10 * 60 * 1000);
+    EXPECT_LT(ac.clock.millis(), 10u * 60 * 1000);
+    EXPECT_NEAR(10 * 60 * 1000 / (ac.get_period() + 1), split.status_requests - requests, 1);
+    EXPECT_EQ(0u, ac._sequences_failed);
+}
+
+TEST(Clock, SetClockRestartsPollPeriod) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.set_period(60000);
+    unsigned requests = split.status_requests;
+
+    FakeClock other;
+    other.us = 500000000ull * 1000;
+    ac.set_clock(&other);
+    EXPECT_EQ(&other, ac.get_clock());
+    // новые часы ушли далеко вперед, но период отсчитывается от момента подмены
+    ac.loopCore();
+    EXPECT_FALSE(ac.hasSequence());
+    other.advance_ms(60001);
+    ac.loopCore();
+    EXPECT_TRUE(ac.hasSequence());
+
+    ac.set_clock(&ac.clock);
+    split.fast_forward(3600 * 1000);
+    EXPECT_NEAR(60, split.status_requests - requests, 2);
+    EXPECT_EQ(0u, ac._sequences_failed);
+}
+
+TEST(Clock, NoPollingWithoutConnection) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    split.mute = true;
+    split.fast_forward(3600 * 1000);
+    // только пробный запрос на старте: малый статус, на который никто не ответил
+    EXPECT_EQ(make_packet(AC_PTYPE_CMD, {0x01, AC_CMD_STATUS_SMALL}).size(), ac.uart.tx.size());
+    EXPECT_FALSE(ac.get_has_connection());
+    EXPECT_EQ(1u, ac._sequences_failed);
+}
+
+TEST(Startup, ProbeConnectsBeforeFirstPing) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    split.fast_forward(300);
+    EXPECT_TRUE(ac.get_has_connection());
+    EXPECT_TRUE(ac.get_connected_by_probe());
+    EXPECT_TRUE(ac.has_live_state());
+    EXPECT_LT(ac.get_first_state_latency(), 300u);
+    EXPECT_TRUE(ac._is_inverter);  // большой статус тоже получен
+    EXPECT_EQ(1u, split.status_requests);
+    EXPECT_EQ(0u, ac._sequences_failed);
+
+    // пинг после пробы не запускает стартовую последовательность еще раз
+    ac.uart.push(PING);
+    split.run(500);
+    EXPECT_EQ(1u, split.status_requests);
+}
+
+TEST(Startup, FallsBackToPingWhenProbeFails) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    split.mute = true;
+    split.fast_forward(1000);
+    EXPECT_FALSE(ac.get_has_connection());
+    EXPECT_FALSE(ac.hasSequence());
+
+    split.mute = false;
+    connect(ac, split);
+    EXPECT_FALSE(ac.get_connected_by_probe());
+    EXPECT_GE(ac.get_connection_latency(), 1000u);
+    EXPECT_TRUE(ac.has_live_state());
+}
+
+TEST(Startup, ProbeCanBeDisabled) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    ac.set_startup_probe(false);
+    split.fast_forward(3600 * 1000);
+    EXPECT_TRUE(ac.uart.tx.empty());
+    EXPECT_EQ(0u, split.status_requests);
+}
+
+TEST(Action, OnOffOutcomes) {
+    struct {
+        ac_state_t state;
+        ac_action action;
+    } cases[] = {
+        {action_state(AC_POWER_OFF, AC_REAL_FAN_OFF, 24, 20), AC_ACTION_OFF},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_MUTE, 24.5, 23), AC_ACTION_DRYING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, 15), AC_ACTION_COOLING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_LOW, 20, 35), AC_ACTION_HEATING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_MID, 24, 23), AC_ACTION_FAN},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_OFF, 24, 26), AC_ACTION_IDLE},
+    };
+    for (auto &c : cases) {
+        AirConActionEstimator estimator;
+        EXPECT_TRUE(estimator.update(c.state, false, 100000));
+        EXPECT_EQ(c.action, estimator.get_action()) << "fan " << c.state.realFanSpeed << ", ambient " << c.state.temp_ambient;
+    }
+}
+
+TEST(Action, InverterOffOutcomes) {
+    struct {
+        ac_state_t state;
+        ac_action action;
+    } cases[] = {
+        {action_state(AC_POWER_OFF, AC_REAL_FAN_OFF, 24, 20), AC_ACTION_OFF},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_MUTE, 24.5, 23), AC_ACTION_DRYING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_OFF, 24, 26), AC_ACTION_IDLE},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, 15), AC_ACTION_FAN},
+    };
+    for (auto &c : cases) {
+        AirConActionEstimator estimator;
+        estimator.update(c.state, true, 100000);
+        EXPECT_EQ(c.action, estimator.get_action()) << "fan " << c.state.realFanSpeed << ", ambient " << c.state.temp_ambient;
+    }
+}
+
+TEST(Action, InverterRunningOutcomes) {
+    struct {
+        ac_state_t state;
+        ac_action action;
+    } cases[] = {
+        {action_state(AC_POWER_ON, AC_REAL_FAN_MUTE, 24, 20, 30), AC_ACTION_DRYING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_OFF, 24, 26, 30), AC_ACTION_IDLE},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 20, 35, 30), AC_ACTION_HEATING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, 15, 30), AC_ACTION_COOLING},
+        {action_state(AC_POWER_ON, AC_REAL_FAN_LOW, 24, 23, 30), AC_ACTION_IDLE},
+    };
+    for (auto &c : cases) {
+        AirConActionEstimator estimator;
+        // инвертор выключен, затем включается
+        estimator.update(action_state(AC_POWER_ON, AC_REAL_FAN_OFF, 24, 24), true, 100000);
+        // пока инвертор только включился, экшин определяется лишь по вентилятору
+        estimator.update(c.state, true, 101000);
+        EXPECT_EQ((c.state.realFanSpeed <= AC_REAL_FAN_MUTE) ? AC_ACTION_IDLE : AC_ACTION_FAN, estimator.get_action());
+        // реакция на включение инвертора получена
+        estimator.update(c.state, true, 102500);
+        EXPECT_EQ(c.action, estimator.get_action()) << "fan " << c.state.realFanSpeed << ", ambient " << c.state.temp_ambient;
+    }
+}
+
+TEST(Action, RecalculatedOnlyWhenInputsChange) {
+    AirConActionEstimator estimator;
+    ac_state_t state = action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, 15);
+    estimator.update(state, false, 1000);
+    EXPECT_EQ(1u, estimator.get_recalculations());
+
+    // параметры, которые не влияют на экшин
+    state.temp_target = 18;
+    state.temp_outdoor = 35;
+    EXPECT_FALSE(estimator.update(state, false, 2000));
+    EXPECT_EQ(1u, estimator.get_recalculations());
+
+    state.temp_inbound = 30;
+    EXPECT_TRUE(estimator.update(state, false, 3000));
+    EXPECT_EQ(AC_ACTION_HEATING, estimator.get_action());
+    EXPECT_EQ(2u, estimator.get_recalculations());
+
+    // пока ждем реакции инвертора, пересчет идет и без изменения параметров
+    estimator.update(state, true, 3500);
+    state.inverter_power = 40;
+    estimator.update(state, true, 4000);
+    EXPECT_EQ(AC_ACTION_FAN, estimator.get_action());
+    EXPECT_TRUE(estimator.update(state, true, 7000));
+    EXPECT_EQ(AC_ACTION_HEATING, estimator.get_action());
+    EXPECT_FALSE(estimator.update(state, true, 8000));
+    EXPECT_EQ(5u, estimator.get_recalculations());
+}
+
+TEST(Action, InstancesAreIndependent) {
+    // два инверторных сплита на одной ноде: выключение инвертора у второго не сбивает ожидание у первого
+    AirConActionEstimator first, second;
+    ac_state_t running = action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, 15, 50);
+    ac_state_t stopped = action_state(AC_POWER_ON, AC_REAL_FAN_LOW, 24, 24, 0);
+
+    first.update(stopped, true, 1000);
+    first.update(running, true, 5000);
+    EXPECT_EQ(AC_ACTION_COOLING, first.get_action());
+
+    second.update(stopped, true, 6000);
+    first.update(running, true, 7000);
+    EXPECT_EQ(AC_ACTION_COOLING, first.get_action());
+    EXPECT_EQ(AC_ACTION_FAN, second.get_action());
+}
+
+TEST(Footprint, TestPacketIsAllocatedOnDemand) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    EXPECT_EQ(0u, ac.get_footprint().heap);
+
+    size_t sent = ac.uart.tx.size();
+    ASSERT_TRUE(ac.sendTestPacket({0xBB, 0x00, 0x06, 0x80, 0x00, 0x00, 0x02, 0x00, 0x11, 0x01}));
+    EXPECT_EQ(sizeof(packet_t), ac.get_footprint().heap);
+    split.run(100);
+    EXPECT_FALSE(ac.hasSequence());
+
+    // в линию ушел пакет с пересчитанной CRC
+    std::vector<uint8_t> expected = make_packet(AC_PTYPE_CMD, {0x11, 0x01});
+    expected[3] = 0x80;
+    uint16_t crc = reference_crc(std::vector<uint8_t>(expected.begin(), expected.end() - 2));
+    expected[expected.size() - 2] = crc >> 8;
+    expected[expected.size() - 1] = crc & 0xFF;
+    EXPECT_EQ(expected, std::vector<uint8_t>(ac.uart.tx.begin() + sent, ac.uart.tx.end()));
+}
+
+// флеш в памяти: считает записи
+class MemoryPresetStorage : public AirConCommandStorage {
+   public:
+    ac_save_command_t data[AC_PRESETS_COUNT] = {};
+    unsigned saves = 0;
+    bool fail = false;
+
+    bool load(ac_save_command_t *items, uint8_t count) override {
+        memcpy(items, data, count * sizeof(ac_save_command_t));
+        return true;
+    }
+
+    bool save(const ac_save_command_t *items, uint8_t count) override {
+        if (fail) return false;
+        memcpy(data, items, count * sizeof(ac_save_command_t));
+        saves++;
+        return true;
+    }
+};
+
+ac_command_t cool_command(float temp) {
+    HostAirCon ac;
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.power = AC_POWER_ON;
+    cmd.mode = AC_MODE_COOL;
+    cmd.temp_target = temp;
+    return cmd;
+}
+
+TEST(Presets, BaseSizeIsComputed) {
+    EXPECT_EQ(offsetof(ac_command_t, health_status), AC_COMMAND_BASE_SIZE);
+    EXPECT_LE(AC_COMMAND_BASE_SIZE, sizeof(ac_save_command_t));
+}
+
+TEST(Presets, SliderBurstIsWrittenOnce) {
+    MemoryPresetStorage flash;
+    AirConPresetStore store;
+    store.begin(&flash);
+    store.set_save_delay(1000);
+
+    uint32_t now = 0;
+    for (int i = 0; i < 10; i++, now += 200) {
+        ac_command_t cmd = cool_command(20 + i * 0.5);
+        EXPECT_EQ(POS_MODE_COOL, store.put(&cmd, now));
+        EXPECT_EQ(AC_STORE_NOTHING, store.loop(now));
+    }
+    EXPECT_EQ(0u, flash.saves);
+    EXPECT_EQ(1 << POS_MODE_COOL, store.get_dirty_slots());
+
+    EXPECT_EQ(AC_STORE_SAVED, store.loop(now - 200 + 1000));
+    EXPECT_EQ(1u, flash.saves);
+    EXPECT_EQ(1u, store.get_flash_writes());
+    EXPECT_EQ(9u, store.get_writes_avoided());
+    EXPECT_EQ(24.5f, flash.data[POS_MODE_COOL].temp_target);
+}
+
+TEST(Presets, RevertedChangeIsNotWritten) {
+    MemoryPresetStorage flash;
+    AirConPresetStore store;
+    store.begin(&flash);
+    ac_command_t a = cool_command(22), b = cool_command(25);
+    store.put(&a, 0);
+    store.flush(0);
+    ASSERT_EQ(1u, flash.saves);
+
+    EXPECT_EQ(-1, store.put(&a, 100));  // то же самое - даже не помечается
+    EXPECT_EQ(0, store.get_dirty_slots());
+    store.put(&b, 200);
+    store.put(&a, 300);
+    EXPECT_EQ(AC_STORE_UNCHANGED, store.loop(300 + store.get_save_delay()));
+    EXPECT_EQ(1u, flash.saves);
+    EXPECT_EQ(0, store.get_dirty_slots());
+    EXPECT_EQ(2u, store.get_writes_avoided());
+}
+
+TEST(Presets, RevertCheckComparesContent) {
+    // один слот вернулся к сохраненному, другой изменился: записывать надо
+    MemoryPresetStorage flash;
+    AirConPresetStore store;
+    store.begin(&flash);
+    ac_command_t cool = cool_command(22), warmer = cool_command(23);
+    ac_command_t heat = cool_command(28);
+    heat.mode = AC_MODE_HEAT;
+    store.put(&cool, 0);
+    store.flush(0);
+    store.put(&warmer, 100);
+    store.put(&cool, 200);
+    store.put(&heat, 300);
+    EXPECT_EQ(AC_STORE_SAVED, store.flush(400));
+    EXPECT_EQ(2u, flash.saves);
+    EXPECT_EQ(28, flash.data[POS_MODE_HEAT].temp_target);
+
+    // снимок: любое отличие от записанного во флеш уходит во флеш, даже в одном бите
+    AirConStateSnapshot snapshot;
+    MemoryPresetStorage snapshot_flash;
+    snapshot.begin(&snapshot_flash);
+    snapshot.put(0, &cool, 0);
+    EXPECT_EQ(AC_STORE_SAVED, snapshot.flush(0));
+    ac_command_t louver = cool;
+    louver.louver.louver_v = (ac_louver_V)(cool.louver.louver_v ^ 0x01);
+    snapshot.put(0, &louver, 100);
+    EXPECT_EQ(AC_STORE_SAVED, snapshot.flush(200));
+    EXPECT_EQ(2u, snapshot_flash.saves);
+}
+
+TEST(Presets, FailedWriteIsRetried) {
+    MemoryPresetStorage flash;
+    AirConPresetStore store;
+    store.begin(&flash);
+    store.set_save_delay(100);
+    ac_command_t cmd = cool_command(23);
+    store.put(&cmd, 0);
+    flash.fail = true;
+    EXPECT_EQ(AC_STORE_FAILED, store.loop(100));
+    EXPECT_EQ(AC_STORE_NOTHING, store.loop(150));
+    flash.fail = false;
+    EXPECT_EQ(AC_STORE_SAVED, store.loop(200));
+    EXPECT_EQ(1u, flash.saves);
+}
+
+TEST(Presets, LoadRestoresOnlyInitializedSlots) {
+    MemoryPresetStorage flash;
+    ac_command_t saved = cool_command(26);
+    saved.fanSpeed = AC_FANSPEED_HIGH;
+    memcpy(&flash.data[POS_MODE_COOL], &saved, AC_COMMAND_BASE_SIZE);
+
+    AirConPresetStore store;
+    store.begin(&flash);
+    ac_command_t cmd = cool_command(20);
+    cmd.health_status = AC_HEALTH_STATUS_ON;
+    EXPECT_TRUE(store.load(&cmd, POS_MODE_COOL));
+    EXPECT_EQ(26, cmd.temp_target);
+    EXPECT_EQ(AC_FANSPEED_HIGH, cmd.fanSpeed);
+    EXPECT_EQ(AC_HEALTH_STATUS_ON, cmd.health_status);  // поля вне AC_COMMAND_BASE не трогаются
+
+    cmd.mode = AC_MODE_HEAT;
+    EXPECT_FALSE(store.load(&cmd, POS_MODE_HEAT));
+    EXPECT_FALSE(store.load(&cmd, AC_PRESETS_COUNT));
+}
+
+TEST(Snapshot, RestoredStateIsStaleUntilFirstStatus) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    ac_command_t cmd = cool_command(24.5);
+    cmd.fanSpeed = AC_FANSPEED_LOW;
+    ac_save_command_t snapshot;
+    memcpy(&snapshot, &cmd, AC_COMMAND_BASE_SIZE);
+
+    ASSERT_TRUE(ac.restoreState(&snapshot));
+    EXPECT_TRUE(ac.is_state_stale());
+    EXPECT_FALSE(ac.has_live_state());
+    EXPECT_EQ(AC_MODE_COOL, ac._current_ac_state.mode);
+    EXPECT_EQ(24.5, ac._current_ac_state.temp_target);
+    unsigned changes = ac.state_changes;
+
+    ac.clock.advance_ms(1200);
+    connect(ac, split);
+    EXPECT_FALSE(ac.is_state_stale());
+    EXPECT_TRUE(ac.has_live_state());
+    EXPECT_GE(ac.get_first_state_latency(), 1200u);
+    // живой статус совпал с восстановленным, но публикуется все равно, уже без пометки "устаревшее"
+    EXPECT_GT(ac.state_changes, changes);
+    EXPECT_FALSE(ac.restoreState(&snapshot));
+}
+
+TEST(Snapshot, StoreKeepsOneSlot) {
+    MemoryPresetStorage flash;
+    AirConStateSnapshot snapshot;
+    snapshot.begin(&flash);
+    snapshot.set_save_delay(1000);
+    ac_command_t a = cool_command(22), b = cool_command(23);
+    EXPECT_TRUE(snapshot.put(0, &a, 0));
+    EXPECT_FALSE(snapshot.put(1, &b, 0));
+    EXPECT_TRUE(snapshot.put(0, &b, 500));
+    EXPECT_EQ(AC_STORE_NOTHING, snapshot.loop(1000));
+    EXPECT_EQ(AC_STORE_SAVED, snapshot.loop(1500));
+    EXPECT_EQ(23, flash.data[0].temp_target);
+    EXPECT_EQ(0, flash.data[1].power);  // второй слот не трогается
+    EXPECT_EQ(1u, snapshot.get_writes_avoided());
+}
+
+// команда с тем, что уже показывает small_body(): охлаждение, 24.5 градуса, низкая скорость, питание включено
+ac_command_t current_command(HostAirCon &ac) {
+    ac_command_t cmd;
+    ac._clearCommand(&cmd);
+    cmd.power = AC_POWER_ON;
+    cmd.mode = AC_MODE_COOL;
+    cmd.fanSpeed = AC_FANSPEED_LOW;
+    cmd.temp_target = 24.5;
+    cmd.temp_target_matter = true;
+    return cmd;
+}
+
+TEST(NoOp, UnchangedCommandIsSuppressed) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac_command_t cmd = current_command(ac);
+    EXPECT_FALSE(ac._stripUnchanged(&cmd));
+    EXPECT_EQ(1u, ac.get_commands_suppressed());
+}
+
+TEST(NoOp, OnlyChangedFieldsAreLeft) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac_command_t cmd = current_command(ac);
+    cmd.fanSpeed = AC_FANSPEED_HIGH;
+    ac_command_t full = cmd;
+
+    EXPECT_TRUE(ac._stripUnchanged(&cmd));
+    EXPECT_EQ(AC_POWER_UNTOUCHED, cmd.power);
+    EXPECT_EQ(AC_MODE_UNTOUCHED, cmd.mode);
+    EXPECT_FALSE(cmd.temp_target_matter);
+    EXPECT_EQ(AC_FANSPEED_HIGH, cmd.fanSpeed);
+    EXPECT_EQ(0u, ac.get_commands_suppressed());
+
+    // в линию уходят те же байты, что и без вычистки
+    ac._fillSetCommand(true, nullptr, &full);
+    std::vector<uint8_t> expected(ac._outPacket.data, ac._outPacket.data + ac._outPacket.bytesLoaded);
+    ac._fillSetCommand(true, nullptr, &cmd);
+    EXPECT_EQ(expected, std::vector<uint8_t>(ac._outPacket.data, ac._outPacket.data + ac._outPacket.bytesLoaded));
+}
+
+TEST(NoOp, KeptWhileStateIsUnknownOrCommandPending) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    ac_command_t cmd = current_command(ac);
+    EXPECT_TRUE(ac._stripUnchanged(&cmd));  // статуса от сплита еще не было
+    EXPECT_EQ(AC_MODE_COOL, cmd.mode);
+
+    connect(ac, split);
+    ac_command_t other = current_command(ac);
+    other.temp_target = 22;
+    ASSERT_TRUE(ac.commandSequence(&other));
+    // 22 еще не применилась, и возврат к 24.5 подавлять нельзя
+    cmd = current_command(ac);
+    EXPECT_TRUE(ac._stripUnchanged(&cmd));
+    EXPECT_TRUE(cmd.temp_target_matter);
+    EXPECT_EQ(0u, ac.get_commands_suppressed());
+}
+
+// ядро, которое запоминает каждую публикацию целевой температуры и откаты
+class PublishingAirCon : public HostAirCon {
+   public:
+    std::vector<float> published;
+    unsigned rollbacks = 0;
+
+    void stateChanged() override {
+        HostAirCon::stateChanged();
+        published.push_back(_stateForPublish().temp_target);
+    }
+    void commandRolledBack() override { rollbacks++; }
+};
+
+TEST(Optimistic, PublishedRightAwayAndConfirmed) {
+    PublishingAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.set_optimistic(true);
+    ac.published.clear();
+
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    ASSERT_EQ(1u, ac.published.size());
+    EXPECT_EQ(21, ac.published.back());
+    EXPECT_TRUE(ac.has_pending_command());
+    EXPECT_EQ(24.5, ac._current_ac_state.temp_target);  // сплит еще ничего не знает
+
+    split.run(500);
+    EXPECT_FALSE(ac.has_pending_command());
+    EXPECT_EQ(21, ac._current_ac_state.temp_target);
+    for (float t : ac.published) EXPECT_EQ(21, t);  // без мигания старым значением
+    EXPECT_EQ(0u, ac.get_rollbacks());
+    EXPECT_EQ(0u, ac.rollbacks);
+}
+
+TEST(Optimistic, RolledBackWhenNotConfirmed) {
+    PublishingAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.set_optimistic(true);
+    ac.published.clear();
+    split.mute = true;
+
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(AC_SEQUENCE_DEFAULT_TIMEOUT * 2);
+    EXPECT_FALSE(ac.has_pending_command());
+    EXPECT_EQ(1u, ac.get_rollbacks());
+    EXPECT_EQ(1u, ac.rollbacks);
+    EXPECT_EQ(24.5, ac.published.back());
+}
+
+TEST(Optimistic, OffByDefault) {
+    PublishingAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.published.clear();
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    EXPECT_TRUE(ac.published.empty());
+    EXPECT_FALSE(ac.has_pending_command());
+}
+
+TEST(TrustEcho, NoTrailingStatusRequest) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+
+    unsigned requests = split.status_requests;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    EXPECT_EQ(2u, split.status_requests - requests);  // по умолчанию: статус до команды и после
+
+    ac.set_trust_echo(true);
+    cmd.temp_target = 22;
+    requests = split.status_requests;
+    unsigned changes = ac.state_changes;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(1u, split.status_requests - requests);
+    EXPECT_EQ(2u, split.commands);
+    EXPECT_EQ(22, ac._current_ac_state.temp_target);  // состояние взято из отправленной команды
+    EXPECT_GT(ac.state_changes, changes);
+}
+
+TEST(TrustEcho, NothingAppliedWithoutEcho) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.set_trust_echo(true);
+    split.mute = true;
+
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(AC_SEQUENCE_DEFAULT_TIMEOUT * 2);
+    EXPECT_FALSE(ac.hasSequence());
+    EXPECT_EQ(24.5, ac._current_ac_state.temp_target);
+}
+
+TEST(TrustEcho, OptimisticStateConfirmedByEcho) {
+    PublishingAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac.set_optimistic(true);
+    ac.set_trust_echo(true);
+    ac.published.clear();
+
+    ac_command_t cmd = current_command(ac);
+    cmd.temp_target = 21;
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    EXPECT_FALSE(ac.has_pending_command());
+    EXPECT_EQ(21, ac._current_ac_state.temp_target);
+    for (float t : ac.published) EXPECT_EQ(21, t);
+    EXPECT_EQ(0u, ac.get_rollbacks());
+}
+
+TEST(SendCommand, SeveralFieldsInOneExchange) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ASSERT_TRUE(ac._is_inverter);
+
+    ac_command_t cmd = ac.newCommand();
+    cmd.temp_target = 22;
+    cmd.temp_target_matter = true;
+    EXPECT_TRUE(ac.commandVLouver(&cmd, AC_LOUVERV_SWING_MIDDLE));
+    EXPECT_TRUE(ac.commandPowerLimitation(&cmd, true, 60));
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+
+    EXPECT_EQ(1u, split.commands);  // одна команда установки вместо трех
+    EXPECT_EQ(22, ac._current_ac_state.temp_target);
+    EXPECT_EQ(AC_LOUVERV_SWING_MIDDLE, ac._current_ac_state.louver.louver_v);
+    EXPECT_TRUE(ac._current_ac_state.inverter_power_limitation_enable);
+    EXPECT_EQ(60, ac._current_ac_state.inverter_power_limitation_value);
+}
+
+TEST(SendCommand, ZeroPowerLimitClearsEnableBit) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ac_command_t cmd = ac.newCommand();
+    ASSERT_TRUE(ac.commandPowerLimitation(&cmd, true, 60));
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    ASSERT_TRUE(ac._current_ac_state.inverter_power_limitation_enable);
+
+    // так send_command собирает power_limit: 0
+    size_t start = ac.uart.tx.size();
+    unsigned commands = split.commands;
+    cmd = ac.newCommand();
+    ASSERT_TRUE(ac.commandPowerLimitation(&cmd, false, 0));
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    EXPECT_EQ(commands + 1, split.commands);
+
+    // в отправленном пакете установки бит включения сброшен, значение ограничения прежнее
+    bool found = false;
+    for (size_t pos = start; pos + AC_HEADER_SIZE < ac.uart.tx.size(); pos += AC_HEADER_SIZE + ac.uart.tx[pos + 6] + 2) {
+        if (ac.uart.tx[pos + AC_HEADER_SIZE] != AC_CMD_SET_PARAMS) continue;
+        uint8_t limit = ac.uart.tx[pos + AC_HEADER_SIZE + 13];
+        EXPECT_EQ(0, limit & AC_INVERTER_POWER_LIMITATION_ENABLE_MASK);
+        EXPECT_EQ(60, limit & AC_INVERTER_POWER_LIMITATION_VALUE_MASK);
+        found = true;
+    }
+    EXPECT_TRUE(found);
+    EXPECT_FALSE(ac._current_ac_state.inverter_power_limitation_enable);
+
+    // повторное выключение ничего не меняет и подавляется
+    cmd = ac.newCommand();
+    ac.commandPowerLimitation(&cmd, false);
+    EXPECT_FALSE(ac._stripUnchanged(&cmd));
+}
+
+TEST(SendCommand, FanAndPresetFieldsKeepDependencies) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    connect(ac, split);
+    ASSERT_TRUE(ac.powerSequence(AC_POWER_OFF));
+    split.run(500);
+    ASSERT_EQ(AC_POWER_OFF, ac._current_ac_state.power);
+
+    // те же зависимости, что и у пресетов в control()
+    ac_command_t cmd = ac.newCommand();
+    EXPECT_TRUE(ac.commandFanTurbo(&cmd, true));
+    EXPECT_TRUE(ac.commandFanMute(&cmd, true));
+    EXPECT_EQ(AC_FANTURBO_OFF, cmd.fanTurbo);
+    EXPECT_EQ(AC_FANMUTE_ON, cmd.fanMute);
+    EXPECT_TRUE(ac.commandFanSpeed(&cmd, AC_FANSPEED_LOW));
+    EXPECT_EQ(AC_FANMUTE_OFF, cmd.fanMute);
+    EXPECT_FALSE(ac.commandFanSpeed(&cmd, AC_FANSPEED_UNTOUCHED));
+    EXPECT_EQ(AC_FANSPEED_LOW, cmd.fanSpeed);
+
+    // сплит выключен: очистка включается, ионизатор - нет
+    cmd = ac.newCommand();
+    EXPECT_FALSE(ac.commandHealth(&cmd, true));
+    EXPECT_EQ(AC_HEALTH_UNTOUCHED, cmd.health);
+    EXPECT_TRUE(ac.commandMildew(&cmd, true));
+    EXPECT_TRUE(ac.commandClean(&cmd, true));
+    EXPECT_EQ(AC_CLEAN_ON, cmd.clean);
+    EXPECT_EQ(AC_MILDEW_OFF, cmd.mildew);
+
+    // с включением в той же команде ионизатор уже можно
+    cmd = ac.newCommand();
+    cmd.power = AC_POWER_ON;
+    cmd.mode = AC_MODE_COOL;
+    EXPECT_TRUE(ac.commandFanTurbo(&cmd, true));
+    EXPECT_TRUE(ac.commandHealth(&cmd, true));
+    EXPECT_EQ(AC_FANTURBO_OFF, cmd.fanTurbo);
+    EXPECT_EQ(AC_FANSPEED_AUTO, cmd.fanSpeed);
+    EXPECT_TRUE(ac.commandHLouverSwing(&cmd, true));
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+
+    EXPECT_EQ(AC_POWER_ON, ac._current_ac_state.power);
+    EXPECT_EQ(AC_HEALTH_ON, ac._current_ac_state.health);
+    EXPECT_EQ(AC_FANSPEED_AUTO, ac._current_ac_state.fanSpeed);
+    EXPECT_EQ(AC_LOUVERH_SWING_LEFTRIGHT, ac._current_ac_state.louver.louver_h);
+
+    cmd = ac.newCommand();
+    EXPECT_TRUE(ac.commandHLouverSwing(&cmd, false));
+    EXPECT_TRUE(ac.commandHealth(&cmd, false));
+    ASSERT_TRUE(ac.commandSequence(&cmd));
+    split.run(500);
+    EXPECT_EQ(AC_HEALTH_OFF, ac._current_ac_state.health);
+    EXPECT_NE(AC_LOUVERH_SWING_LEFTRIGHT, ac._current_ac_state.louver.louver_h);
+}
+
+TEST(SendCommand, InvalidFieldsLeaveCommandUntouched) {
+    HostAirCon ac;
+    ac_command_t cmd = ac.newCommand();
+    EXPECT_FALSE(ac.commandVLouver(&cmd, (ac_louver_V)0x06));
+    EXPECT_FALSE(ac.commandVLouver(&cmd, AC_LOUVERV_UNTOUCHED));
+    EXPECT_EQ(AC_LOUVERV_UNTOUCHED, cmd.louver.louver_v);
+    // статуса еще не было, и неизвестно, инверторный ли сплит
+    EXPECT_FALSE(ac.commandPowerLimitation(&cmd, true, 60));
+    EXPECT_FALSE(cmd.inverter_power_limitation_enable);
+}
+
+// кондиционер группы: о конце своей команды сообщает общему учету рассылки
+class GroupAirCon : public HostAirCon {
+   public:
+    AirConCommandGroup *group = nullptr;
+    uint8_t unit = 0;
+    unsigned done = 0, failed = 0;
+    std::function<void(bool)> on_done;  // как add_on_command_done_callback() у AirCon
+
+    void commandDone(bool success) override {
+        success ? done++ : failed++;
+        if (group != nullptr) group->finished(unit, success, clock.millis());
+        if (on_done) on_done(success);
+    }
+};
+
+// несколько кондиционеров узла, у каждого свой сплит на своем UART; часы идут вместе
+struct GroupNode {
+    GroupAirCon units[4];
+    std::vector<std::unique_ptr<SplitEmulator>> splits;
+    AirConCommandGroup group;
+
+    GroupNode() {
+        for (uint8_t i = 0; i < 4; i++) {
+            splits.emplace_back(new SplitEmulator(units[i]));
+            connect(units[i], *splits[i]);
+            units[i].group = &group;
+            units[i].unit = i;
+        }
+    }
+
+    uint32_t now() { return units[0].clock.millis(); }
+
+    // один шаг автомата у всех кондиционеров
+    void step() {
+        for (auto &split : splits) split->run(1);
+    }
+
+    bool send(uint8_t i, float temp) {
+        ac_command_t cmd = units[i].newCommand();
+        cmd.temp_target = temp;
+        cmd.temp_target_matter = true;
+        return group.loaded(i, units[i].commandSequence(&cmd), now());
+    }
+};
+
+TEST(Group, UnitsRunConcurrently) {
+    GroupNode node;
+
+    // одна команда одному кондиционеру - столько же занимает и рассылка
+    node.group.begin(1, node.now());
+    node.send(0, 20);
+    while (!node.group.is_complete()) node.step();
+    uint32_t single = node.group.get_elapsed(node.now());
+
+    node.group.begin(4, node.now());
+    for (uint8_t i = 0; i < 4; i++) EXPECT_FALSE(node.send(i, 22));
+    EXPECT_TRUE(node.group.is_running());
+    unsigned steps = 0;
+    while (!node.group.is_complete() && steps++ < 5000) node.step();
+
+    ASSERT_TRUE(node.group.is_complete());
+    EXPECT_EQ(4, node.group.get_done());
+    EXPECT_EQ(0, node.group.get_failed());
+    for (uint8_t i = 0; i < 4; i++) {
+        EXPECT_EQ(AC_GROUP_UNIT_DONE, node.group.get_unit_state(i));
+        EXPECT_EQ(22, node.units[i]._current_ac_state.temp_target);
+    }
+    // примерно один обмен, а не четыре
+    EXPECT_LT(node.group.get_elapsed(node.now()), single * 2);
+}
+
+TEST(Group, FailedUnitsAreReported) {
+    GroupNode node;
+    node.splits[1]->mute = true;
+    node.units[3]._has_connection = false;  // команда даже не загрузится
+
+    node.group.begin(4, node.now());
+    for (uint8_t i = 0; i < 4; i++) node.send(i, 22);
+    EXPECT_EQ(AC_GROUP_UNIT_FAILED, node.group.get_unit_state(3));
+    for (unsigned i = 0; i < AC_SEQUENCE_DEFAULT_TIMEOUT * 2 && !node.group.is_complete(); i++) node.step();
+
+    ASSERT_TRUE(node.group.is_complete());
+    EXPECT_EQ(2, node.group.get_done());
+    EXPECT_EQ(2, node.group.get_failed());
+    EXPECT_EQ(AC_GROUP_UNIT_FAILED, node.group.get_unit_state(1));
+    EXPECT_EQ(1u, node.units[1].failed);
+    EXPECT_EQ(AC_GROUP_UNIT_DONE, node.group.get_unit_state(2));
+    EXPECT_EQ(0u, node.group.get_unit_time(3));
+}
+
+TEST(Group, StatusPollsDoNotCountAsCommands) {
+    GroupNode node;
+    node.units[0].group = nullptr;
+    node.splits[0]->fast_forward(30000);  // несколько опросов статуса
+    EXPECT_EQ(0u, node.units[0].done + node.units[0].failed);
+}
+
+// связка AirConGroupCommandAction без ESPHome: отчеты идут через колбэк, конец рассылки - запуск следующего действия
+struct GroupActionModel {
+    GroupNode node;
+    AirConGroupCommandRun run;
+    int num_running = 0;
+    float var = 0;
+    std::vector<float> next;  // с какими аргументами запускалось следующее действие
+
+    GroupActionModel() {
+        for (uint8_t i = 0; i < 4; i++) {
+            node.units[i].group = nullptr;
+            node.units[i].on_done = [this, i](bool success) {
+                if (run.finished(i, success, node.now())) complete();
+            };
+        }
+    }
+
+    void play(float temp) {
+        if (run.stop()) complete();
+        num_running++;
+        var = temp;
+        bool complete_now = run.start(4, node.now(), [&](uint8_t i) {
+            ac_command_t cmd = node.units[i].newCommand();
+            cmd.temp_target = temp;
+            cmd.temp_target_matter = true;
+            return node.units[i].commandSequence(&cmd);
+        });
+        if (complete_now) complete();
+    }
+
+    void complete() {
+        if (num_running == 0) return;
+        num_running--;
+        next.push_back(var);
+    }
+
+    void run_until_idle(unsigned steps) {
+        for (unsigned i = 0; i < steps && run.is_running(); i++) node.step();
+    }
+};
+
+TEST(Group, ActionCompletesOnceAfterAllUnits) {
+    GroupActionModel action;
+    action.play(22);
+    EXPECT_TRUE(action.next.empty());
+    action.run_until_idle(5000);
+
+    ASSERT_EQ(1u, action.next.size());
+    EXPECT_EQ(22, action.next[0]);
+    EXPECT_EQ(0, action.num_running);
+    EXPECT_EQ(4, action.run.get_group().get_done());
+    // дальнейшие опросы статуса рассылку не трогают
+    for (unsigned i = 0; i < 20000; i++) action.node.step();
+    EXPECT_EQ(1u, action.next.size());
+}
+
+TEST(Group, ActionRestartCompletesPreviousRun) {
+    GroupActionModel action;
+    action.play(22);
+    for (unsigned i = 0; i < 20; i++) action.node.step();
+    ASSERT_TRUE(action.run.is_running());
+
+    // новая рассылка раньше конца прежней: прежняя завершается сразу со своими аргументами
+    action.play(24);
+    ASSERT_EQ(1u, action.next.size());
+    EXPECT_EQ(22, action.next[0]);
+    EXPECT_EQ(1, action.num_running);
+
+    action.run_until_idle(AC_SEQUENCE_DEFAULT_TIMEOUT * 4);
+    ASSERT_EQ(2u, action.next.size());
+    EXPECT_EQ(24, action.next[1]);
+    EXPECT_EQ(0, action.num_running);
+    for (auto &unit : action.node.units) EXPECT_EQ(24, unit._current_ac_state.temp_target);
+    for (unsigned i = 0; i < 20000; i++) action.node.step();
+    EXPECT_EQ(2u, action.next.size());
+}
+
+TEST(Group, ActionWithNothingLoadedCompletesImmediately) {
+    GroupActionModel action;
+    for (auto &unit : action.node.units) unit._has_connection = false;
+    action.play(22);
+    ASSERT_EQ(1u, action.next.size());
+    EXPECT_FALSE(action.run.is_running());
+    EXPECT_EQ(4, action.run.get_group().get_failed());
+}
+
+TEST(Group, StoppedActionIgnoresReports) {
+    GroupActionModel action;
+    action.play(22);
+    EXPECT_TRUE(action.run.stop());  // script.stop
+    action.num_running = 0;
+    for (unsigned i = 0; i < 5000; i++) action.node.step();
+    EXPECT_TRUE(action.next.empty());
+    EXPECT_FALSE(action.run.stop());
+}
+
+TEST(Scheduler, StaggersPolls) {
+    NodeSimulation node(4, true);
+    node.run_ms(60000);
+
+    EXPECT_EQ(4, node.scheduler.get_units());
+    EXPECT_EQ(Constants::AC_STATES_REQUEST_INTERVAL / 4, node.scheduler.get_poll_spacing());
+    EXPECT_EQ(1, node.scheduler.get_max_tick_polls());  // опросы не совпадают
+    EXPECT_GT(node.scheduler.get_deferred_polls(), 0u);
+    for (auto &split : node.splits) {
+        // период опроса у каждого прежний: 60 с / 7 с, плюс стартовые запросы; последний сдвинут по фазе на 5.25 с
+        EXPECT_GE(split->status_requests, 7u);
+        EXPECT_LE(split->status_requests, 10u);
+    }
+}
+
+TEST(Scheduler, CapsWorkPerTick) {
+    NodeSimulation free_node(4, false);
+    free_node.run_ms(60000);
+    EXPECT_GT(free_node.scheduler.get_max_tick_polls(), 1);
+    EXPECT_GT(free_node.scheduler.get_max_tick_entities(), Constants::AC_SCHEDULER_TICK_ENTITIES);
+    EXPECT_GT(free_node.scheduler.get_max_tick_bytes(), Constants::AC_SCHEDULER_TICK_BYTES);
+
+    NodeSimulation node(4, true);
+    node.run_ms(60000);
+    EXPECT_LE(node.scheduler.get_max_tick_entities(), Constants::AC_SCHEDULER_TICK_ENTITIES);
+    EXPECT_LE(node.scheduler.get_max_tick_bytes(), Constants::AC_SCHEDULER_TICK_BYTES);
+    for (size_t i = 0; i < node.units.size(); i++) {
+        // отложенное все равно доходит: состояние известно, публикации были
+        EXPECT_TRUE(node.units[i]->has_live_state());
+        EXPECT_GT(node.units[i]->publishes, 0u);
+        EXPECT_FALSE(node.units[i]->_publish_deferred);
+    }
+}
+
+TEST(Scheduler, BudgetDefersWorkToNextTick) {
+    // опросы совпадают, и все упирается в бюджет прохода
+    NodeSimulation free_node(4, false);
+    NodeSimulation node(4, true);
+    node.scheduler.set_stagger_polls(false);
+    free_node.run_ms(60000);
+    node.run_ms(60000);
+    EXPECT_GT(node.scheduler.get_deferred_parses(), 0u);
+    EXPECT_GT(node.scheduler.get_deferred_publishes(), 0u);
+    EXPECT_LE(node.scheduler.get_max_tick_entities(), Constants::AC_SCHEDULER_TICK_ENTITIES);
+    EXPECT_LE(node.scheduler.get_max_tick_bytes(), Constants::AC_SCHEDULER_TICK_BYTES);
+    for (size_t i = 0; i < node.units.size(); i++) {
+        // стартовая гонка пинга и пробы одинакова с бюджетом и без; отложенный разбор новых сбоев не добавляет
+        EXPECT_EQ(free_node.units[i]->_sequences_failed, node.units[i]->_sequences_failed);
+        EXPECT_GE(node.splits[i]->status_requests, 8u);
+    }
+}
+
+TEST(Scheduler, SingleUnitIsNotHeldBack) {
+    NodeSimulation alone(1, false);
+    NodeSimulation node(1, true);
+    alone.run_ms(60000);
+    node.run_ms(60000);
+    EXPECT_EQ(0u, node.scheduler.get_deferred_polls());
+    EXPECT_EQ(0u, node.scheduler.get_deferred_publishes());
+    EXPECT_EQ(alone.splits[0]->status_requests, node.splits[0]->status_requests);
+    EXPECT_EQ(alone.units[0]->publishes, node.units[0]->publishes);
+}
+
+TEST(Scheduler, NoFreeSlots) {
+    AirConScheduler scheduler;
+    HostAirCon units[AC_SCHEDULER_MAX_UNITS + 1];
+    for (uint8_t i = 0; i < AC_SCHEDULER_MAX_UNITS; i++) EXPECT_TRUE(units[i].set_scheduler(&scheduler));
+    EXPECT_FALSE(units[AC_SCHEDULER_MAX_UNITS].set_scheduler(&scheduler));
+    EXPECT_EQ(nullptr, units[AC_SCHEDULER_MAX_UNITS].get_scheduler());
+}
+
+// узел под общим бюджетом мощности; rooms - температура в комнате у каждого сплита, цель у всех 24.5 на охлаждение
+struct BudgetNode {
+    NodeSimulation node;
+    AirConPowerBudget budget;
+    uint16_t rated;
+
+    BudgetNode(const std::vector<uint8_t> &rooms, uint16_t max_power, uint16_t rated_power, uint8_t demand = 100)
+        : node(rooms.size(), true), rated(rated_power) {
+        budget.set_max_power(max_power);
+        for (size_t i = 0; i < rooms.size(); i++) {
+            node.splits[i]->room = rooms[i];
+            node.splits[i]->demand = demand;
+            uint8_t unit = budget.attach(node.units[i].get(), rated_power);
+            node.units[i]->on_power_limit = [this, unit](uint8_t limit) { budget.set_user_limit(unit, limit); };
+        }
+    }
+
+    void run_ms(uint32_t ms) {
+        for (uint32_t i = 0; i < ms; i++) {
+            node.tick();
+            budget.loop(node.units[0]->clock.millis());
+        }
+    }
+
+    // сколько узел потребляет на самом деле, по сплитам
+    uint32_t actual_power() {
+        uint32_t total = 0;
+        for (auto &split : node.splits) total += (uint32_t)split->inverter_power() * rated / 100;
+        return total;
+    }
+
+    unsigned commands() {
+        unsigned total = 0;
+        for (auto &split : node.splits) total += split->commands;
+        return total;
+    }
+};
+
+TEST(PowerBudget, NoLimitsWhenEverythingFits) {
+    BudgetNode node({30, 27, 25}, 4500, 1500);
+    node.run_ms(60000);
+    EXPECT_EQ(3, node.budget.get_units());
+    for (uint8_t i = 0; i < 3; i++) EXPECT_EQ(100, node.budget.get_limit(i));
+    EXPECT_EQ(0u, node.commands());
+    EXPECT_EQ(4500u, node.actual_power());
+}
+
+TEST(PowerBudget, FurthestFromTargetGoesFirst) {
+    // минимум 30% на каждого - 1350 Вт, остальные 1050 Вт достаются самому дальнему от цели
+    BudgetNode node({25, 30, 27}, 2400, 1500);
+    node.run_ms(60000);
+    EXPECT_EQ(30, node.budget.get_limit(0));
+    EXPECT_EQ(100, node.budget.get_limit(1));
+    EXPECT_EQ(30, node.budget.get_limit(2));
+    EXPECT_LE(node.actual_power(), 2400u);
+    EXPECT_LE(node.budget.get_total_power(), 2400u);
+    EXPECT_EQ(2u, node.budget.get_changes());  // самому дальнему ограничение не нужно
+}
+
+TEST(PowerBudget, SatisfiedUnitKeepsItsDrawWithHeadroom) {
+    // первый уже на цели и работает на 50%, двое других далеко от нее и получают полную мощность
+    BudgetNode node({23, 30, 28}, 3900, 1500);
+    node.node.splits[0]->demand = 50;
+    node.run_ms(60000);
+    EXPECT_EQ(60, node.budget.get_limit(0));  // 50% + запас 10%, из остатка 3900 - 3000 = 900 Вт
+    EXPECT_EQ(100, node.budget.get_limit(1));
+    EXPECT_EQ(100, node.budget.get_limit(2));
+    EXPECT_LE(node.actual_power(), 3900u);
+}
+
+TEST(PowerBudget, UnsatisfiedUnitsGoBeforeHeadroom) {
+    // лимит тесный: остаток над минимумами (3000 - 1350 = 1650 Вт) целиком уходит тем, кто далеко от цели,
+    // а добравшийся до цели остается на минимуме, хоть и работает сейчас на 50%
+    BudgetNode node({23, 30, 28}, 3000, 1500);
+    node.node.splits[0]->demand = 50;
+    node.run_ms(60000);
+    EXPECT_EQ(30, node.budget.get_limit(0));
+    EXPECT_EQ(100, node.budget.get_limit(1));
+    EXPECT_EQ(70, node.budget.get_limit(2));  // 450 + 600 Вт
+    EXPECT_LE(node.actual_power(), 3000u);
+}
+
+TEST(PowerBudget, UserLimitIsLeftAlone) {
+    BudgetNode node({30, 27, 25}, 4500, 1500);
+    node.run_ms(10000);
+    ASSERT_TRUE(node.node.units[0]->powerLimitationOnSequence(60));
+    node.run_ms(60000);
+
+    // все влезают в лимит, но ограничение пользователя бюджет не снимает
+    EXPECT_EQ(60, node.budget.get_user_limit(0));
+    EXPECT_EQ(60, node.budget.get_limit(0));
+    EXPECT_EQ(1u, node.commands());
+    EXPECT_TRUE(node.node.units[0]->get_current_state().inverter_power_limitation_enable);
+    EXPECT_EQ(60, node.node.units[0]->get_current_state().inverter_power_limitation_value);
+
+    // пользователь снял ограничение сам
+    ASSERT_TRUE(node.node.units[0]->powerLimitationOffSequence());
+    node.run_ms(60000);
+    EXPECT_EQ(100, node.budget.get_user_limit(0));
+    EXPECT_EQ(2u, node.commands());
+    EXPECT_FALSE(node.node.units[0]->get_current_state().inverter_power_limitation_enable);
+}
+
+TEST(PowerBudget, UserLimitIsCeiling) {
+    // самому дальнему от цели пользователь разрешил только 60%: недобранное уходит следующему по очереди
+    BudgetNode node({25, 30, 27}, 2400, 1500);
+    node.run_ms(10000);
+    ASSERT_TRUE(node.node.units[1]->powerLimitationOnSequence(60));
+    node.run_ms(60000);
+    EXPECT_EQ(30, node.budget.get_limit(0));
+    EXPECT_EQ(60, node.budget.get_limit(1));
+    EXPECT_EQ(70, node.budget.get_limit(2));
+    EXPECT_EQ(60, node.node.units[1]->get_current_state().inverter_power_limitation_value);
+    EXPECT_LE(node.actual_power(), 2400u);
+
+}
+
+TEST(PowerBudget, ChangesAreRateLimited) {
+    BudgetNode node({30, 25}, 2000, 1500);
+    node.run_ms(30000);
+    EXPECT_EQ(100, node.budget.get_limit(0));
+    EXPECT_EQ(30, node.budget.get_limit(1));
+    unsigned commands = node.commands();
+
+    // приоритеты поменялись местами: первого сразу ограничивают, а второй ждет паузы после своего прошлого изменения
+    node.node.splits[0]->room = 25;
+    node.node.splits[1]->room = 30;
+    node.run_ms(20000);
+    EXPECT_GT(node.budget.get_held(), 0u);
+    EXPECT_EQ(30, node.node.units[0]->get_current_state().inverter_power_limitation_value);
+    EXPECT_EQ(30, node.node.units[1]->get_current_state().inverter_power_limitation_value);
+
+    node.run_ms(Constants::AC_POWER_BUDGET_HOLD_TIME);
+    EXPECT_FALSE(node.node.units[1]->get_current_state().inverter_power_limitation_enable);  // ограничение снято
+    EXPECT_EQ(commands + 2, node.commands());
+    EXPECT_LE(node.actual_power(), 2000u);
+}
+
+TEST(PowerBudget, OverBudgetCutSkipsTheHold) {
+    BudgetNode node({30, 25}, 2400, 1500);
+    node.run_ms(20000);
+    EXPECT_EQ(60, node.budget.get_limit(1));
+    EXPECT_EQ(2400u, node.actual_power());
+
+    // лимит узла снизился, когда пауза после прошлого изменения еще не прошла
+    node.budget.set_max_power(1800);
+    node.run_ms(15000);
+    EXPECT_GT(node.budget.get_over_budget(), 0u);
+    EXPECT_EQ(0u, node.budget.get_held());
+    EXPECT_EQ(90, node.node.units[0]->get_current_state().inverter_power_limitation_value);
+    EXPECT_EQ(30, node.node.units[1]->get_current_state().inverter_power_limitation_value);
+    EXPECT_LE(node.actual_power(), 1800u);
+}
+
+TEST(PowerBudget, IdleUnitsAreLeftAlone) {
+    BudgetNode node({30, 30}, 2000, 1500);
+    node.node.units[1]->_current_ac_state.power = AC_POWER_OFF;
+    node.node.splits[1]->mute = true;  // сплит молчит, его состояние так и остается выключенным
+    node.run_ms(30000);
+    EXPECT_EQ(0, node.budget.get_limit(1));
+    EXPECT_EQ(0u, node.node.splits[1]->commands);
+}
+
+TEST(PowerBudget, NoFreeSlots) {
+    AirConPowerBudget budget;
+    HostAirCon units[AC_POWER_BUDGET_MAX_UNITS + 1];
+    EXPECT_EQ(AC_POWER_BUDGET_MAX_UNITS, budget.attach(&units[0], 0));  // без паспортной мощности считать нечего
+    for (uint8_t i = 0; i < AC_POWER_BUDGET_MAX_UNITS; i++) EXPECT_EQ(i, budget.attach(&units[i], 1000));
+    EXPECT_EQ(AC_POWER_BUDGET_MAX_UNITS, budget.attach(&units[AC_POWER_BUDGET_MAX_UNITS], 1000));
+    budget.set_max_power(5000);
+    budget.set_max_power(4000);
+    budget.set_max_power(6000);
+    EXPECT_EQ(4000, budget.get_max_power());  // действует наименьший лимит
+}
+
+// флеш для счетчика энергии в памяти
+class MemoryEnergyStorage : public AirConEnergyStorage {
+   public:
+    double energy_wh = 0;
+    bool empty = true;
+    unsigned saves = 0;
+
+    bool load(double *value) override {
+        if (empty) return false;
+        *value = energy_wh;
+        return true;
+    }
+
+    bool save(double value) override {
+        energy_wh = value;
+        empty = false;
+        saves++;
+        return true;
+    }
+};
+
+// кривая условного сплита на 1.4 кВт
+void calibrate(AirConEnergyMeter &meter) {
+    meter.add_curve_point(100, 1400);
+    meter.add_curve_point(0, 40);
+    meter.add_curve_point(50, 600);
+    meter.set_fan_power(AC_REAL_FAN_LOW, 12);
+    meter.set_standby_power(3);
+}
+
+ac_state_t running_state(uint8_t inverter_power, ac_realFan fan = AC_REAL_FAN_LOW) {
+    HostAirCon ac;
+    ac_state_t state;
+    ac._clearCommand(&state);
+    state.power = AC_POWER_ON;
+    state.inverter_power = inverter_power;
+    state.realFanSpeed = fan;
+    return state;
+}
+
+TEST(Energy, CurveIsInterpolated) {
+    AirConEnergyMeter meter;
+    calibrate(meter);
+    EXPECT_EQ(3, meter.get_curve_points());
+    EXPECT_FLOAT_EQ(40 + 12, meter.estimate(running_state(0)));
+    EXPECT_FLOAT_EQ(320 + 12, meter.estimate(running_state(25)));
+    EXPECT_FLOAT_EQ(1000 + 12, meter.estimate(running_state(75)));
+    EXPECT_FLOAT_EQ(1400, meter.estimate(running_state(100, AC_REAL_FAN_OFF)));
+    EXPECT_FLOAT_EQ(320, meter.estimate(running_state(25, AC_REAL_FAN_HIGH)));  // для высокой скорости калибровки нет
+
+    ac_state_t off = running_state(0);
+    off.power = AC_POWER_OFF;
+    EXPECT_FLOAT_EQ(3, meter.estimate(off));
+
+    EXPECT_FALSE(meter.set_fan_power(AC_REAL_FAN_OFF, 5));
+    EXPECT_FALSE(meter.add_curve_point(101, 5));
+}
+
+TEST(Energy, TrapezoidBetweenStatuses) {
+    AirConEnergyMeter meter;
+    calibrate(meter);
+    meter.set_max_gap(3600000);
+    meter.sample(running_state(0, AC_REAL_FAN_OFF), 1000);        // 40 Вт
+    EXPECT_DOUBLE_EQ(0, meter.get_energy_kwh());
+    meter.sample(running_state(50, AC_REAL_FAN_OFF), 1801000);    // 600 Вт через полчаса
+    EXPECT_NEAR(0.160, meter.get_energy_kwh(), 1e-9);             // (40 + 600) / 2 * 0.5 ч
+    EXPECT_FLOAT_EQ(600, meter.get_power());
+    EXPECT_EQ(2u, meter.get_samples());
+}
+
+TEST(Energy, GapIsNotIntegrated) {
+    AirConEnergyMeter meter;
+    calibrate(meter);
+    meter.sample(running_state(100), 0);
+    meter.sample(running_state(100), 7000);
+    double before = meter.get_energy_kwh();
+    meter.sample(running_state(100), 7000 + 3 * Constants::AC_STATES_REQUEST_INTERVAL + 1);  // связи не было
+    EXPECT_DOUBLE_EQ(before, meter.get_energy_kwh());
+    EXPECT_EQ(1u, meter.get_gaps());
+}
+
+TEST(Energy, SurvivesReboot) {
+    MemoryEnergyStorage flash;
+    {
+        AirConEnergyMeter meter;
+        calibrate(meter);
+        EXPECT_FALSE(meter.begin(&flash));  // во флеше пусто
+        meter.set_save_interval(60000);
+        uint32_t now = 0;
+        for (int i = 0; i <= 20; i++, now += 7000) {
+            meter.sample(running_state(50, AC_REAL_FAN_OFF), now);
+            meter.loop(now);
+        }
+        EXPECT_EQ(2u, flash.saves);  // раз в минуту, а не на каждый пакет
+        EXPECT_EQ(AC_STORE_SAVED, meter.flush(now));
+        EXPECT_EQ(AC_STORE_NOTHING, meter.flush(now));
+        EXPECT_NEAR(600.0 * 140 / 3600, flash.energy_wh, 1e-6);
+    }
+    AirConEnergyMeter meter;
+    EXPECT_TRUE(meter.begin(&flash));
+    EXPECT_NEAR(0.6 * 140 / 3600, meter.get_energy_kwh(), 1e-9);
+
+    flash.energy_wh = -1;  // мусор во флеше
+    EXPECT_FALSE(meter.begin(&flash));
+    EXPECT_DOUBLE_EQ(0, meter.get_energy_kwh());
+}
+
+TEST(Energy, HourOnTheSimulatedSplit) {
+    HostAirCon ac;
+    SplitEmulator split(ac);
+    AirConEnergyMeter meter;
+    calibrate(meter);
+    split.demand = 25;  // сплит в эмуляторе все время на 25%, вентилятор выключен: 320 Вт
+    ac.uart.push(PING);
+
+    uint32_t first_big = 0;
+    uint32_t last_big = 0;
+    for (int s = 0; s < 3600; s++) {
+        split.fast_forward(1000);
+        if (ac.get_big_status_time() != last_big) {
+            last_big = ac.get_big_status_time();
+            if (first_big == 0) first_big = last_big;
+            meter.sample(ac.get_current_state(), last_big);
+        }
+    }
+    EXPECT_EQ(0u, meter.get_gaps());
+    EXPECT_GT(meter.get_samples(), 500u);
+    EXPECT_FLOAT_EQ(320, meter.get_power());
+    // интеграл идет от первого большого статуса до последнего, это почти весь час
+    EXPECT_GT(last_big - first_big, 3600000u - 2 * Constants::AC_STATES_REQUEST_INTERVAL);
+    EXPECT_NEAR(0.320 * (last_big - first_big) / 3600000, meter.get_energy_kwh(), 1e-6);
+}
+
+// телеметрия, похожая на настоящую: комнатная и магистрали плывут понемногу, мощность инвертора скачет
+std::vector<ac_history_sample_t> telemetry(uint32_t seconds, uint32_t step = 7) {
+    std::vector<ac_history_sample_t> samples;
+    std::mt19937 rng(1);
+    ac_history_sample_t s = {0, 235, 5, 18, 30, 60, 40, false};
+    for (uint32_t t = 0; t < seconds; t += step) {
+        s.time_s = 1000 + t;
+        if (rng() % 10 == 0) s.ambient_x10 += (rng() % 2) ? 1 : -1;
+        if (rng() % 200 == 0) s.outdoor += (rng() % 2) ? 1 : -1;
+        if (rng() % 8 == 0) s.inbound += (rng() % 2) ? 1 : -1;
+        if (rng() % 8 == 0) s.outbound += (rng() % 2) ? 1 : -1;
+        if (rng() % 15 == 0) s.compressor += (rng() % 2) ? 1 : -1;
+        if (rng() % 4 == 0) s.inverter_power = 30 + rng() % 40;
+        if (rng() % 500 == 0) s.defrost = !s.defrost;
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+bool same_sample(const ac_history_sample_t &a, const ac_history_sample_t &b) {
+    return a.time_s == b.time_s && a.ambient_x10 == b.ambient_x10 && a.outdoor == b.outdoor && a.inbound == b.inbound &&
+           a.outbound == b.outbound && a.compressor == b.compressor && a.inverter_power == b.inverter_power && a.defrost == b.defrost;
+}
+
+std::vector<ac_history_sample_t> read_all(AirConHistory &history) {
+    std::vector<ac_history_sample_t> out;
+    AirConHistory::cursor_t cursor;
+    history.rewind(cursor);
+    ac_history_sample_t sample;
+    while (history.next(cursor, &sample)) out.push_back(sample);
+    return out;
+}
+
+TEST(History, RoundTrip) {
+    AirConHistory history;
+    ASSERT_TRUE(history.begin(8192));
+    std::vector<ac_history_sample_t> samples = telemetry(3600);
+    samples[100].ambient_x10 = -150;  // мороз и большие скачки тоже проходят
+    samples[101].time_s += 100000;
+    for (size_t i = 102; i < samples.size(); i++) samples[i].time_s += 100000;
+    for (auto &s : samples) EXPECT_TRUE(history.record(s));
+
+    std::vector<ac_history_sample_t> out = read_all(history);
+    ASSERT_EQ(samples.size(), out.size());
+    for (size_t i = 0; i < samples.size(); i++) EXPECT_TRUE(same_sample(samples[i], out[i])) << i;
+    EXPECT_EQ(samples.size(), history.get_count());
+}
+
+TEST(History, UnchangedSampleTakesOneByte) {
+    AirConHistory history;
+    history.begin(1024);
+    ac_history_sample_t s = {100, 235, 5, 18, 30, 60, 40, false};
+    for (int i = 0; i < 100; i++, s.time_s += 7) history.record(s);
+    // заголовок блока 4 + опорный отсчет 12, у второго отсчета еще интервал, дальше по байту
+    EXPECT_EQ(4u + 12 + 2 + 98, history.get_bytes_used());
+}
+
+TEST(History, HoursInFewKilobytes) {
+    AirConHistory history;
+    history.begin(4096);
+    std::vector<ac_history_sample_t> samples = telemetry(8 * 3600);
+    for (auto &s : samples) history.record(s);
+
+    // в 4 КБ помещается больше четырех часов опроса раз в 7 с
+    EXPECT_GT(samples.back().time_s - history.get_oldest_time(), 4u * 3600);
+    EXPECT_LE(history.get_bytes_used(), 4096u);
+    EXPECT_LT(history.get_bytes_used(), history.get_count() * sizeof(ac_history_sample_t) / 5);
+
+    // выброшены только самые старые блоки, оставшееся - ровно хвост записанного
+    std::vector<ac_history_sample_t> out = read_all(history);
+    ASSERT_EQ(history.get_count(), out.size());
+    size_t first = samples.size() - out.size();
+    for (size_t i = 0; i < out.size(); i++) EXPECT_TRUE(same_sample(samples[first + i], out[i])) << i;
+}
+
+TEST(History, CursorSurvivesOverwrite) {
+    AirConHistory history;
+    history.begin(512);
+    std::vector<ac_history_sample_t> samples = telemetry(7 * 2000);
+    size_t written = 0;
+    for (; written < 100; written++) history.record(samples[written]);
+
+    AirConHistory::cursor_t cursor;
+    history.rewind(cursor);
+    ac_history_sample_t sample;
+    ASSERT_TRUE(history.next(cursor, &sample));
+    EXPECT_TRUE(same_sample(samples[0], sample));
+
+    // пока читатель стоит, его блок выбрасывается: чтение продолжается с самого старого из оставшихся
+    for (; written < samples.size(); written++) history.record(samples[written]);
+    ASSERT_TRUE(history.next(cursor, &sample));
+    EXPECT_EQ(history.get_oldest_time(), sample.time_s);
+    unsigned read = 1;
+    while (history.next(cursor, &sample)) read++;
+    EXPECT_EQ(history.get_count(), read);
+    EXPECT_TRUE(same_sample(samples.back(), sample));
+}
+
+TEST(History, IntervalThinsSamples) {
+    AirConHistory history;
+    history.begin(1024);
+    history.set_interval(30);
+    std::vector<ac_history_sample_t> samples = telemetry(3600);
+    unsigned recorded = 0;
+    for (auto &s : samples) recorded += history.record(s);
+    EXPECT_EQ(history.get_recorded(), recorded);
+    EXPECT_NEAR(3600 / 35, recorded, 2);  // первый отсчет, отстоящий от записанного на 30 с и больше: каждые 35 с
+}
+
+TEST(History, NoMemoryNoRecords) {
+    AirConHistory history;
+    EXPECT_FALSE(history.begin(AC_HISTORY_BLOCK_SIZE));  // нужно хотя бы два блока
+    EXPECT_FALSE(history.record(telemetry(7)[0]));
+    EXPECT_EQ(0u, history.get_count());
+    EXPECT_EQ(0, history.get_capacity());
+}
+
+TEST(History, SampleFromState) {
+    ac_state_t state = running_state(55);
+    state.temp_ambient = 23.6;
+    state.temp_outdoor = -7;
+    state.defrost = true;
+    ac_history_sample_t sample = AirConHistory::from_state(state, 12);
+    EXPECT_EQ(12u, sample.time_s);
+    EXPECT_EQ(236, sample.ambient_x10);
+    EXPECT_EQ(-7, sample.outdoor);
+    EXPECT_EQ(55, sample.inverter_power);
+    EXPECT_TRUE(sample.defrost);
+}
+
+TEST(History, SecondsSurviveMillisWrap) {
+    AirConSeconds seconds;
+    EXPECT_EQ(0u, seconds.get(0));
+    EXPECT_EQ(4294966u, seconds.get(0xFFFFFFFFu - 500));  // 4294966.795 с
+    // millis() перешел через 0: секунды идут дальше, а не начинаются заново
+    EXPECT_EQ(4294967u, seconds.get(600));
+    EXPECT_EQ(4294977u, seconds.get(10600));
+    // доли секунды не теряются между вызовами
+    for (uint32_t ms = 10700; ms <= 11600; ms += 100) seconds.get(ms);
+    EXPECT_EQ(4294978u, seconds.get(11600));
+}
+
+TEST(Stats, MedianRejectsSpike) {
+    AirConStatsChannel ch;
+    ch.set_window(5);
+    for (float v : {20.0f, 20.0f, 45.0f, 21.0f, 20.0f}) ch.add(v);
+    EXPECT_FLOAT_EQ(20, ch.get_median());
+    EXPECT_FLOAT_EQ(45, ch.get_max());
+    EXPECT_FLOAT_EQ(20, ch.get_min());
+    EXPECT_FLOAT_EQ(20, ch.get_last());
+    // при четном числе отсчетов - среднее двух средних
+    AirConStatsChannel even;
+    even.set_window(4);
+    for (float v : {23.1f, 23.5f, 22.9f, 24.0f}) even.add(v);
+    EXPECT_NEAR(23.3, even.get_median(), 1e-5);
+}
+
+TEST(Stats, WindowSlides) {
+    AirConStatsChannel ch;
+    ch.set_window(3);
+    for (float v : {-5.0f, 10.0f, 3.0f}) ch.add(v);
+    EXPECT_FLOAT_EQ(-5, ch.get_min());
+    ch.add(4);  // -5 вышел из окна
+    EXPECT_EQ(3, ch.get_count());
+    EXPECT_FLOAT_EQ(3, ch.get_min());
+    EXPECT_FLOAT_EQ(10, ch.get_max());
+    ch.add(4);
+    ch.add(4);
+    EXPECT_FLOAT_EQ(4, ch.get_max());
+
+    // окно ограничено сверху, смена окна начинает статистику заново
+    ch.set_window(100);
+    EXPECT_EQ(AC_STATS_WINDOW_MAX, ch.get_window());
+    EXPECT_EQ(0, ch.get_count());
+    for (int i = 0; i < 40; i++) ch.add(i);
+    EXPECT_EQ(AC_STATS_WINDOW_MAX, ch.get_count());
+    EXPECT_FLOAT_EQ(40 - AC_STATS_WINDOW_MAX, ch.get_min());
+}
+
+TEST(Stats, EmaFollowsStep) {
+    AirConStatsChannel ch;
+    ch.set_ema_alpha(0.5);
+    ch.add(20);
+    EXPECT_FLOAT_EQ(20, ch.get_ema());  // первый отсчет задает EMA целиком
+    ch.add(30);
+    EXPECT_FLOAT_EQ(25, ch.get_ema());
+    for (int i = 0; i < 20; i++) ch.add(30);
+    EXPECT_NEAR(30, ch.get_ema(), 0.01);
+
+    // вне (0..1] - без сглаживания
+    AirConStatsChannel raw;
+    raw.set_ema_alpha(0);
+    raw.add(20);
+    raw.add(30);
+    EXPECT_FLOAT_EQ(30, raw.get_ema());
+}
+
+TEST(Stats, OutputsAndChanges) {
+    AirConTelemetryStats stats;
+    ac_state_t state = running_state(40);
+    state.temp_ambient = 23.4;
+    state.temp_outdoor = 5;
+    EXPECT_FALSE(stats.is_used());
+    // пока отсчетов нет, наружу идет сырое значение
+    EXPECT_FLOAT_EQ(7, stats.get_output_value(AC_STATS_OUTDOOR, 7));
+
+    stats.set_window(3);
+    stats.set_output(AC_STATS_OUTDOOR, AC_STATS_MAX);
+    EXPECT_TRUE(stats.is_used());
+    EXPECT_TRUE(stats.sample(state));
+    EXPECT_FLOAT_EQ(23.4, stats.get_output_value(AC_STATS_AMBIENT, 0));
+    EXPECT_FALSE(stats.sample(state));  // ничего не изменилось
+
+    state.temp_outdoor = 9;
+    EXPECT_TRUE(stats.sample(state));
+    state.temp_outdoor = 6;
+    EXPECT_FALSE(stats.sample(state));  // максимум за окно все еще 9
+    EXPECT_FALSE(stats.sample(state));
+    EXPECT_FLOAT_EQ(9, stats.get_output_value(AC_STATS_OUTDOOR, state.temp_outdoor));
+    EXPECT_TRUE(stats.sample(state));  // а теперь 9 вышло из окна
+    EXPECT_FLOAT_EQ(6, stats.get_output_value(AC_STATS_OUTDOOR, state.temp_outdoor));
+    EXPECT_EQ(6u, stats.get_samples());
+}
+
+TEST(Stats, SpikeDoesNotFlipAction) {
+    // одиночный выброс входящей температуры: по сырым значениям экшин на один опрос уходит в ОБОГРЕВ
+    AirConTelemetryStats stats;
+    stats.set_window(3);
+    stats.set_action_value(AC_STATS_MEDIAN);
+    AirConActionEstimator raw, filtered;
+    uint32_t now = 100000;
+    unsigned raw_flips = 0;
+    unsigned filtered_flips = 0;
+    for (int i = 0; i < 10; i++) {
+        ac_state_t state = action_state(AC_POWER_ON, AC_REAL_FAN_HIGH, 26, (i == 5) ? 35 : 15);
+        stats.sample(state);
+        raw_flips += raw.update(state, false, now) && (i > 0);
+        stats.apply_action_inputs(&state);
+        filtered_flips += filtered.update(state, false, now) && (i > 0);
+        EXPECT_EQ(AC_ACTION_COOLING, filtered.get_action());
+        now += 7000;
+    }
+    EXPECT_EQ(2u, raw_flips);
+    EXPECT_EQ(0u, filtered_flips);
+}
+
+// кондиционер со статистикой, подключенной к ядру так же, как в адаптере
+class StatsAirCon : public HostAirCon {
+   public:
+    AirConTelemetryStats stats;
+    bool telemetryParsed() override { return stats.is_used() && stats.sample(_current_ac_state); }
+};
+
+TEST(Stats, SmoothedValueIsPublishedWhileRawIsSteady) {
+    for (bool smoothed : {false, true}) {
+        StatsAirCon ac;
+        SplitEmulator split(ac);
+        if (smoothed) {
+            ac.stats.set_ema_alpha(0.3);
+            ac.stats.set_output(AC_STATS_AMBIENT, AC_STATS_EMA);
+        }
+        ac.uart.push(PING);
+        split.fast_forward(60000);
+        unsigned before = ac.state_changes;
+        // комната скачком стала теплее и дальше не меняется: сырое значение меняется один раз, EMA ползет еще несколько опросов
+        split.room = 27;
+        split.fast_forward(60000);
+        unsigned changes = ac.state_changes - before;
+        if (smoothed) {
+            EXPECT_GT(changes, 3u);
+            EXPECT_NEAR(27.5, ac.stats.get_output_value(AC_STATS_AMBIENT, 0), 0.3);
+        } else {
+            EXPECT_EQ(1u, changes);
+        }
+    }
+}
+
+TEST(BusGuard, WaitsForSilenceBeforeSending) {
+    HostAirCon ac;
+    ac.set_tx_guard_time(10);
+    ac.uart.push(PING);
+    ac.run(1);  // ping принят целиком, ответ подготовлен
+
+    // пока по шине идут байты, отправка откладывается
+    for (int i = 0; i < 5; i++) {
+        ac.uart.push({0x00});
+        ac.run(1, 5);
+    }
+    EXPECT_TRUE(ac.uart.tx.empty());
+
+    ac.run(20);
+    EXPECT_EQ(PING_ANSWER, ac.uart.tx);
+    EXPECT_EQ(1u, ac._tx_deferrals);
+}
+
+TEST(Log, PacketDump) {
+    HostAirCon ac;
+    ac.uart.push(PING);
+    ac.run(20);
+    EXPECT_TRUE(ac.logger.contains("[<=] [BB 00 01 00 00 00 00 00] [43 FF]"));
+    EXPECT_TRUE(ac.logger.contains("[=>] [BB 00 01 80 01 00 08 00] 1C 27 00 00 00 00 00 00 [1E 58]"));
+}
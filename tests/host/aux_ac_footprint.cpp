@@ -0,0 +1,57 @@
+// Отчет о памяти, которую ядро aux_ac занимает на один кондиционер
+// Размеры зависят от платформы: на компьютере указатели 8 байт, на ESP8266/ESP32 - 4, поэтому там все меньше.
+// Точные цифры для прошивки печатает dump_config() (строка "RAM per instance").
+//   aux_ac_footprint [--budget N]   код возврата 1, если ядро больше N байт
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_hal.h"
+
+using namespace aux_ac_host;
+
+namespace {
+
+class FootprintAirCon : public AirConCore {
+   public:
+    void stateChanged() override {}
+
+    void print() {
+        footprint_t fp = get_footprint();
+        printf("aux_ac footprint, bytes (pointer size %zu):\n", sizeof(void *));
+        printf("  %-28s %6u\n", "AirConCore", fp.core);
+        printf("  %-28s %6u\n", "  _inPacket + _outPacket", fp.packets);
+        printf("  %-28s %6u  (%u steps x %zu)\n", "  _sequence", fp.sequence, AC_SEQUENCE_MAX_LEN, sizeof(_sequence[0]));
+        printf("  %-28s %6u\n", "  _current_ac_state", fp.state);
+        printf("  %-28s %6zu\n", "  _last_raw_data", sizeof(_last_raw_data));
+        printf("  %-28s %6zu\n", "  _action_estimator", sizeof(_action_estimator));
+        printf("  %-28s %6zu  (only after sendTestPacket)\n", "_outTestPacket on demand", sizeof(packet_t));
+        // адаптер AirCon на компьютере не собирается (ему нужен ESPHome), поэтому здесь только его части из ядра;
+        // Climate, Component и датчики ESPHome добавляет сверху, итог по прошивке - в dump_config()
+        printf("adapter (AirCon) parts from the core:\n");
+        printf("  %-28s %6zu  (PRESETS_SAVING only)\n", "_presets", sizeof(AirConPresetStore));
+        printf("  %-28s %6zu\n", "_snapshot", sizeof(AirConStateSnapshot));
+        printf("  %-28s %6zu\n", "_energy", sizeof(AirConEnergyMeter));
+        printf("  %-28s %6zu  (+ history.size bytes on the heap)\n", "_history + cursor + clock",
+               sizeof(AirConHistory) + sizeof(AirConHistory::cursor_t) + sizeof(AirConSeconds));
+        printf("  %-28s %6zu  (pointer; object only with statistics)\n", "_stats", sizeof(AirConTelemetryStats *));
+        printf("  %-28s %6zu  (on demand)\n", "AirConTelemetryStats", sizeof(AirConTelemetryStats));
+    }
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned budget = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) budget = atoi(argv[++i]);
+    }
+
+    FootprintAirCon ac;
+    ac.print();
+    if (budget > 0 && sizeof(AirConCore) > budget) {
+        printf("AirConCore is %zu bytes, budget is %u bytes\n", sizeof(AirConCore), budget);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Фаззинг приемника и парсера ядра aux_ac
+// Произвольный поток байт проходит через idle -> receiving -> parsing -> контроль последовательностей.
+//
+// clang: собирается как обычная цель libFuzzer (-fsanitize=fuzzer,address,undefined).
+// gcc: libFuzzer нет, поэтому собирается со своим main(): прогоняет корпус и его случайные мутации
+// под ASan/UBSan. Перед каждым прогоном вход пишется в fuzz-current.bin: если санитайзер уронит
+// процесс, в этом файле останется упавший вход, его надо перенести в корпус и в регрессионные тесты.
+//   aux_ac_fuzz [-runs=N] [-seed=N] <файл или папка корпуса>...
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "host_hal.h"
+
+using namespace aux_ac_host;
+
+namespace {
+
+// лог, который форматирует сообщения, но никуда их не выводит: так проверяются и аргументы форматов
+class FormatOnlyLogger : public AirConLogger {
+   public:
+    void logv(uint8_t, unsigned int, const char *format, va_list args) override {
+        char buf[AC_DEBUG_PACKET_STR_LEN];
+        vsnprintf(buf, sizeof(buf), format, args);
+    }
+};
+
+const std::vector<uint8_t> PING = {0xBB, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0xFF};
+
+}  // namespace
+
+/** формат входа:
+ *   байт 0 - флаги: бит 0 - сначала ping (есть связь и стартовая последовательность),
+ *            бит 1 - загрузить последовательность команды, бит 2 - таймаут пакета 600 мс вместо 150
+ *   байт 1 - размер порций, которыми байты попадают в UART (1..16), и шаг часов между порциями (0..15 мс)
+ *   остальное - поток байт со стороны кондиционера
+ **/
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size < 2) return 0;
+    uint8_t flags = data[0];
+    size_t chunk = (data[1] & 0x0F) + 1;
+    uint32_t step_ms = data[1] >> 4;
+    data += 2;
+    size -= 2;
+
+    static FormatOnlyLogger logger;
+    HostAirCon ac;
+    ac.initCore(&ac.uart, &ac.clock, &logger);
+    if (flags & 0x04) ac.set_packet_timeout(Constants::AC_PACKET_TIMEOUT_MAX);
+
+    if (flags & 0x01) {
+        ac.uart.push(PING);
+        ac.run(20);
+    }
+    if (flags & 0x02) {
+        ac_command_t cmd;
+        ac._clearCommand(&cmd);
+        cmd.power = AC_POWER_ON;
+        cmd.temp_target = 23;
+        cmd.temp_target_matter = true;
+        ac.commandSequence(&cmd);
+    }
+
+    for (size_t pos = 0; pos < size; pos += chunk) {
+        size_t n = (size - pos < chunk) ? size - pos : chunk;
+        ac.uart.push(std::vector<uint8_t>(data + pos, data + pos + n));
+        ac.run(2, step_ms);
+    }
+    // дорабатываем все, что осталось, вместе с таймаутами приема и последовательностей
+    ac.run(AC_SEQUENCE_DEFAULT_TIMEOUT * 2);
+    return 0;
+}
+
+#if !defined(AUX_AC_LIBFUZZER)
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <string>
+
+namespace {
+
+void run_one(const std::vector<uint8_t> &input) {
+    FILE *f = fopen("fuzz-current.bin", "wb");
+    if (f != nullptr) {
+        fwrite(input.data(), 1, input.size(), f);
+        fclose(f);
+    }
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+}
+
+bool read_file(const std::string &path, std::vector<uint8_t> &out) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) return false;
+    out.clear();
+    uint8_t buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+void collect(const std::string &path, std::vector<std::vector<uint8_t>> &corpus) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return;
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) return;
+        while (struct dirent *e = readdir(dir)) {
+            if (e->d_name[0] == '.') continue;
+            collect(path + "/" + e->d_name, corpus);
+        }
+        closedir(dir);
+        return;
+    }
+    std::vector<uint8_t> input;
+    if (read_file(path, input)) corpus.push_back(input);
+}
+
+// простой генератор: воспроизводимые прогоны при одинаковом -seed
+uint32_t rng_state = 1;
+uint32_t rnd(uint32_t n) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return n ? rng_state % n : 0;
+}
+
+// мутации в духе libFuzzer: замена, вставка и удаление байт, склейка с другим входом корпуса
+std::vector<uint8_t> mutate(const std::vector<std::vector<uint8_t>> &corpus) {
+    std::vector<uint8_t> input = corpus[rnd(corpus.size())];
+    unsigned count = 1 + rnd(4);
+    for (unsigned i = 0; i < count; i++) {
+        switch (rnd(6)) {
+            case 0:  // бит
+                if (!input.empty()) input[rnd(input.size())] ^= 1 << rnd(8);
+                break;
+            case 1:  // байт, в том числе интересные для протокола значения
+                if (!input.empty()) {
+                    static const uint8_t interesting[] = {0x00, 0x01, 0x02, 0x04, 0x07, 0x0F, 0x11, 0x18, 0x19, 0x1A, 0x21, 0x2C, 0x7F, 0x80, 0xBB, 0xFF};
+                    input[rnd(input.size())] = rnd(2) ? interesting[rnd(sizeof(interesting))] : rnd(256);
+                }
+                break;
+            case 2:  // вставка
+                input.insert(input.begin() + rnd(input.size() + 1), (uint8_t)rnd(256));
+                break;
+            case 3:  // удаление
+                if (input.size() > 2) input.erase(input.begin() + rnd(input.size()));
+                break;
+            case 4: {  // склейка
+                const std::vector<uint8_t> &other = corpus[rnd(corpus.size())];
+                if (other.size() > 2) input.insert(input.end(), other.begin() + 2, other.end());
+                break;
+            }
+            case 5:  // обрезка
+                if (input.size() > 2) input.resize(2 + rnd(input.size() - 1));
+                break;
+        }
+    }
+    if (input.size() > 512) input.resize(512);
+    return input;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned runs = 0;
+    std::vector<std::vector<uint8_t>> corpus;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) runs = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "-seed=", 6) == 0) rng_state = atoi(argv[i] + 6) | 1;
+        else collect(argv[i], corpus);
+    }
+    if (corpus.empty()) corpus.push_back({0x01, 0x00});
+
+    for (const std::vector<uint8_t> &input : corpus) run_one(input);
+    for (unsigned i = 0; i < runs; i++) run_one(mutate(corpus));
+
+    remove("fuzz-current.bin");
+    printf("fuzz: %zu corpus inputs and %u mutations done\n", corpus.size(), runs);
+    return 0;
+}
+#endif  // !AUX_AC_LIBFUZZER
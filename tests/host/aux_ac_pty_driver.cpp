@@ -0,0 +1,259 @@
+// Сквозной прогон протокольного ядра aux_ac через настоящий последовательный порт (или pty симулятора)
+// Подключается к сплиту, ждет стартовую последовательность, отправляет серию команд и печатает
+// задержку и пропускную способность. Код возврата 0, если провалов не больше --max-failures.
+// ui_latency_ms - через сколько после команды опубликовано состояние с новыми параметрами (то, что видит пользователь);
+// с --optimistic ядро публикует команду сразу, без него - после подтверждения сплитом.
+// с --trust-echo последовательность команды заканчивается на эхе сплита, без финального запроса статуса.
+// собранный с AC_LOOP_PROFILER (цель aux_ac_pty_driver_prof) печатает еще и время обработчиков автомата, мкс:
+// так меряется, сколько loop() занят отправкой пакета.
+//   aux_ac_pty_driver <port> [--commands N] [--max-failures N] [--timeout S] [--optimistic] [--trust-echo] [-v]
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include "aux_ac_core.h"
+
+using namespace esphome::aux_ac;
+
+namespace {
+
+// UART поверх файлового дескриптора
+class PosixUart : public AirConUart {
+   public:
+    uint32_t rx_bytes = 0;
+    uint32_t tx_bytes = 0;
+
+    bool open_port(const char *path) {
+        _fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0) return false;
+        struct termios tio;
+        if (tcgetattr(_fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            cfsetispeed(&tio, B4800);
+            cfsetospeed(&tio, B4800);
+            tio.c_cflag |= PARENB | CLOCAL | CREAD;
+            tio.c_cflag &= ~PARODD;
+            tcsetattr(_fd, TCSANOW, &tio);
+        }
+        return true;
+    }
+
+    int available() override {
+        _fill();
+        return (int)_rx.size();
+    }
+
+    int peek() override {
+        _fill();
+        return _rx.empty() ? -1 : _rx.front();
+    }
+
+    int read() override {
+        _fill();
+        if (_rx.empty()) return -1;
+        uint8_t data = _rx.front();
+        _rx.pop_front();
+        return data;
+    }
+
+    void write_array(const uint8_t *data, size_t len) override {
+        while (len > 0) {
+            ssize_t n = ::write(_fd, data, len);
+            if (n < 0) {
+                usleep(100);
+                continue;
+            }
+            data += n;
+            len -= n;
+            tx_bytes += n;
+        }
+    }
+
+   private:
+    int _fd = -1;
+    std::deque<uint8_t> _rx;
+
+    void _fill() {
+        uint8_t buf[64];
+        ssize_t n = ::read(_fd, buf, sizeof(buf));
+        if (n <= 0) return;
+        _rx.insert(_rx.end(), buf, buf + n);
+        rx_bytes += n;
+    }
+};
+
+class SteadyClock : public AirConClock {
+   public:
+    uint32_t millis() override { return (uint32_t)(_now() / 1000); }
+    uint32_t micros() override { return (uint32_t)_now(); }
+
+   private:
+    uint64_t _now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+class ConsoleLogger : public AirConLogger {
+   public:
+    uint8_t level = ESPHOME_LOG_LEVEL_WARN;
+
+    void logv(uint8_t lvl, unsigned int line, const char *format, va_list args) override {
+        if (lvl > level) return;
+        printf("[%u][AirCon:%u] ", lvl, line);
+        vprintf(format, args);
+        printf("\n");
+    }
+};
+
+class DriverAirCon : public AirConCore {
+   public:
+    unsigned state_changes = 0;
+    // ожидаемое в публикации состояние и момент, когда оно опубликовано
+    bool waiting = false;
+    float want_temp = 0;
+    ac_mode want_mode = AC_MODE_UNTOUCHED;
+    uint32_t shown_ms = 0;
+
+    void stateChanged() override {
+        state_changes++;
+        if (!waiting) return;
+        ac_state_t state = _stateForPublish();
+        if (state.temp_target == want_temp && state.mode == want_mode) {
+            shown_ms = _millis();
+            waiting = false;
+        }
+    }
+
+    using AirConCore::_clearCommand;
+    using AirConCore::_current_ac_state;
+    using AirConCore::_doStateMachine;
+    using AirConCore::_sequences_done;
+    using AirConCore::_sequences_failed;
+    using AirConCore::_tx_collisions;
+    using AirConCore::_tx_deferrals;
+#if defined(AC_LOOP_PROFILER)
+    using AirConCore::_profiler;
+#endif
+};
+
+DriverAirCon ac;
+PosixUart uart;
+SteadyClock steady;
+ConsoleLogger logger;
+
+// крутит конечный автомат, пока условие не выполнится или не выйдет время
+template <typename Pred>
+bool spin_until(Pred done, uint32_t timeout_ms) {
+    uint32_t start = steady.millis();
+    while (!done()) {
+        if (steady.millis() - start >= timeout_ms) return false;
+        ac._doStateMachine();
+        usleep(200);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <port> [--commands N] [--max-failures N] [--timeout S] [--optimistic] [--trust-echo] [-v]\n", argv[0]);
+        return 2;
+    }
+    const char *port = argv[1];
+    unsigned commands = 10;
+    unsigned max_failures = 0;
+    uint32_t timeout_ms = 10000;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--commands" && i + 1 < argc) commands = atoi(argv[++i]);
+        else if (arg == "--max-failures" && i + 1 < argc) max_failures = atoi(argv[++i]);
+        else if (arg == "--timeout" && i + 1 < argc) timeout_ms = atoi(argv[++i]) * 1000;
+        else if (arg == "--optimistic") ac.set_optimistic(true);
+        else if (arg == "--trust-echo") ac.set_trust_echo(true);
+        else if (arg == "-v") logger.level = ESPHOME_LOG_LEVEL_DEBUG;
+    }
+
+    if (!uart.open_port(port)) {
+        fprintf(stderr, "driver: can't open %s: %s\n", port, strerror(errno));
+        return 2;
+    }
+    ac.initCore(&uart, &steady, &logger);
+
+    // подключение: ping от сплита и стартовая последовательность со статусами
+    uint32_t t0 = steady.millis();
+    if (!spin_until([] { return ac.get_has_connection() && !ac.hasSequence() && ac.state_changes > 0; }, timeout_ms)) {
+        fprintf(stderr, "driver: no connection to the split within %u ms\n", timeout_ms);
+        return 1;
+    }
+    printf("driver: connected, startup took %u ms\n", steady.millis() - t0);
+
+    unsigned ok = 0, failed = 0, wrong = 0;
+    uint32_t lat_min = UINT32_MAX, lat_max = 0, lat_sum = 0;
+    uint32_t ui_min = UINT32_MAX, ui_max = 0, ui_sum = 0;
+    uint32_t series_start = steady.millis();
+    for (unsigned i = 0; i < commands; i++) {
+        ac_command_t cmd;
+        ac._clearCommand(&cmd);
+        cmd.power = AC_POWER_ON;
+        cmd.mode = (i % 2) ? AC_MODE_HEAT : AC_MODE_COOL;
+        cmd.temp_target = 18 + (i % 10) + 0.5 * (i % 2);
+        cmd.temp_target_matter = true;
+        float requested = cmd.temp_target;
+
+        uint32_t failed_before = ac._sequences_failed;
+        ac.waiting = true;
+        ac.want_temp = requested;
+        ac.want_mode = cmd.mode;
+        uint32_t start = steady.millis();
+        if (!ac.commandSequence(&cmd)) {
+            failed++;
+            continue;
+        }
+        bool finished = spin_until([] { return !ac.hasSequence(); }, timeout_ms);
+        uint32_t latency = steady.millis() - start;
+
+        if (!finished || ac._sequences_failed != failed_before) {
+            failed++;
+            // запоздавшие ответы сплита на прерванную последовательность не должны попасть в следующую
+            spin_until([] { return false; }, 1000);
+            continue;
+        }
+        if (ac._current_ac_state.temp_target != requested || ac._current_ac_state.mode != cmd.mode) wrong++;
+        ok++;
+        lat_sum += latency;
+        if (latency < lat_min) lat_min = latency;
+        if (latency > lat_max) lat_max = latency;
+        uint32_t ui = ac.waiting ? latency : ac.shown_ms - start;
+        ac.waiting = false;
+        ui_sum += ui;
+        if (ui < ui_min) ui_min = ui;
+        if (ui > ui_max) ui_max = ui;
+    }
+    uint32_t series_ms = steady.millis() - series_start;
+
+    printf("driver: {\"commands\": %u, \"ok\": %u, \"failed\": %u, \"wrong_state\": %u, ", commands, ok, failed, wrong);
+    if (ok > 0) printf("\"latency_ms\": {\"min\": %u, \"avg\": %u, \"max\": %u}, ", lat_min, lat_sum / ok, lat_max);
+    if (ok > 0) printf("\"ui_latency_ms\": {\"min\": %u, \"avg\": %u, \"max\": %u}, ", ui_min, ui_sum / ok, ui_max);
+    printf("\"commands_per_s\": %.2f, \"rx_bytes\": %u, \"tx_bytes\": %u, \"tx_deferred\": %u, \"tx_collisions\": %u}\n",
+           series_ms ? 1000.0 * ok / series_ms : 0.0, uart.rx_bytes, uart.tx_bytes, ac._tx_deferrals, ac._tx_collisions);
+
+#if defined(AC_LOOP_PROFILER)
+    printf("driver: {\"profiler_us\": {");
+    for (uint8_t i = 0; i < AC_PROF_COUNT; i++) {
+        const ac_profiler_stat_t &stat = ac._profiler[i];
+        printf("%s\"%s\": {\"min\": %u, \"avg\": %u, \"max\": %u, \"calls\": %u}", i ? ", " : "", AC_PROFILER_POINT_NAMES[i],
+               stat.calls ? stat.min_us : 0, stat.calls ? (uint32_t)(stat.total_us / stat.calls) : 0, stat.max_us, stat.calls);
+    }
+    printf("}}\n");
+#endif
+
+    if (wrong > 0 || failed > max_failures || ok == 0) return 1;
+    return 0;
+}
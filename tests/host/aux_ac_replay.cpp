@@ -0,0 +1,275 @@
+// Воспроизведение записанных логов HOLMES через протокольное ядро aux_ac
+// Берет текстовый лог ESPHome с пакетами в формате _debugPrintPacket() или сырой дамп линии,
+// прогоняет входящие пакеты через приемник, парсер и последовательности с исходными интервалами
+// по виртуальным часам (без реального ожидания) и печатает публикации состояния.
+//   aux_ac_replay [-q] [--raw] <лог>...
+//     -q     только итоговая сводка
+//     --raw  файлы - сырые байты с линии (например, cat /dev/ttyUSB0 > dump.bin), идут со скоростью 4800 бод
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "host_hal.h"
+
+using namespace aux_ac_host;
+
+namespace {
+
+// пакет из лога
+struct captured_packet_t {
+    uint32_t msec;
+    bool incoming;
+    std::vector<uint8_t> data;
+};
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/** разбирает строку лога с пакетом, например
+ *   [12:00:01][D][AirCon:1352]: 0000123456: [<=] [BB 00 01 00 00 00 00 00] [43 FF]
+ * скобки и разделители берутся любые (см. HOLMES_x), важны только метка направления,
+ * 10-значное время перед ней и байты в виде пар шестнадцатеричных цифр
+ **/
+bool parse_line(const char *line, captured_packet_t &packet) {
+    const char *marker = strstr(line, "[<=]");
+    packet.incoming = true;
+    if (marker == nullptr) {
+        marker = strstr(line, "[=>]");
+        packet.incoming = false;
+    }
+    if (marker == nullptr) return false;
+
+    // время: цифры перед ": " слева от метки
+    const char *p = marker;
+    while (p > line && (p[-1] == ' ' || p[-1] == ':')) p--;
+    const char *digits_end = p;
+    while (p > line && p[-1] >= '0' && p[-1] <= '9') p--;
+    if (p == digits_end) return false;
+    packet.msec = (uint32_t)strtoul(p, nullptr, 10);
+
+    packet.data.clear();
+    for (p = marker + 4; *p; p++) {
+        int hi = hex_value(p[0]);
+        if (hi < 0) continue;
+        int lo = hex_value(p[1]);
+        if (lo < 0 || hex_value(p[2]) >= 0) break;  // не байт - конец пакета (например, хвост строки лога)
+        packet.data.push_back((uint8_t)(hi << 4 | lo));
+        p++;
+    }
+    return !packet.data.empty();
+}
+
+bool load_text_log(const char *path, std::vector<captured_packet_t> &packets) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) return false;
+    char line[1024];
+    captured_packet_t packet;
+    while (fgets(line, sizeof(line), f)) {
+        if (!parse_line(line, packet)) continue;
+        // один и тот же пакет ядро выводит несколько раз на разных уровнях лога
+        if (!packets.empty()) {
+            const captured_packet_t &last = packets.back();
+            if (last.msec == packet.msec && last.incoming == packet.incoming && last.data == packet.data) continue;
+        }
+        packets.push_back(packet);
+    }
+    fclose(f);
+    return true;
+}
+
+bool load_raw_dump(const char *path, std::vector<uint8_t> &bytes) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) return false;
+    uint8_t buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+const char *mode_name(ac_mode mode) {
+    switch (mode) {
+        case AC_MODE_AUTO: return "AUTO";
+        case AC_MODE_COOL: return "COOL";
+        case AC_MODE_DRY: return "DRY";
+        case AC_MODE_HEAT: return "HEAT";
+        case AC_MODE_FAN: return "FAN";
+        default: return "?";
+    }
+}
+
+const char *fan_name(ac_fanspeed fan) {
+    switch (fan) {
+        case AC_FANSPEED_HIGH: return "HIGH";
+        case AC_FANSPEED_MEDIUM: return "MEDIUM";
+        case AC_FANSPEED_LOW: return "LOW";
+        case AC_FANSPEED_AUTO: return "AUTO";
+        default: return "?";
+    }
+}
+
+// ядро, которое записывает каждую публикацию состояния в виде списка изменившихся полей
+class ReplayAirCon : public HostAirCon {
+   public:
+    bool quiet = false;
+    unsigned publishes = 0;
+    unsigned transitions = 0;
+
+    ReplayAirCon() { _clearCommand(&_published); }
+
+    void stateChanged() override {
+        publishes++;
+        std::string diff;
+        char buf[64];
+#define REPLAY_FIELD(cond, ...)                              \
+    if (first || (cond)) {                                   \
+        snprintf(buf, sizeof(buf), __VA_ARGS__);             \
+        diff += buf;                                         \
+    }
+        const ac_state_t &s = _current_ac_state;
+        const ac_state_t &o = _published;
+        bool first = (publishes == 1);
+        REPLAY_FIELD(s.power != o.power, " power=%s", s.power == AC_POWER_ON ? "ON" : "OFF");
+        REPLAY_FIELD(s.mode != o.mode, " mode=%s", mode_name(s.mode));
+        REPLAY_FIELD(s.temp_target != o.temp_target, " target=%.1f", s.temp_target);
+        REPLAY_FIELD(s.fanSpeed != o.fanSpeed, " fan=%s", fan_name(s.fanSpeed));
+        REPLAY_FIELD(s.fanTurbo != o.fanTurbo, " turbo=%s", s.fanTurbo == AC_FANTURBO_ON ? "ON" : "OFF");
+        REPLAY_FIELD(s.fanMute != o.fanMute, " mute=%s", s.fanMute == AC_FANMUTE_ON ? "ON" : "OFF");
+        REPLAY_FIELD(s.sleep != o.sleep, " sleep=%s", s.sleep == AC_SLEEP_ON ? "ON" : "OFF");
+        REPLAY_FIELD(s.louver.louver_v != o.louver.louver_v, " vlouver=%02X", s.louver.louver_v);
+        REPLAY_FIELD(s.louver.louver_h != o.louver.louver_h, " hlouver=%02X", s.louver.louver_h);
+        REPLAY_FIELD(s.display != o.display, " display=%s", s.display == AC_DISPLAY_ON ? "ON" : "OFF");
+        REPLAY_FIELD(s.temp_ambient != o.temp_ambient, " ambient=%.1f", s.temp_ambient);
+        REPLAY_FIELD(s.temp_outdoor != o.temp_outdoor, " outdoor=%d", s.temp_outdoor);
+        REPLAY_FIELD(s.temp_inbound != o.temp_inbound, " inbound=%d", s.temp_inbound);
+        REPLAY_FIELD(s.temp_outbound != o.temp_outbound, " outbound=%d", s.temp_outbound);
+        REPLAY_FIELD(s.temp_compressor != o.temp_compressor, " compressor=%d", s.temp_compressor);
+        REPLAY_FIELD(s.realFanSpeed != o.realFanSpeed, " real_fan=%u", s.realFanSpeed);
+        REPLAY_FIELD(s.inverter_power != o.inverter_power, " inverter_power=%u", s.inverter_power);
+        REPLAY_FIELD(s.defrost != o.defrost, " defrost=%s", s.defrost ? "ON" : "OFF");
+        REPLAY_FIELD(s.inverter_power_limitation_enable != o.inverter_power_limitation_enable, " power_limit=%s",
+                     s.inverter_power_limitation_enable ? "ON" : "OFF");
+        REPLAY_FIELD(s.inverter_power_limitation_value != o.inverter_power_limitation_value, " power_limit_value=%u",
+                     s.inverter_power_limitation_value);
+#undef REPLAY_FIELD
+        if (!diff.empty()) transitions++;
+        _published = _current_ac_state;
+        if (!quiet) printf("%010u publish:%s\n", _millis(), diff.c_str());
+    }
+
+    // крутит автомат до момента msec: пока идет обмен - по 1 мс, в тишине - прыжком
+    void advance_to(uint32_t msec) {
+        while ((int32_t)(msec - _millis()) > 0) {
+            uint32_t step = busy() ? 1 : msec - _millis();
+            run(1, step);
+        }
+    }
+
+    // дорабатывает все, что осталось после последнего пакета
+    void drain() { advance_to(_millis() + AC_SEQUENCE_DEFAULT_TIMEOUT * 2); }
+
+   private:
+    ac_state_t _published;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    bool quiet = false;
+    bool raw = false;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) quiet = true;
+        else if (strcmp(argv[i], "--raw") == 0) raw = true;
+        else files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "usage: %s [-q] [--raw] <log>...\n", argv[0]);
+        return 2;
+    }
+
+    unsigned total_in = 0, total_out = 0, total_publishes = 0, total_transitions = 0, total_crc_errors = 0;
+    size_t total_bytes = 0;
+    uint64_t total_span_ms = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+
+    for (const char *path : files) {
+        ReplayAirCon ac;
+        ac.quiet = quiet;
+        ac.set_tx_guard_time(0);
+        if (!quiet) printf("== %s\n", path);
+
+        uint32_t start = 0, finish = 0;
+        unsigned in = 0, out = 0;
+        size_t bytes_in = 0;
+        if (raw) {
+            std::vector<uint8_t> bytes;
+            if (!load_raw_dump(path, bytes)) {
+                fprintf(stderr, "replay: can't read %s\n", path);
+                return 2;
+            }
+            // 4800 бод, 8E1: 11 бит на байт, около 2.3 мс
+            start = ac.clock.millis();
+            for (size_t i = 0; i < bytes.size(); i++) {
+                ac.advance_to(start + (uint32_t)(i * 11 * 1000 / 4800));
+                ac.uart.rx.push_back(bytes[i]);
+            }
+            bytes_in = bytes.size();
+        } else {
+            std::vector<captured_packet_t> packets;
+            if (!load_text_log(path, packets)) {
+                fprintf(stderr, "replay: can't read %s\n", path);
+                return 2;
+            }
+            if (!packets.empty()) {
+                // виртуальные часы начинают с момента первого пакета лога
+                start = packets.front().msec;
+                ac.clock.us = (uint64_t)start * 1000;
+            }
+            for (const captured_packet_t &packet : packets) {
+                if (!packet.incoming) {
+                    out++;
+                    continue;
+                }
+                ac.advance_to(packet.msec);
+                ac.uart.push(packet.data);
+                bytes_in += packet.data.size();
+                in++;
+            }
+        }
+        ac.drain();
+        finish = ac.clock.millis();
+
+        unsigned crc_errors = 0;
+        for (const std::string &l : ac.logger.lines)
+            if (l.find("CRC fail") != std::string::npos) crc_errors++;
+
+        if (!quiet) {
+            if (raw) printf("   incoming bytes: %zu, sent by core: %zu bytes\n", bytes_in, ac.uart.tx.size());
+            else printf("   incoming packets: %u, outgoing in log: %u, sent by core: %zu bytes\n", in, out, ac.uart.tx.size());
+            printf("   publishes: %u, state transitions: %u, CRC errors: %u, log span: %u ms\n", ac.publishes, ac.transitions,
+                   crc_errors, finish - start);
+        }
+        total_in += in;
+        total_bytes += bytes_in;
+        total_out += out;
+        total_publishes += ac.publishes;
+        total_transitions += ac.transitions;
+        total_crc_errors += crc_errors;
+        total_span_ms += finish - start;
+    }
+
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+    printf("replay: files %zu, incoming packets %u, outgoing in logs %u, bytes %zu, publishes %u, transitions %u, CRC errors %u\n",
+           files.size(), total_in, total_out, total_bytes, total_publishes, total_transitions, total_crc_errors);
+    printf("replay: %.1f s of traffic replayed in %.1f ms (%.0fx)\n", total_span_ms / 1000.0, wall_ms,
+           wall_ms > 0 ? total_span_ms / wall_ms : 0.0);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# Сравнивает результаты бенчмарков (JSON Google Benchmark) с базовыми из benchmark_baseline.json.
+# Код возврата 1, если какой-то бенчмарк стал медленнее базового больше чем в --threshold раз.
+# Сравнение только справочное (код возврата 0), если задан --advisory или если замеры несравнимы:
+# библиотека бенчмарков собрана как debug или база снята на другом железе.
+#   python3 compare_benchmarks.py benchmark_baseline.json current.json [--threshold 1.5] [--advisory]
+import argparse
+import json
+import sys
+
+
+def createParser():
+    parser = argparse.ArgumentParser(description='''Compare aux_ac benchmark results with the stored baseline.''', add_help=False)
+    parent_group = parser.add_argument_group(title='Params')
+    parent_group.add_argument('--help', '-h', action='help', help='show this help message and exit')
+    parent_group.add_argument('baseline', help='baseline JSON (Google Benchmark output format)')
+    parent_group.add_argument('current', help='current JSON (Google Benchmark output format)')
+    parent_group.add_argument('--threshold', type=float, default=1.5, help='allowed slowdown ratio (default 1.5)')
+    parent_group.add_argument('--advisory', action='store_true', help='only report slowdowns, always exit with 0')
+    return parser
+
+
+def load(path):
+    # при --benchmark_repetitions берется медиана повторов, иначе - единственный прогон
+    with open(path) as f:
+        data = json.load(f)
+    result = {}
+    for b in data['benchmarks']:
+        if b.get('run_type') == 'aggregate':
+            if b.get('aggregate_name') == 'median':
+                result[b['run_name']] = b['cpu_time']
+        elif b['name'] not in result:
+            result[b['name']] = b['cpu_time']
+    return data.get('context', {}), result
+
+
+# причины, по которым цифры двух прогонов нельзя сравнивать строго
+def incomparable(base_ctx, cur_ctx):
+    reasons = []
+    for name, ctx in (('baseline', base_ctx), ('current', cur_ctx)):
+        if ctx.get('library_build_type') == 'debug':
+            reasons.append('%s was run against a debug build of the benchmark library' % name)
+    for key in ('num_cpus', 'mhz_per_cpu'):
+        if base_ctx.get(key) != cur_ctx.get(key):
+            reasons.append('%s differs: baseline %s, current %s' % (key, base_ctx.get(key), cur_ctx.get(key)))
+    return reasons
+
+
+def main():
+    args = createParser().parse_args()
+    base_ctx, baseline = load(args.baseline)
+    cur_ctx, current = load(args.current)
+    regressions = 0
+    print('%-48s %12s %12s %8s' % ('benchmark', 'baseline, ns', 'current, ns', 'ratio'))
+    for name, base in sorted(baseline.items()):
+        if name not in current:
+            print('%-48s %12.1f %12s %8s' % (name, base, '-', 'missing'))
+            continue
+        ratio = current[name] / base if base else 1.0
+        mark = ''
+        if ratio > args.threshold:
+            mark = '  <-- slower'
+            regressions += 1
+        print('%-48s %12.1f %12.1f %8.2f%s' % (name, base, current[name], ratio, mark))
+    for name in sorted(set(current) - set(baseline)):
+        print('%-48s %12s %12.1f %8s' % (name, '-', current[name], 'new'))
+
+    reasons = incomparable(base_ctx, cur_ctx)
+    for reason in reasons:
+        print('note: %s' % reason)
+    if regressions:
+        print('%d benchmark(s) more than %.2fx slower than the baseline' % (regressions, args.threshold))
+    if args.advisory or reasons:
+        if regressions:
+            print('advisory comparison, not failing')
+        return 0
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
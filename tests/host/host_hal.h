@@ -0,0 +1,301 @@
+// Заглушки интерфейсов ядра aux_ac для сборки и тестов на компьютере
+// UART - очереди байт в памяти, часы - ручные, лог складывается в вектор строк
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aux_ac_core.h"
+
+namespace aux_ac_host {
+
+using namespace esphome::aux_ac;
+
+// UART: rx - то, что "прислал" кондиционер, tx - то, что отправило ядро
+class FakeUart : public AirConUart {
+   public:
+    std::deque<uint8_t> rx;
+    std::vector<uint8_t> tx;
+
+    int available() override { return (int)rx.size(); }
+
+    int peek() override { return rx.empty() ? -1 : rx.front(); }
+
+    int read() override {
+        if (rx.empty()) return -1;
+        uint8_t data = rx.front();
+        rx.pop_front();
+        return data;
+    }
+
+    void write_array(const uint8_t *data, size_t len) override { tx.insert(tx.end(), data, data + len); }
+
+    void push(const std::vector<uint8_t> &data) { rx.insert(rx.end(), data.begin(), data.end()); }
+};
+
+// часы, которые идут только тогда, когда их двигает тест
+class FakeClock : public AirConVirtualClock {
+   public:
+    FakeClock() { us = 1000000; }
+};
+
+// лог: сообщения сохраняются, при echo = true еще и печатаются
+class CaptureLogger : public AirConLogger {
+   public:
+    std::vector<std::string> lines;
+    bool echo = false;
+
+    void logv(uint8_t level, unsigned int line, const char *format, va_list args) override {
+        char buf[512];
+        vsnprintf(buf, sizeof(buf), format, args);
+        lines.push_back(buf);
+        if (echo) printf("[%u][AirCon:%u] %s\n", level, line, buf);
+    }
+
+    bool contains(const std::string &text) const {
+        for (const std::string &l : lines)
+            if (l.find(text) != std::string::npos) return true;
+        return false;
+    }
+};
+
+// ядро, подключенное к заглушкам; внутренности ядра открыты для тестов
+class HostAirCon : public AirConCore {
+   public:
+    FakeUart uart;
+    FakeClock clock;
+    CaptureLogger logger;
+    unsigned state_changes = 0;
+
+    HostAirCon() { initCore(&uart, &clock, &logger); }
+
+    void stateChanged() override { state_changes++; }
+
+    // steps шагов конечного автомата, между шагами часы уходят вперед на step_ms
+    void run(unsigned steps, uint32_t step_ms = 1) {
+        for (unsigned i = 0; i < steps; i++) {
+            _doStateMachine();
+            clock.advance_ms(step_ms);
+        }
+    }
+
+    // идет обмен или в автомате есть работа: время надо двигать по 1 мс
+    bool busy() {
+        return hasSequence() || (_ac_state != ACSM_IDLE) || !uart.rx.empty() || (_outPacket.bytesLoaded > 0);
+    }
+
+    // момент следующего опроса статуса по таймеру loopCore()
+    uint32_t next_poll_ms() { return _dataMillis + _update_period + 1; }
+
+    using AirConCore::_addSequenceFuncStep;
+    using AirConCore::_ac_state;
+    using AirConCore::_CRC16;
+    using AirConCore::_checkCRC;
+    using AirConCore::_clearCommand;
+    using AirConCore::_commands_suppressed;
+    using AirConCore::_clearInPacket;
+    using AirConCore::_current_ac_state;
+    using AirConCore::_dataMillis;
+    using AirConCore::_debugPrintPacket;
+    using AirConCore::_doParsingPacket;
+    using AirConCore::_doStateMachine;
+    using AirConCore::_fillSetCommand;
+    using AirConCore::_fillStatusBig;
+    using AirConCore::_fillStatusSmall;
+    using AirConCore::_has_connection;
+    using AirConCore::_inPacket;
+    using AirConCore::_is_inverter;
+    using AirConCore::_outPacket;
+    using AirConCore::_publish_deferred;
+    using AirConCore::_sequences_done;
+    using AirConCore::_sequences_failed;
+    using AirConCore::_stripUnchanged;
+    using AirConCore::_tx_collisions;
+    using AirConCore::_tx_deferrals;
+    using AirConCore::_update_period;
+    using AirConCore::sq_controlDoCommand;
+};
+
+// CRC пакета AUX, посчитанная независимо от ядра: сумма 16-битных слов big-endian, перенос, инверсия
+inline uint16_t reference_crc(const std::vector<uint8_t> &data) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < data.size(); i += 2) {
+        uint32_t word = data[i] << 8;
+        if (i + 1 < data.size()) word += data[i + 1];
+        crc += word;
+    }
+    crc = (crc >> 16) + (crc & 0xFFFF);
+    return (uint16_t)(~crc & 0xFFFF);
+}
+
+// собирает пакет от кондиционера: заголовок, тело и правильная CRC
+inline std::vector<uint8_t> make_packet(uint8_t packet_type, const std::vector<uint8_t> &body) {
+    std::vector<uint8_t> p = {AC_PACKET_START_BYTE, 0x00, packet_type, 0x00, 0x00, 0x00, (uint8_t)body.size(), 0x00};
+    p.insert(p.end(), body.begin(), body.end());
+    uint16_t crc = reference_crc(p);
+    p.push_back(crc >> 8);
+    p.push_back(crc & 0xFF);
+    return p;
+}
+
+// тело малого статуса: 24.5 градуса, жалюзи стоп, охлаждение, низкая скорость, питание включено
+inline std::vector<uint8_t> small_body() {
+    return {0x01, AC_CMD_STATUS_SMALL, (uint8_t)((16 << 3) | 0x07), 0xE0, 0x80, AC_FANSPEED_LOW, 0x00, AC_MODE_COOL,
+            0x00, 0x00, AC_POWER_ON, 0x00, 0x00, 0x00, 0x00};
+}
+
+// тело большого статуса: инвертор, в комнате 23.5, на улице 5, инвертор на 40%
+inline std::vector<uint8_t> big_body(uint8_t length = 0x18, uint8_t room = 23, uint8_t inverter_power = 40) {
+    std::vector<uint8_t> body(length, 0x00);
+    body[0] = 0x01;
+    body[1] = AC_CMD_STATUS_BIG;
+    body[2] = 0x20;
+    body[7] = 0x20 + room;
+    body[9] = 0x20 + 18;
+    body[12] = 0x20 + 5;
+    body[13] = 0x20 + 30;
+    body[14] = 0x20 + 60;
+    body[16] = inverter_power;
+    body[23] = 5;
+    return body;
+}
+
+// простейший сплит: отвечает на запросы статуса и применяет команды установки параметров
+class SplitEmulator {
+   public:
+    explicit SplitEmulator(HostAirCon &ac) : _ac(ac), _small(small_body()) {}
+
+    bool mute = false;
+    uint8_t big_length = 0x18;
+    unsigned commands = 0;
+    unsigned status_requests = 0;
+    uint8_t room = 23;    // температура в комнате, целые градусы
+    uint8_t demand = 40;  // мощность, на которой инвертор работал бы без ограничения, %
+
+    // разбирает все, что модуль отправил с прошлого вызова, и кладет ответы в rx
+    void answer() {
+        std::vector<uint8_t> &tx = _ac.uart.tx;
+        while (_pos + AC_HEADER_SIZE <= tx.size()) {
+            size_t len = AC_HEADER_SIZE + tx[_pos + 6] + 2;
+            if (_pos + len > tx.size()) break;
+            std::vector<uint8_t> packet(tx.begin() + _pos, tx.begin() + _pos + len);
+            _pos += len;
+            if (mute || packet[2] != AC_PTYPE_CMD) continue;
+
+            switch (packet[AC_HEADER_SIZE]) {
+                case AC_CMD_STATUS_SMALL:
+                    status_requests++;
+                    _ac.uart.push(make_packet(AC_PTYPE_INFO, _small));
+                    break;
+                case AC_CMD_STATUS_BIG:
+                    _ac.uart.push(make_packet(AC_PTYPE_INFO, big_body(big_length, room, inverter_power())));
+                    break;
+                case AC_CMD_SET_PARAMS:
+                    commands++;
+                    for (size_t i = 2; i < _small.size(); i++) _small[i] = packet[AC_HEADER_SIZE + i];
+                    _ac.uart.push(make_packet(AC_PTYPE_INFO, {0x01, AC_CMD_SET_PARAMS, packet[len - 2], packet[len - 1]}));
+                    break;
+            }
+        }
+    }
+
+    // прогон автомата вместе с ответами сплита
+    void run(unsigned steps) {
+        for (unsigned i = 0; i < steps; i++) {
+            _ac.run(1);
+            answer();
+        }
+    }
+
+    // ускоренная перемотка на ms миллисекунд полного цикла модуля (loopCore) вместе с ответами сплита:
+    // пока идет обмен, часы идут по 1 мс, в тишине - сразу до следующего опроса статуса
+    void fast_forward(uint64_t ms) {
+        uint64_t end = _ac.clock.us + ms * 1000;
+        while (_ac.clock.us < end) {
+            _ac.loopCore();
+            answer();
+            uint64_t step = 1000;
+            if (!_ac.busy()) {
+                uint64_t wait = (uint64_t)(uint32_t)(_ac.next_poll_ms() - _ac.clock.millis()) * 1000;
+                if (wait > step) step = wait;
+            }
+            if (step > end - _ac.clock.us) step = end - _ac.clock.us;
+            _ac.clock.advance_us(step);
+        }
+    }
+
+    // фактическая мощность инвертора с учетом ограничения, которое сплиту прислали
+    uint8_t inverter_power() {
+        uint8_t limit = _small[13];
+        if ((limit & AC_INVERTER_POWER_LIMITATION_ENABLE_MASK) && (demand > (limit & AC_INVERTER_POWER_LIMITATION_VALUE_MASK)))
+            return limit & AC_INVERTER_POWER_LIMITATION_VALUE_MASK;
+        return demand;
+    }
+
+   private:
+    HostAirCon &_ac;
+    std::vector<uint8_t> _small;
+    size_t _pos = 0;
+};
+
+// кондиционер узла: публикация, как у адаптера, стоит entities сущностей и может откладываться планировщиком
+class NodeAirCon : public HostAirCon {
+   public:
+    uint16_t entities = 13;
+    unsigned publishes = 0;
+    std::function<void(uint8_t)> on_power_limit;  // как у AirCon: ограничение пользователя уходит в бюджет мощности
+
+    void stateChanged() override {
+        if (!_takePublishTurn(entities)) return;
+        HostAirCon::stateChanged();
+        publishes++;
+    }
+
+    void powerLimitationCommanded(uint8_t limit) override {
+        if (on_power_limit) on_power_limit(limit);
+    }
+};
+
+// узел из нескольких кондиционеров, у каждого свой сплит на своем UART; часы у всех идут вместе
+// без общего планировщика работу за проход все равно считает планировщик, но только считает (бюджеты и разнесение выключены)
+class NodeSimulation {
+   public:
+    std::vector<std::unique_ptr<NodeAirCon>> units;
+    std::vector<std::unique_ptr<SplitEmulator>> splits;
+    AirConScheduler scheduler;
+
+    NodeSimulation(uint8_t count, bool shared) {
+        if (!shared) {
+            scheduler.set_stagger_polls(false);
+            scheduler.set_tick_budget(0, 0);
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            units.emplace_back(new NodeAirCon());
+            splits.emplace_back(new SplitEmulator(*units[i]));
+            units[i]->set_tx_guard_time(0);
+            units[i]->set_scheduler(&scheduler);
+            units[i]->uart.push({0xBB, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0xFF});  // ping
+        }
+    }
+
+    // один проход главного цикла узла: loop() всех кондиционеров, ответы сплитов, 1 мс
+    void tick() {
+        for (size_t i = 0; i < units.size(); i++) {
+            units[i]->loopCore();
+            splits[i]->answer();
+        }
+        for (auto &unit : units) unit->clock.advance_ms(1);
+    }
+
+    void run_ms(uint32_t ms) {
+        for (uint32_t i = 0; i < ms; i++) tick();
+    }
+};
+
+}  // namespace aux_ac_host